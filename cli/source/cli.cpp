@@ -2,9 +2,109 @@
 #include <cstring>
 #include <stdio.h>
 #include <stdlib.h> 
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
 
 using namespace IBLLib;
 
+static bool isPanoramaFile(const std::string& _path)
+{
+	const size_t dot = _path.find_last_of('.');
+	if (dot == std::string::npos)
+	{
+		return false;
+	}
+
+	std::string extension = _path.substr(dot + 1u);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(tolower(c)); });
+	return extension == "hdr" || extension == "png" || extension == "jpg" || extension == "jpeg";
+}
+
+// collects the panoramas of a directory, returns false if _path is not a directory
+static bool listDirectory(const std::string& _path, std::vector<std::string>& _outPaths)
+{
+#ifdef _WIN32
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((_path + "\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	do
+	{
+		if ((data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0 && isPanoramaFile(data.cFileName))
+		{
+			_outPaths.push_back(_path + "/" + data.cFileName);
+		}
+	} while (FindNextFileA(find, &data));
+
+	FindClose(find);
+#else
+	DIR* dir = opendir(_path.c_str());
+	if (dir == nullptr)
+	{
+		return false;
+	}
+
+	while (const dirent* entry = readdir(dir))
+	{
+		if (entry->d_name[0] != '.' && isPanoramaFile(entry->d_name))
+		{
+			_outPaths.push_back(_path + "/" + entry->d_name);
+		}
+	}
+
+	closedir(dir);
+#endif
+
+	// directory order is not defined, keep batches reproducible
+	std::sort(_outPaths.begin(), _outPaths.end());
+	return true;
+}
+
+// a directory of panoramas or a text file with one path per line, lines starting with # are ignored
+static bool collectBatchInputs(const char* _path, std::vector<std::string>& _outPaths)
+{
+	if (listDirectory(_path, _outPaths))
+	{
+		return true;
+	}
+
+	std::ifstream list(_path);
+	if (list.is_open() == false)
+	{
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(list, line))
+	{
+		line.erase(line.find_last_not_of(" \t\r") + 1u);
+		if (line.empty() == false && line[0] != '#')
+		{
+			_outPaths.push_back(line);
+		}
+	}
+
+	return true;
+}
+
+static std::string fileStem(const std::string& _path)
+{
+	const size_t slash = _path.find_last_of("/\\");
+	const std::string name = slash == std::string::npos ? _path : _path.substr(slash + 1u);
+	return name.substr(0u, name.find_last_of('.'));
+}
+
 int main(int argc, char* argv[])
 {
 	const char* pathIn = nullptr;
@@ -18,6 +118,19 @@ int main(int argc, char* argv[])
 	float lodBias = 0.0f;
 	bool enableDebugOutput = false;
 	const char* pathOutSH = nullptr;
+	const char* pathBatch = nullptr;
+	const char* pathOutDir = ".";
+	BatchOptions batchOptions;
+	const char* pathOutSpecular = nullptr;
+	const char* pathOutDiffuse = nullptr;
+	const char* pathOutSkybox = nullptr;
+	const char* pathOutGltf = nullptr;
+	unsigned int skyboxResolution = 0u;
+	const char* pathLutCache = nullptr;
+	unsigned int lutResolution = 0u;
+	unsigned int lutSampleCount = 0u;
+	bool hostLUT = false;
+	bool host = false;
 
 	const char* targetFormatString = "R16G16B16A16_SFLOAT";
 	const char* distributionString = "GGX";
@@ -30,7 +143,7 @@ int main(int argc, char* argv[])
 
 		printf("-inputPath: path to panorama image (default) or cube map (if inputIsCubeMap flag ist set) \n");
 		printf("-outCubeMap: output path for filtered cube map\n");
-		printf("-outLUT output path for BRDF LUT\n");
+		printf("-outLUT output path for BRDF LUT, .ktx/.ktx2 keep the float values, other extensions are written as png\n");
 		printf("-outSH: output path for spherical harmonics coefficients (default = sh.txt)\n");
 		printf("-distribution NDF to sample (Lambertian, GGX, Charlie, GGXCubeMap)\n");
 		printf("-sampleCount: number of samples used for filtering (default = 1024)\n");
@@ -38,6 +151,18 @@ int main(int argc, char* argv[])
 		printf("-cubeMapResolution: resolution of output cube map.  If omitted, an optimal resolution is chosen, based on the input panorama's resolution.\n");
 		printf("-targetFormat: specify output texture format (R8G8B8A8_UNORM, R16G16B16A16_SFLOAT, R32G32B32A32_SFLOAT, B10G11R11_UFLOAT_PACK32)  \n");
 		printf("-lodBias: level of detail bias applied to filtering (default = 0) \n");
+		printf("-lutResolution: resolution of the BRDF LUT (default = cubeMapResolution)\n");
+		printf("-lutSampleCount: number of samples per BRDF LUT texel (default = sampleCount)\n");
+		printf("-hostLUT: only writes the BRDF LUT (-outLUT, GGX or Charlie), integrated on the cpu without a vulkan device, and reports its error against a Monte Carlo reference\n");
+		printf("-host: filters the cube map on the cpu without a vulkan device, slow for large cube maps but useful without a gpu or as reference\n");
+		printf("-lutCache: directory in which BRDF LUTs are cached across runs, a cached LUT is copied instead of computed\n");
+		printf("-outSpecular, -outDiffuse, -outSkybox: bundle mode, filters the GGX and Lambertian cube maps of one panorama and writes its skybox as a single unfiltered level in a single run\n");
+		printf("-skyboxResolution: resolution of the skybox cube map in bundle mode (default = cubeMapResolution)\n");
+		printf("-outGltf: bundle mode, output path for an EXT_lights_image_based glTF referencing the specular and skybox cube maps\n");
+		printf("-batch: directory of panoramas or text file with one panorama path per line, replaces -inputPath\n");
+		printf("-outDir: batch output directory, each panorama writes <name>.ktx2 and <name>_sh.txt (default = .)\n");
+		printf("-jobsInFlight: number of batch panoramas decoded, filtered and encoded concurrently (default = %u)\n", batchOptions.maxJobsInFlight);
+		printf("-memoryBudgetMB: host memory for decoded panoramas and readbacks in batch mode (default = %u)\n", static_cast<unsigned int>(batchOptions.memoryBudget >> 20));
 
 		return 0;
 	}
@@ -123,6 +248,143 @@ int main(int argc, char* argv[])
 		{
 			enableDebugOutput = true;
 		}
+		else if (strcmp(argv[i], "-lutResolution") == 0)
+		{
+			lutResolution = strtoul(nextArg, NULL, 0);
+		}
+		else if (strcmp(argv[i], "-lutSampleCount") == 0)
+		{
+			lutSampleCount = strtoul(nextArg, NULL, 0);
+		}
+		else if (strcmp(argv[i], "-hostLUT") == 0)
+		{
+			hostLUT = true;
+		}
+		else if (strcmp(argv[i], "-host") == 0)
+		{
+			host = true;
+		}
+		else if (strcmp(argv[i], "-lutCache") == 0)
+		{
+			pathLutCache = nextArg;
+		}
+		else if (strcmp(argv[i], "-outSpecular") == 0)
+		{
+			pathOutSpecular = nextArg;
+		}
+		else if (strcmp(argv[i], "-outDiffuse") == 0)
+		{
+			pathOutDiffuse = nextArg;
+		}
+		else if (strcmp(argv[i], "-outSkybox") == 0)
+		{
+			pathOutSkybox = nextArg;
+		}
+		else if (strcmp(argv[i], "-outGltf") == 0)
+		{
+			pathOutGltf = nextArg;
+		}
+		else if (strcmp(argv[i], "-skyboxResolution") == 0)
+		{
+			skyboxResolution = strtoul(nextArg, NULL, 0);
+		}
+		else if (strcmp(argv[i], "-batch") == 0)
+		{
+			pathBatch = nextArg;
+		}
+		else if (strcmp(argv[i], "-outDir") == 0)
+		{
+			pathOutDir = nextArg;
+		}
+		else if (strcmp(argv[i], "-jobsInFlight") == 0)
+		{
+			batchOptions.maxJobsInFlight = strtoul(nextArg, NULL, 0);
+		}
+		else if (strcmp(argv[i], "-memoryBudgetMB") == 0)
+		{
+			batchOptions.memoryBudget = static_cast<size_t>(strtoul(nextArg, NULL, 0)) << 20;
+		}
+	}
+
+	if (hostLUT)
+	{
+		LutJob lutJob;
+		lutJob.outputPath = pathOutLUT != nullptr ? pathOutLUT : "outputLUT.png";
+		lutJob.distribution = distribution == Distribution::GGXCubeMap ? Distribution::GGX : distribution;
+		lutJob.resolution = lutResolution != 0u ? lutResolution : lutJob.resolution;
+		lutJob.sampleCount = lutSampleCount != 0u ? lutSampleCount : sampleCount;
+
+		printf("host LUT %ux%u with %u samples to %s\n", lutJob.resolution, lutJob.resolution, lutJob.sampleCount, lutJob.outputPath);
+
+		LutErrorReport report;
+		if (computeLUT(lutJob, &report) != Result::Success)
+		{
+			return -1;
+		}
+
+		printf("error against %u samples at %u texels: max %f %f %f, rms %f %f %f\n", report.referenceSampleCount, report.texelCount,
+			report.maxError[0], report.maxError[1], report.maxError[2], report.rmsError[0], report.rmsError[1], report.rmsError[2]);
+
+		if (report.fileMismatches != 0u)
+		{
+			printf("%u texels of %s differ from the computed LUT\n", report.fileMismatches, lutJob.outputPath);
+			return -1;
+		}
+
+		return 0;
+	}
+
+	if (pathBatch != nullptr)
+	{
+		std::vector<std::string> inputs;
+		if (collectBatchInputs(pathBatch, inputs) == false || inputs.empty())
+		{
+			printf("No panoramas found in %s\n", pathBatch);
+			return -1;
+		}
+
+		// the jobs point into these strings, they have to outlive the batch
+		const std::string outDir = pathOutDir;
+		std::vector<std::string> outCubeMaps;
+		std::vector<std::string> outSHs;
+		for (const std::string& input : inputs)
+		{
+			outCubeMaps.push_back(outDir + "/" + fileStem(input) + ".ktx2");
+			outSHs.push_back(outDir + "/" + fileStem(input) + "_sh.txt");
+		}
+
+		// one LUT for all inputs, see LutCache
+		const std::string outLUT = pathOutLUT != nullptr ? std::string(pathOutLUT) : outDir + "/outputLUT.png";
+
+		std::vector<IblJob> jobs(inputs.size());
+		for (size_t i = 0u; i < inputs.size(); ++i)
+		{
+			IblJob& job = jobs[i];
+			job.inputPath = inputs[i].c_str();
+			job.outputPathCubeMap = outCubeMaps[i].c_str();
+			job.outputPathLUT = i == 0u ? outLUT.c_str() : nullptr;
+			job.outputPathSH = outSHs[i].c_str();
+			job.distribution = distribution;
+			job.cubemapResolution = cubeMapResolution;
+			job.mipmapCount = mipLevelCount;
+			job.sampleCount = sampleCount;
+			job.targetFormat = targetFormat;
+			job.lodBias = lodBias;
+			job.lutCacheDirectory = pathLutCache;
+			job.lutResolution = lutResolution;
+			job.lutSampleCount = lutSampleCount;
+		}
+
+		printf("batch of %zu panoramas, %u jobs in flight, outDir set to %s\n", jobs.size(), batchOptions.maxJobsInFlight, outDir.c_str());
+
+		IblSession session;
+		Result res = session.initialize(enableDebugOutput);
+		if (res == Result::Success)
+		{
+			res = session.runBatch(jobs, batchOptions);
+		}
+
+		return res != Result::Success ? -1 : 0;
 	}
 
 	if (argc == 2)
@@ -136,18 +398,88 @@ int main(int argc, char* argv[])
 		return -1;
 	}
 
-	if (pathOutCubeMap == nullptr)
+	if (pathOutSpecular != nullptr || pathOutDiffuse != nullptr || pathOutSkybox != nullptr || pathOutGltf != nullptr)
+	{
+		IblBundle bundle;
+		bundle.inputPath = pathIn;
+		bundle.outputPathLUT = pathOutLUT;
+		bundle.outputPathSH = pathOutSH;
+		bundle.outputPathGltf = pathOutGltf;
+		bundle.sampleCount = sampleCount;
+		bundle.lodBias = lodBias;
+		bundle.lutCacheDirectory = pathLutCache;
+		bundle.lutDistribution = distribution == Distribution::Charlie ? Distribution::Charlie : Distribution::GGX;
+		bundle.lutResolution = lutResolution;
+		bundle.lutSampleCount = lutSampleCount;
+
+		IblBundleOutput output;
+		output.targetFormat = targetFormat;
+		output.cubemapResolution = cubeMapResolution;
+
+		if (pathOutSpecular != nullptr)
+		{
+			output.outputPath = pathOutSpecular;
+			output.distribution = Distribution::GGX;
+			output.mipmapCount = mipLevelCount;
+			bundle.gltfSpecularCubeMap = static_cast<int>(bundle.cubeMaps.size());
+			bundle.cubeMaps.push_back(output);
+		}
+
+		if (pathOutDiffuse != nullptr)
+		{
+			output.outputPath = pathOutDiffuse;
+			output.distribution = Distribution::Lambertian;
+			output.mipmapCount = 0u;
+			bundle.cubeMaps.push_back(output);
+		}
+
+		if (pathOutSkybox != nullptr)
+		{
+			output.outputPath = pathOutSkybox;
+			output.distribution = Distribution::GGXCubeMap;
+			output.cubemapResolution = skyboxResolution != 0u ? skyboxResolution : cubeMapResolution;
+			// the glTF only references the first level, which is the input at roughness 0
+			output.mipmapCount = 1u;
+			bundle.gltfSkyboxCubeMap = static_cast<int>(bundle.cubeMaps.size());
+			bundle.cubeMaps.push_back(output);
+		}
+
+		if (pathOutGltf != nullptr && pathOutSpecular == nullptr)
+		{
+			printf("-outGltf requires -outSpecular\n");
+			return -1;
+		}
+
+		printf("bundle of %zu cube maps from %s\n", bundle.cubeMaps.size(), pathIn);
+
+		IblSession session;
+		Result res = session.initialize(enableDebugOutput);
+		if (res == Result::Success)
+		{
+			res = session.runBundle(bundle);
+		}
+
+		return res != Result::Success ? -1 : 0;
+	}
+
+	// -outSH alone only projects the panorama, there are no default cube map and LUT outputs
+	const bool shOnly = pathOutSH != nullptr && pathOutCubeMap == nullptr && pathOutLUT == nullptr;
+
+	if (pathOutCubeMap == nullptr && shOnly == false)
 	{
 		pathOutCubeMap = "outputCubeMap.ktx2";
 	}
 
-	if (pathOutLUT == nullptr)
+	if (pathOutLUT == nullptr && shOnly == false)
 	{
 		pathOutLUT = "outputLUT.png";
 	}
 
 	printf("inputPath set to %s \n", pathIn);
-	printf("outCubeMap set to %s \n", pathOutCubeMap);
+	if (pathOutCubeMap != nullptr)
+	{
+		printf("outCubeMap set to %s \n", pathOutCubeMap);
+	}
 
 	if (pathOutLUT != nullptr)
 	{
@@ -165,7 +497,36 @@ int main(int argc, char* argv[])
 	printf("lodBias set to %f \n", lodBias);
 	printf("debug flag is set to %s\n", enableDebugOutput ? "True" : "False");
 
-	Result res = sample(pathIn, pathOutCubeMap, pathOutLUT, pathOutSH, distribution, cubeMapResolution, mipLevelCount, sampleCount, targetFormat, lodBias, enableDebugOutput);
+	IblJob job;
+	job.inputPath = pathIn;
+	job.outputPathCubeMap = pathOutCubeMap;
+	job.outputPathLUT = pathOutLUT;
+	job.outputPathSH = pathOutSH;
+	job.distribution = distribution;
+	job.cubemapResolution = cubeMapResolution;
+	job.mipmapCount = mipLevelCount;
+	job.sampleCount = sampleCount;
+	job.targetFormat = targetFormat;
+	job.lodBias = lodBias;
+	job.lutCacheDirectory = pathLutCache;
+	job.lutResolution = lutResolution;
+	job.lutSampleCount = lutSampleCount;
+
+	// lambertian and SH only jobs do not create a vulkan device
+	Result res = Result::Success;
+	if (host || canRunOnHost(job))
+	{
+		res = runOnHost(job);
+	}
+	else
+	{
+		IblSession session;
+		res = session.initialize(enableDebugOutput);
+		if (res == Result::Success)
+		{
+			res = session.run(job);
+		}
+	}
 
 	if (res != Result::Success)
 	{
@@ -0,0 +1,36 @@
+# Compiles one entry point of a shader that is stored as raw string literal (R""( ... )"") into a SPIR-V header.
+# Usage: cmake -DGLSLANG_VALIDATOR=<exe> -DSOURCE=<shader> -DSTAGE=<vert|frag|comp> -DENTRY_POINT=<name> -DVARIABLE=<name> -DOUTPUT=<header> [-DDEFINES=<A|B=1>] -P embed_spirv.cmake
+
+file(READ "${SOURCE}" shader_text)
+
+# strip the raw string literal wrapper
+string(REGEX REPLACE "^[ \t\r\n]*R\"\"\\(" "" shader_text "${shader_text}")
+string(REGEX REPLACE "\\)\"\"[ \t\r\n]*$" "" shader_text "${shader_text}")
+
+file(WRITE "${OUTPUT}.glsl" "${shader_text}")
+
+set(define_args "")
+if (DEFINES)
+    string(REPLACE "|" ";" define_list "${DEFINES}")
+    foreach(define ${define_list})
+        list(APPEND define_args "-D${define}")
+    endforeach()
+endif()
+
+# same settings as ShaderCompiler::compile
+execute_process(
+    COMMAND "${GLSLANG_VALIDATOR}" -V --target-env vulkan1.0 -S ${STAGE}
+            -e ${ENTRY_POINT} --source-entrypoint ${ENTRY_POINT}
+            --auto-map-bindings --auto-map-locations ${define_args}
+            --vn ${VARIABLE} -o "${OUTPUT}" "${OUTPUT}.glsl"
+    RESULT_VARIABLE result
+    OUTPUT_VARIABLE log
+    ERROR_VARIABLE log
+)
+
+file(REMOVE "${OUTPUT}.glsl")
+
+if (NOT result EQUAL 0)
+    file(REMOVE "${OUTPUT}")
+    message(FATAL_ERROR "Failed to compile ${SOURCE} (${ENTRY_POINT}):\n${log}")
+endif()
@@ -1,5 +1,7 @@
 #pragma once
 #include "ResultType.h"
+#include <memory>
+#include <vector>
 
 namespace IBLLib
 {
@@ -19,5 +21,117 @@ namespace IBLLib
 		GGXCubeMap = 3
 	};
 
+	struct IblJob
+	{
+		const char* inputPath = nullptr;
+		const char* outputPathCubeMap = nullptr; // nullptr: SH (and LUT) only
+		const char* outputPathLUT = nullptr; // .ktx/.ktx2: float LUT, other extensions: 8 bit png
+		const char* outputPathSH = nullptr;
+		Distribution distribution = Distribution::GGX;
+		unsigned int cubemapResolution = 0u; // 0: derived from panorama height
+		unsigned int mipmapCount = 0u; // 0: derived from cubemap resolution
+		unsigned int sampleCount = 1024u;
+		OutputFormat targetFormat = OutputFormat::R16G16B16A16_SFLOAT;
+		float lodBias = 0.0f;
+		bool computeFilter = true; // filter all mip levels with one compute dispatch, falls back to the fragment pipeline if unsupported
+		const char* lutCacheDirectory = nullptr; // BRDF LUTs are cached in this directory across runs, nullptr: in memory for the session only
+		unsigned int lutResolution = 0u; // 0: cube map resolution
+		unsigned int lutSampleCount = 0u; // 0: sampleCount
+	};
+
+	// one cube map of an IblBundle
+	struct IblBundleOutput
+	{
+		const char* outputPath = nullptr;
+		Distribution distribution = Distribution::GGX;
+		unsigned int cubemapResolution = 0u; // 0: derived from panorama height
+		unsigned int mipmapCount = 0u; // 0: derived from cubemap resolution
+		OutputFormat targetFormat = OutputFormat::R16G16B16A16_SFLOAT;
+	};
+
+	// all outputs of one environment: the panorama is decoded, projected, uploaded and converted to a mipmapped cube map once,
+	// every cube map is filtered from that shared input
+	struct IblBundle
+	{
+		const char* inputPath = nullptr;
+		std::vector<IblBundleOutput> cubeMaps;
+		const char* outputPathLUT = nullptr;
+		const char* outputPathSH = nullptr;
+		const char* outputPathGltf = nullptr; // EXT_lights_image_based environment, references the cube maps below
+		int gltfSpecularCubeMap = -1; // index into cubeMaps, required for the glTF
+		int gltfSkyboxCubeMap = -1; // index into cubeMaps, optional
+		unsigned int sampleCount = 1024u;
+		float lodBias = 0.0f;
+		bool computeFilter = true;
+		const char* lutCacheDirectory = nullptr;
+		Distribution lutDistribution = Distribution::GGX; // GGX or Charlie
+		unsigned int lutResolution = 0u; // 0: resolution of the largest cube map
+		unsigned int lutSampleCount = 0u; // 0: sampleCount
+	};
+
+	// BRDF LUT integrated on the host from the same importance samples as the GPU pass, no vulkan device is created
+	struct LutJob
+	{
+		const char* outputPath = nullptr; // .ktx/.ktx2: float LUT, other extensions: 8 bit png
+		Distribution distribution = Distribution::GGX; // GGX or Charlie
+		unsigned int resolution = 128u;
+		unsigned int sampleCount = 1024u;
+		unsigned int referenceSampleCount = 65536u; // samples of the Monte Carlo reference for the LutErrorReport
+	};
+
+	// absolute difference of a host LUT to the reference, per rgb channel
+	struct LutErrorReport
+	{
+		unsigned int referenceSampleCount = 0u;
+		unsigned int texelCount = 0u; // compared texels, a regular subset of at most 32x32
+		float maxError[3] = {};
+		float rmsError[3] = {};
+		unsigned int fileMismatches = 0u; // .ktx/.ktx2 outputs are read back, texels of the file that differ from the computed LUT
+	};
+
+	struct BatchOptions
+	{
+		unsigned int maxJobsInFlight = 3u; // jobs between the start of their decode and the end of their encode
+		size_t memoryBudget = size_t(1024u) << 20; // decoded panoramas and readbacks held in host memory, no new job is started while it is exceeded
+	};
+
+	// Keeps the vulkan device, shaders, pipelines and samplers alive across jobs.
+	// Render targets are kept as well and only recreated if resolution, mip count or target format change.
+	class IblSession
+	{
+	public:
+		IblSession();
+		~IblSession();
+
+		IblSession(const IblSession&) = delete;
+		IblSession& operator=(const IblSession&) = delete;
+
+		Result initialize(bool _debugOutput = false);
+		Result run(const IblJob& _job);
+		Result runBundle(const IblBundle& _bundle);
+		// runs all jobs on this session's device, decoding, filtering and encoding of different jobs overlap.
+		// returns the first failure, the result of every job is written to _outResults if set
+		Result runBatch(const std::vector<IblJob>& _jobs, const BatchOptions& _options = BatchOptions(), std::vector<Result>* _outResults = nullptr);
+		// releases all vulkan resources, the session can be initialized again afterwards
+		void shutdown();
+
+	private:
+		struct Impl;
+		std::unique_ptr<Impl> m_impl;
+	};
+
+	// Lambertian jobs and SH only jobs (neither outputPathCubeMap nor outputPathLUT) never need the gpu, sample() and the cli hand
+	// them to runOnHost. IblSession::run always uses the session's device
+	bool canRunOnHost(const IblJob& _job);
+	// runs any job without a vulkan device: lambertian cube maps are evaluated from the SH projection, GGX and Charlie cube maps
+	// are filtered by a multithreaded port of filter.frag. Much slower than the gpu for large cube maps, meant for small probes
+	// on machines without a gpu and as a reference for the gpu output. computeFilter and lutCacheDirectory are ignored.
+	// No device is created, but the library still links the Vulkan loader, so it has to be installed to load GltfIblSampler
+	Result runOnHost(const IblJob& _job);
+
+	// writes the LUT of _job without a GPU, the error against the reference is only computed if _outReport is set
+	Result computeLUT(const LutJob& _job, LutErrorReport* _outReport = nullptr);
+
+	// convenience function for a single job, creates a temporary IblSession
 	Result sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, const char* _outputPathSH, Distribution _distribution, unsigned int  _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput);
 } // !IBLLib
\ No newline at end of file
@@ -0,0 +1,430 @@
+#include "BrdfLut.h"
+#include "ImportanceSamples.h"
+#include "ktxImage.h"
+#include "LutCache.h"
+#include "Parallel.h"
+#include "STBImage.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+#include <string>
+
+namespace
+{
+	constexpr float pi = 3.14159265358979f;
+
+	// The half vectors only depend on the roughness, they are shared by all texels of a row.
+	// The normal is +z and V lies in the xz plane, so H.y never contributes.
+	// The arrays are padded to a multiple of 4 with samples of weight 0.
+	struct RowSamples
+	{
+		std::vector<float> hx;
+		std::vector<float> hz; // NdotH
+		std::vector<float> weight; // GGX: 1 / NdotH, Charlie: D_Charlie(roughness, NdotH)
+	};
+
+	// GGX() and Charlie() of filter.frag with the hammersley points of getImportanceSample()
+	void sampleRow(IBLLib::Distribution _distribution, float _roughness, uint32_t _sampleCount, RowSamples& _outSamples)
+	{
+		const size_t paddedCount = (static_cast<size_t>(_sampleCount) + 3u) & ~size_t(3u);
+		_outSamples.hx.assign(paddedCount, 0.0f);
+		_outSamples.hz.assign(paddedCount, 1.0f);
+		_outSamples.weight.assign(paddedCount, 0.0f);
+
+		const float alpha = _roughness * _roughness;
+		const float invSheenRoughness = 1.0f / std::max(_roughness, 0.000001f);
+
+		for (uint32_t i = 0u; i < _sampleCount; ++i)
+		{
+			const float xiX = float(i) / float(_sampleCount);
+			const float xiY = IBLLib::radicalInverse(i);
+
+			float cosTheta = 0.0f;
+			float sinTheta = 0.0f;
+			if (_distribution == IBLLib::Distribution::Charlie)
+			{
+				sinTheta = powf(xiY, alpha / (2.0f * alpha + 1.0f));
+				cosTheta = sqrtf(1.0f - sinTheta * sinTheta);
+			}
+			else
+			{
+				cosTheta = std::min(std::max(sqrtf((1.0f - xiY) / (1.0f + (alpha * alpha - 1.0f) * xiY)), 0.0f), 1.0f);
+				sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+			}
+
+			const float phi = 2.0f * pi * xiX;
+
+			_outSamples.hx[i] = sinTheta * cosf(phi);
+			_outSamples.hz[i] = cosTheta;
+
+			if (_distribution == IBLLib::Distribution::Charlie)
+			{
+				const float sin2h = 1.0f - cosTheta * cosTheta;
+				_outSamples.weight[i] = (2.0f + invSheenRoughness) * powf(sin2h, invSheenRoughness * 0.5f) / (2.0f * pi);
+			}
+			else
+			{
+				_outSamples.weight[i] = 1.0f / cosTheta;
+			}
+		}
+	}
+
+	float sum4(IBLLib::float4 _v)
+	{
+		float lanes[4];
+		IBLLib::store4(lanes, _v);
+		return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+	}
+
+	// LUT(NdotV, roughness) of filter.frag, 4 samples at a time.
+	// Samples with NdotL == 0 contribute 0 to every term, which replaces the NdotL > 0 branch.
+	void integrateTexel(IBLLib::Distribution _distribution, float _NdotV, float _roughness, const RowSamples& _samples, uint32_t _sampleCount, float* _outRgba)
+	{
+		using namespace IBLLib;
+
+		const float4 zero = set4(0.0f);
+		const float4 one = set4(1.0f);
+		const float4 two = set4(2.0f);
+		const float4 vx = set4(sqrtf(1.0f - _NdotV * _NdotV));
+		const float4 vz = set4(_NdotV);
+
+		// V_SmithGGXCorrelated
+		const float a2 = _roughness * _roughness * _roughness * _roughness;
+		const float4 a2v = set4(a2);
+		const float4 oneMinusA2 = set4(1.0f - a2);
+		const float4 ggxV = set4(sqrtf(_NdotV * _NdotV * (1.0f - a2) + a2));
+
+		// float lanes are flushed to double every block to keep large reference sample counts accurate
+		const size_t blockSize = 1024u;
+		double sums[3] = {};
+
+		for (size_t block = 0u; block < _samples.hx.size(); block += blockSize)
+		{
+			const size_t blockEnd = std::min(block + blockSize, _samples.hx.size());
+
+			float4 a = zero;
+			float4 b = zero;
+			float4 c = zero;
+
+			for (size_t i = block; i < blockEnd; i += 4u)
+			{
+				const float4 hx = load4(&_samples.hx[i]);
+				const float4 hz = load4(&_samples.hz[i]);
+				const float4 weight = load4(&_samples.weight[i]);
+
+				// L = reflect(-V, H)
+				const float4 VdotH = add4(mul4(vx, hx), mul4(vz, hz));
+				const float4 NdotL = max4(min4(sub4(mul4(two, mul4(VdotH, hz)), vz), one), zero);
+				const float4 VdotHSat = max4(min4(VdotH, one), zero);
+
+				if (_distribution == Distribution::Charlie)
+				{
+					// V_Ashikhmin
+					const float4 visibility = min4(div4(one, mul4(set4(4.0f), sub4(add4(NdotL, vz), mul4(NdotL, vz)))), one);
+					c = add4(c, mul4(mul4(visibility, weight), mul4(NdotL, VdotHSat)));
+				}
+				else
+				{
+					const float4 ggxL = mul4(vz, sqrt4(add4(mul4(mul4(NdotL, NdotL), oneMinusA2), a2v)));
+					const float4 visibility = div4(set4(0.5f), add4(mul4(NdotL, ggxV), ggxL));
+					const float4 vPdf = mul4(mul4(visibility, VdotHSat), mul4(NdotL, weight));
+
+					const float4 t = sub4(one, VdotHSat);
+					const float4 t2 = mul4(t, t);
+					const float4 fc = mul4(mul4(t2, t2), t);
+
+					a = add4(a, mul4(sub4(one, fc), vPdf));
+					b = add4(b, mul4(fc, vPdf));
+				}
+			}
+
+			sums[0] += sum4(a);
+			sums[1] += sum4(b);
+			sums[2] += sum4(c);
+		}
+
+		_outRgba[0] = static_cast<float>(4.0 * sums[0] / _sampleCount);
+		_outRgba[1] = static_cast<float>(4.0 * sums[1] / _sampleCount);
+		_outRgba[2] = static_cast<float>(4.0 * 2.0 * 3.14159265358979 * sums[2] / _sampleCount);
+		_outRgba[3] = 1.0f;
+	}
+
+	// loads a written .ktx/.ktx2 LUT and counts the texels that differ from _halfs, catches row layout errors of encodeLUT
+	IBLLib::Result readBackLUT(const char* _path, IBLLib::Distribution _distribution, uint32_t _resolution, const std::vector<uint16_t>& _halfs, unsigned int& _outMismatches)
+	{
+		using namespace IBLLib;
+
+		std::unique_ptr<IKtxImage> ktxImage;
+		Result res = Result::Success;
+		if (LutCache::getFileFormat(_path) == LutCache::FileFormat::Ktx1)
+		{
+			KtxImage1* ktx1 = new KtxImage1();
+			ktxImage.reset(ktx1);
+			res = ktx1->loadKtx1(_path);
+		}
+		else
+		{
+			KtxImage2* ktx2 = new KtxImage2();
+			ktxImage.reset(ktx2);
+			res = ktx2->loadKtx2(_path);
+		}
+
+		if (res != Result::Success)
+		{
+			return res;
+		}
+
+		const bool charlie = _distribution == Distribution::Charlie;
+		const size_t channels = charlie ? 1u : 2u;
+		const size_t rowBytes = static_cast<size_t>(_resolution) * channels * sizeof(uint16_t);
+		const size_t rowPitch = ktxImage->getRowPitch(0u);
+		size_t offset = 0u;
+		if (ktxImage->getWidth() != _resolution || ktxImage->getHeight() != _resolution ||
+			ktxImage->getFormat() != (charlie ? VK_FORMAT_R16_SFLOAT : VK_FORMAT_R16G16_SFLOAT) ||
+			ktxImage->getImageOffset(0u, 0u, offset) != Result::Success ||
+			rowPitch < rowBytes || offset + rowPitch * (_resolution - 1u) + rowBytes > ktxImage->getDataSize())
+		{
+			printf("LUT %s does not match the written layout\n", _path);
+			return Result::KtxError;
+		}
+
+		_outMismatches = 0u;
+		const uint8_t* data = ktxImage->getData() + offset;
+		for (size_t y = 0u; y < _resolution; ++y)
+		{
+			const uint16_t* texels = reinterpret_cast<const uint16_t*>(data + y * rowPitch);
+			const uint16_t* src = &_halfs[y * _resolution * 4u];
+			for (size_t x = 0u; x < _resolution; ++x)
+			{
+				const bool equal = charlie ?
+					texels[x] == src[x * 4u + 2u] :
+					texels[x * 2u] == src[x * 4u] && texels[x * 2u + 1u] == src[x * 4u + 1u];
+				_outMismatches += equal ? 0u : 1u;
+			}
+		}
+
+		return Result::Success;
+	}
+} // !anonymous namespace
+
+void IBLLib::integrateLUT(Distribution _distribution, uint32_t _resolution, uint32_t _sampleCount, std::vector<float>& _outLUT)
+{
+	_outLUT.assign(static_cast<size_t>(_resolution) * _resolution * 4u, 0.0f);
+
+	// there is no lambertian LUT, same as the shader
+	if (_distribution == Distribution::Lambertian || _sampleCount == 0u)
+	{
+		for (size_t i = 3u; i < _outLUT.size(); i += 4u)
+		{
+			_outLUT[i] = 1.0f;
+		}
+		return;
+	}
+
+	parallelFor(_resolution, [&](size_t _begin, size_t _end)
+	{
+		RowSamples samples;
+		for (size_t y = _begin; y < _end; ++y)
+		{
+			const float roughness = (float(y) + 0.5f) / float(_resolution);
+			sampleRow(_distribution, roughness, _sampleCount, samples);
+
+			for (uint32_t x = 0u; x < _resolution; ++x)
+			{
+				const float NdotV = (float(x) + 0.5f) / float(_resolution);
+				integrateTexel(_distribution, NdotV, roughness, samples, _sampleCount, &_outLUT[(y * _resolution + x) * 4u]);
+			}
+		}
+	});
+}
+
+IBLLib::Result IBLLib::encodeLUT(const char* _outputPath, Distribution _distribution, uint32_t _resolution, const std::vector<uint16_t>& _lut, std::function<Result()>& _outWrite, size_t& _outBytes)
+{
+	const size_t pixelCount = static_cast<size_t>(_resolution) * _resolution;
+	if (_lut.size() != pixelCount * 4u)
+	{
+		return Result::InvalidArgument;
+	}
+
+	const std::string path = _outputPath;
+	const LutCache::FileFormat fileFormat = LutCache::getFileFormat(_outputPath);
+
+	if (fileFormat != LutCache::FileFormat::Png)
+	{
+		// charlie only fills the blue channel, ggx red and green
+		const bool charlie = _distribution == Distribution::Charlie;
+		const uint32_t channels = charlie ? 1u : 2u;
+		const VkFormat format = charlie ? VK_FORMAT_R16_SFLOAT : VK_FORMAT_R16G16_SFLOAT;
+
+		std::shared_ptr<IKtxImage> ktxImage;
+		if (fileFormat == LutCache::FileFormat::Ktx1)
+			ktxImage = std::make_shared<KtxImage1>(_resolution, _resolution, format, 1u, false);
+		else
+			ktxImage = std::make_shared<KtxImage2>(_resolution, _resolution, format, 1u, false);
+
+		// KTX1 pads the rows, an odd width single channel LUT is not dense
+		const size_t rowBytes = static_cast<size_t>(_resolution) * channels * sizeof(uint16_t);
+		const size_t rowPitch = ktxImage->getRowPitch(0u);
+		size_t offset = 0u;
+		if (ktxImage->getData() == nullptr || ktxImage->getImageOffset(0u, 0u, offset) != Result::Success ||
+			rowPitch < rowBytes || offset + rowPitch * (_resolution - 1u) + rowBytes > ktxImage->getDataSize())
+		{
+			return Result::KtxError;
+		}
+
+		uint8_t* data = ktxImage->getData() + offset;
+		parallelFor(_resolution, [&](size_t _begin, size_t _end)
+		{
+			for (size_t y = _begin; y < _end; ++y)
+			{
+				uint16_t* dst = reinterpret_cast<uint16_t*>(data + y * rowPitch);
+				const uint16_t* src = &_lut[y * _resolution * 4u];
+				for (size_t x = 0u; x < _resolution; ++x)
+				{
+					if (charlie)
+					{
+						dst[x] = src[x * 4u + 2u];
+					}
+					else
+					{
+						dst[x * 2u] = src[x * 4u];
+						dst[x * 2u + 1u] = src[x * 4u + 1u];
+					}
+				}
+			}
+		}, 16u);
+
+		_outBytes = ktxImage->getDataSize();
+		_outWrite = [ktxImage, path]()
+		{
+			return ktxImage->save(path.c_str());
+		};
+
+		return Result::Success;
+	}
+
+	// stb_image_write can not write 4 channel pngs and 2 channel images are displayed as grey-alpha,
+	// the LUT is stored as rgb so it can be compared to existing LUT pngs
+	std::shared_ptr<std::vector<uint8_t>> pixels = std::make_shared<std::vector<uint8_t>>(pixelCount * 3u);
+	uint8_t* dst = pixels->data();
+	parallelFor(pixelCount, [&](size_t _begin, size_t _end)
+	{
+		for (size_t i = _begin; i < _end; ++i)
+		{
+			for (size_t c = 0u; c < 3u; ++c)
+			{
+				const float value = std::min(std::max(halfToFloat(_lut[i * 4u + c]), 0.0f), 1.0f);
+				dst[i * 3u + c] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+			}
+		}
+	}, 1024u);
+
+	const int width = static_cast<int>(_resolution);
+	_outBytes = pixels->size();
+	_outWrite = [pixels, path, width]()
+	{
+		STBImage stb_image;
+		return stb_image.savePng(path.c_str(), width, width, 3, pixels->data());
+	};
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::computeLUT(const LutJob& _job, LutErrorReport* _outReport)
+{
+	if (_job.outputPath == nullptr || _job.resolution == 0u || _job.sampleCount == 0u)
+	{
+		return Result::InvalidArgument;
+	}
+
+	if (_job.distribution != Distribution::GGX && _job.distribution != Distribution::Charlie)
+	{
+		printf("Only GGX and Charlie have a BRDF LUT\n");
+		return Result::InvalidArgument;
+	}
+
+	const uint32_t resolution = _job.resolution;
+
+	std::vector<float> lut;
+	integrateLUT(_job.distribution, resolution, _job.sampleCount, lut);
+
+	if (_outReport != nullptr)
+	{
+		// a regular subset of at most 32x32 texels, integrated again with the reference sample count
+		const uint32_t step = std::max(resolution / 32u, 1u);
+		const uint32_t referenceSampleCount = std::max(_job.referenceSampleCount, 1u);
+		const uint32_t rows = (resolution + step - 1u) / step;
+
+		std::vector<double> maxErrors(rows * 3u, 0.0);
+		std::vector<double> squaredErrors(rows * 3u, 0.0);
+
+		parallelFor(rows, [&](size_t _begin, size_t _end)
+		{
+			RowSamples samples;
+			float reference[4];
+			for (size_t row = _begin; row < _end; ++row)
+			{
+				const size_t y = row * step;
+				const float roughness = (float(y) + 0.5f) / float(resolution);
+				sampleRow(_job.distribution, roughness, referenceSampleCount, samples);
+
+				for (uint32_t x = 0u; x < resolution; x += step)
+				{
+					const float NdotV = (float(x) + 0.5f) / float(resolution);
+					integrateTexel(_job.distribution, NdotV, roughness, samples, referenceSampleCount, reference);
+
+					for (size_t c = 0u; c < 3u; ++c)
+					{
+						const double error = fabs(double(lut[(y * resolution + x) * 4u + c]) - double(reference[c]));
+						maxErrors[row * 3u + c] = std::max(maxErrors[row * 3u + c], error);
+						squaredErrors[row * 3u + c] += error * error;
+					}
+				}
+			}
+		});
+
+		const uint32_t columns = (resolution + step - 1u) / step;
+
+		*_outReport = LutErrorReport();
+		_outReport->referenceSampleCount = referenceSampleCount;
+		_outReport->texelCount = rows * columns;
+		for (size_t c = 0u; c < 3u; ++c)
+		{
+			double maxError = 0.0;
+			double squaredError = 0.0;
+			for (size_t row = 0u; row < rows; ++row)
+			{
+				maxError = std::max(maxError, maxErrors[row * 3u + c]);
+				squaredError += squaredErrors[row * 3u + c];
+			}
+			_outReport->maxError[c] = static_cast<float>(maxError);
+			_outReport->rmsError[c] = static_cast<float>(sqrt(squaredError / _outReport->texelCount));
+		}
+	}
+
+	// LUT values are far below the largest half
+	std::vector<uint16_t> halfs(lut.size());
+	for (size_t i = 0u; i < lut.size(); i += 4u)
+	{
+		storeHalf4(&halfs[i], load4(&lut[i]));
+	}
+
+	std::function<Result()> write;
+	size_t bytes = 0u;
+
+	Result res = encodeLUT(_job.outputPath, _job.distribution, resolution, halfs, write, bytes);
+	if (res == Result::Success && (res = write()) != Result::Success)
+	{
+		printf("Could not save to path %s \n", _job.outputPath);
+	}
+
+	if (res == Result::Success && _outReport != nullptr && LutCache::getFileFormat(_job.outputPath) != LutCache::FileFormat::Png)
+	{
+		res = readBackLUT(_job.outputPath, _job.distribution, resolution, halfs, _outReport->fileMismatches);
+	}
+
+	return res;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "GltfIblSampler.h"
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+namespace IBLLib
+{
+	// Host side version of LUT() in filter.frag: rgba per texel, x: NdotV, y: roughness,
+	// rg: GGX scale and bias, b: Charlie scale, a: 1. Same hammersley samples as the shader, rows are integrated in parallel.
+	void integrateLUT(Distribution _distribution, uint32_t _resolution, uint32_t _sampleCount, std::vector<float>& _outLUT);
+
+	// Encodes an rgba16f LUT for _outputPath without writing it: .ktx and .ktx2 keep the float values
+	// (GGX as R16G16 scale and bias, Charlie as R16), any other path is an 8 bit RGB png.
+	// _outWrite writes the file, _outBytes is the host memory it holds.
+	Result encodeLUT(const char* _outputPath, Distribution _distribution, uint32_t _resolution, const std::vector<uint16_t>& _lut, std::function<Result()>& _outWrite, size_t& _outBytes);
+} // !IBLLib
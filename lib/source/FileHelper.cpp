@@ -1,6 +1,17 @@
 #include "FileHelper.h"
 #include <stdio.h>
 
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach-o/dyld.h>
+#include <limits.h>
+#else
+#include <unistd.h>
+#include <limits.h>
+#endif
+
 bool IBLLib::readFile(const char* _path, std::vector<char>& _outBuffer)
 {
 	FILE* file = fopen(_path, "rb");
@@ -41,3 +52,34 @@ bool IBLLib::writeFile(const char* _path, const char* _data, size_t _bytes)
 
 	return sizeWritten > 0u;
 }
+
+std::string IBLLib::getExecutableDirectory()
+{
+	std::string path;
+
+#if defined(_WIN32)
+	char buffer[MAX_PATH];
+	const DWORD length = GetModuleFileNameA(nullptr, buffer, MAX_PATH);
+	if (length > 0u && length < MAX_PATH)
+	{
+		path.assign(buffer, length);
+	}
+#elif defined(__APPLE__)
+	char buffer[PATH_MAX];
+	uint32_t size = sizeof(buffer);
+	if (_NSGetExecutablePath(buffer, &size) == 0)
+	{
+		path = buffer;
+	}
+#else
+	char buffer[PATH_MAX];
+	const ssize_t length = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
+	if (length > 0)
+	{
+		path.assign(buffer, static_cast<size_t>(length));
+	}
+#endif
+
+	const size_t separator = path.find_last_of("/\\");
+	return separator != std::string::npos ? path.substr(0u, separator + 1u) : std::string();
+}
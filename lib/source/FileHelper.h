@@ -1,5 +1,6 @@
 #pragma once
 #include <vector>
+#include <string>
 #include <stddef.h>
 
 namespace IBLLib
@@ -8,6 +9,9 @@ namespace IBLLib
 
 	bool writeFile(const char* _path, const char* _data, size_t _bytes);
 
+	// directory of the running executable including the trailing separator, empty if it can not be determined
+	std::string getExecutableDirectory();
+
 	template <class T>
 	bool writeFile(const char* _path, const std::vector<T>& _outBuffer)
 	{
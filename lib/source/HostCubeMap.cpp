@@ -0,0 +1,153 @@
+#include "HostCubeMap.h"
+#include "format.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string>
+
+namespace
+{
+	// unsigned 5 bit exponent float with _mantissaBits, negative and nan become 0, large values the largest finite value
+	uint32_t floatToUnsignedSmallFloat(float _value, uint32_t _mantissaBits)
+	{
+		if ((_value > 0.0f) == false)
+		{
+			return 0u;
+		}
+
+		const uint32_t maxValue = (0x1eu << _mantissaBits) | ((1u << _mantissaBits) - 1u);
+
+		uint32_t x;
+		memcpy(&x, &_value, 4u);
+
+		const int exponent = static_cast<int>((x >> 23) & 0xffu) - 127 + 15;
+		if (exponent <= 0)
+		{
+			// denormal, rounding up to the smallest normal yields its bit pattern
+			const uint32_t mantissa = static_cast<uint32_t>(ldexpf(_value, 14 + static_cast<int>(_mantissaBits)) + 0.5f);
+			return std::min(mantissa, maxValue);
+		}
+
+		const uint32_t shift = 23u - _mantissaBits;
+		uint32_t bits = (static_cast<uint32_t>(exponent) << _mantissaBits) | ((x & 0x7fffffu) >> shift);
+		const uint32_t remainder = x & ((1u << shift) - 1u);
+		const uint32_t halfway = 1u << (shift - 1u);
+		if (remainder > halfway || (remainder == halfway && (bits & 1u)))
+		{
+			++bits;
+		}
+
+		return std::min(bits, maxValue);
+	}
+
+	uint32_t packB10G11R11(float _r, float _g, float _b)
+	{
+		return floatToUnsignedSmallFloat(_r, 6u) | (floatToUnsignedSmallFloat(_g, 6u) << 11) | (floatToUnsignedSmallFloat(_b, 5u) << 22);
+	}
+} // !anonymous namespace
+
+bool IBLLib::isHostOutputFormat(VkFormat _format)
+{
+	return _format == VK_FORMAT_R32G32B32A32_SFLOAT || _format == VK_FORMAT_R16G16B16A16_SFLOAT ||
+		_format == VK_FORMAT_R8G8B8A8_UNORM || _format == VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+}
+
+IBLLib::Result IBLLib::createCubeMapImage(const char* _outputPath, uint32_t _sideLength, uint32_t _mipLevels, VkFormat _format, std::unique_ptr<IKtxImage>& _outImage, std::vector<uint8_t*>& _outFaces)
+{
+	const std::string path = _outputPath;
+
+	if (path.size() >= 4u && path.substr(path.size() - 4).compare(".ktx") == 0)
+		_outImage = std::make_unique<KtxImage1>(_sideLength, _sideLength, _format, _mipLevels, true);
+	else
+		_outImage = std::make_unique<KtxImage2>(_sideLength, _sideLength, _format, _mipLevels, true);
+
+	if (_outImage->getData() == nullptr)
+	{
+		return Result::KtxError;
+	}
+
+	const size_t texelSize = getFormatSize(_format);
+
+	_outFaces.assign(static_cast<size_t>(_mipLevels) * 6u, nullptr);
+	for (uint32_t level = 0u; level < _mipLevels; ++level)
+	{
+		const size_t side = std::max(_sideLength >> level, 1u);
+		for (uint32_t face = 0u; face < 6u; ++face)
+		{
+			size_t offset = 0u;
+			if (_outImage->getImageOffset(face, level, offset) != Result::Success || offset + texelSize * side * side > _outImage->getDataSize())
+			{
+				return Result::KtxError;
+			}
+			_outFaces[level * 6u + face] = _outImage->getData() + offset;
+		}
+	}
+
+	return Result::Success;
+}
+
+void IBLLib::storeTexels(VkFormat _format, const float* _r, const float* _g, const float* _b, size_t _count, uint8_t* _dst)
+{
+	for (size_t i = 0u; i < _count; ++i)
+	{
+		switch (_format)
+		{
+			case VK_FORMAT_R32G32B32A32_SFLOAT:
+			{
+				const float texel[4] = { _r[i], _g[i], _b[i], 1.0f };
+				memcpy(_dst + i * sizeof(texel), texel, sizeof(texel));
+				break;
+			}
+			case VK_FORMAT_R16G16B16A16_SFLOAT:
+			{
+				const float4 maxHalf = set4(65504.0f);
+				const float4 texel = set4(_r[i], _g[i], _b[i], 1.0f);
+				uint16_t halfs[4];
+				storeHalf4(halfs, max4(min4(texel, maxHalf), sub4(set4(0.0f), maxHalf)));
+				memcpy(_dst + i * sizeof(halfs), halfs, sizeof(halfs));
+				break;
+			}
+			case VK_FORMAT_R8G8B8A8_UNORM:
+			{
+				const float rgb[3] = { _r[i], _g[i], _b[i] };
+				for (size_t c = 0u; c < 3u; ++c)
+				{
+					_dst[i * 4u + c] = static_cast<uint8_t>(std::min(std::max(rgb[c], 0.0f), 1.0f) * 255.0f + 0.5f);
+				}
+				_dst[i * 4u + 3u] = 255u;
+				break;
+			}
+			default: // VK_FORMAT_B10G11R11_UFLOAT_PACK32
+			{
+				const uint32_t packed = packB10G11R11(_r[i], _g[i], _b[i]);
+				memcpy(_dst + i * sizeof(packed), &packed, sizeof(packed));
+				break;
+			}
+		}
+	}
+}
+
+void IBLLib::getTexelDirections(int _face, float4 _u, float _v, float4& _outX, float4& _outY, float4& _outZ)
+{
+	const float4 zero = set4(0.0f);
+	const float4 v = set4(_v);
+
+	// uvToXYZ
+	float4 scanX, scanY, scanZ;
+	switch (_face)
+	{
+		case 0: scanX = set4(1.0f); scanY = v; scanZ = sub4(zero, _u); break;
+		case 1: scanX = set4(-1.0f); scanY = v; scanZ = _u; break;
+		case 2: scanX = _u; scanY = set4(-1.0f); scanZ = v; break;
+		case 3: scanX = _u; scanY = set4(1.0f); scanZ = sub4(zero, v); break;
+		case 4: scanX = _u; scanY = v; scanZ = set4(1.0f); break;
+		default: scanX = sub4(zero, _u); scanY = v; scanZ = set4(-1.0f); break;
+	}
+
+	const float4 length = sqrt4(add4(add4(mul4(scanX, scanX), mul4(scanY, scanY)), mul4(scanZ, scanZ)));
+	const float4 invLength = div4(set4(1.0f), length);
+
+	_outX = mul4(scanZ, invLength);
+	_outY = sub4(zero, mul4(scanY, invLength));
+	_outZ = sub4(zero, mul4(scanX, invLength));
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include "ktxImage.h"
+#include "Simd.h"
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace IBLLib
+{
+	// the OutputFormats, the only formats the host paths write
+	bool isHostOutputFormat(VkFormat _format);
+
+	// Cube map storage for _outputPath, paths ending in .ktx are written as KTX1, anything else as KTX2.
+	// _outFaces points to the first texel of every face of every level, level major, rows are tightly packed.
+	Result createCubeMapImage(const char* _outputPath, uint32_t _sideLength, uint32_t _mipLevels, VkFormat _format, std::unique_ptr<IKtxImage>& _outImage, std::vector<uint8_t*>& _outFaces);
+
+	// writes 4 rgb texels in one of the OutputFormats, only the first _count are kept
+	void storeTexels(VkFormat _format, const float* _r, const float* _g, const float* _b, size_t _count, uint8_t* _dst);
+
+	// direction of filterTexel() in filter.frag for 4 texels of a row: uvToXYZ, then the 90 degree rotation around y and the flip of y.
+	// _u and _v are in [-1, 1]
+	void getTexelDirections(int _face, float4 _u, float _v, float4& _outX, float4& _outY, float4& _outZ);
+} // !IBLLib
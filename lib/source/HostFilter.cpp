@@ -0,0 +1,477 @@
+#include "HostFilter.h"
+#include "HostCubeMap.h"
+#include "ImportanceSamples.h"
+#include "format.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <algorithm>
+#include <math.h>
+#include <memory>
+#include <stdio.h>
+
+namespace
+{
+	constexpr float pi = 3.14159265358979f;
+
+	// output texels are filtered in square tiles of this side, the unit of work of the thread pool
+	constexpr uint32_t tileSize = 16u;
+
+	// One level of the input cube map. Every face has a border of one texel copied from its neighbours,
+	// bilinear taps never leave their face and blend across edges like the seamless cube map filtering of the gpu.
+	struct CubeLevel
+	{
+		uint32_t side = 0u;
+		std::vector<float> texels; // rgba, 6 faces of (side + 2)^2 texels
+
+		// _x and _y in [-1, side], -1 and side address the border
+		size_t getOffset(uint32_t _face, int _x, int _y) const
+		{
+			const size_t stride = side + 2u;
+			return ((_face * stride + static_cast<size_t>(_y + 1)) * stride + static_cast<size_t>(_x + 1)) * 4u;
+		}
+	};
+
+	IBLLib::float4 lerp4(IBLLib::float4 _a, IBLLib::float4 _b, IBLLib::float4 _t)
+	{
+		return IBLLib::add4(_a, IBLLib::mul4(IBLLib::sub4(_b, _a), _t));
+	}
+
+	// uvToXYZ of filter.frag, the direction a texel of the input cube map is rendered for
+	void uvToXYZ(uint32_t _face, float _u, float _v, float& _outX, float& _outY, float& _outZ)
+	{
+		switch (_face)
+		{
+			case 0: _outX = 1.0f; _outY = _v; _outZ = -_u; break;
+			case 1: _outX = -1.0f; _outY = _v; _outZ = _u; break;
+			case 2: _outX = _u; _outY = -1.0f; _outZ = _v; break;
+			case 3: _outX = _u; _outY = 1.0f; _outZ = -_v; break;
+			case 4: _outX = _u; _outY = _v; _outZ = 1.0f; break;
+			default: _outX = -_u; _outY = _v; _outZ = -1.0f; break;
+		}
+	}
+
+	// face and texture coordinates in [0, 1] that vulkan selects for a cube map lookup in direction (_x, _y, _z)
+	void selectFace(float _x, float _y, float _z, uint32_t& _outFace, float& _outS, float& _outT)
+	{
+		const float ax = fabsf(_x);
+		const float ay = fabsf(_y);
+		const float az = fabsf(_z);
+
+		float sc, tc, ma;
+		if (ax >= ay && ax >= az)
+		{
+			_outFace = _x >= 0.0f ? 0u : 1u;
+			sc = _x >= 0.0f ? -_z : _z;
+			tc = -_y;
+			ma = ax;
+		}
+		else if (ay >= az)
+		{
+			_outFace = _y >= 0.0f ? 2u : 3u;
+			sc = _x;
+			tc = _y >= 0.0f ? _z : -_z;
+			ma = ay;
+		}
+		else
+		{
+			_outFace = _z >= 0.0f ? 4u : 5u;
+			sc = _z >= 0.0f ? _x : -_x;
+			tc = -_y;
+			ma = az;
+		}
+
+		_outS = 0.5f * (sc / ma + 1.0f);
+		_outT = 0.5f * (tc / ma + 1.0f);
+	}
+
+	// inverse of selectFace for _sc, _tc in [-1, 1], slightly outside for the border texels
+	void getFaceDirection(uint32_t _face, float _sc, float _tc, float& _outX, float& _outY, float& _outZ)
+	{
+		switch (_face)
+		{
+			case 0: _outX = 1.0f; _outY = -_tc; _outZ = -_sc; break;
+			case 1: _outX = -1.0f; _outY = -_tc; _outZ = _sc; break;
+			case 2: _outX = _sc; _outY = 1.0f; _outZ = _tc; break;
+			case 3: _outX = _sc; _outY = -1.0f; _outZ = -_tc; break;
+			case 4: _outX = _sc; _outY = -_tc; _outZ = 1.0f; break;
+			default: _outX = -_sc; _outY = -_tc; _outZ = -1.0f; break;
+		}
+	}
+
+	// mirrorTexel of filter.frag, _x is at most one image outside
+	int mirrorTexel(int _x, int _size)
+	{
+		_x = _x < 0 ? -1 - _x : _x;
+		return _x >= _size ? 2 * _size - 1 - _x : _x;
+	}
+
+	// bilinear lookup with the mirrored repeat address mode of the panorama sampler
+	IBLLib::float4 samplePanorama(const IBLLib::HostPanorama& _panorama, float _u, float _v)
+	{
+		using namespace IBLLib;
+
+		const int width = static_cast<int>(_panorama.width);
+		const int height = static_cast<int>(_panorama.height);
+
+		const float x = _u * _panorama.width - 0.5f;
+		const float y = _v * _panorama.height - 0.5f;
+		const float x0 = floorf(x);
+		const float y0 = floorf(y);
+
+		const int left = mirrorTexel(static_cast<int>(x0), width);
+		const int right = mirrorTexel(static_cast<int>(x0) + 1, width);
+		const float* top = &_panorama.pixels[static_cast<size_t>(mirrorTexel(static_cast<int>(y0), height)) * width * 4u];
+		const float* bottom = &_panorama.pixels[static_cast<size_t>(mirrorTexel(static_cast<int>(y0) + 1, height)) * width * 4u];
+
+		const float4 wx = set4(x - x0);
+		return lerp4(lerp4(load4(top + left * 4), load4(top + right * 4), wx), lerp4(load4(bottom + left * 4), load4(bottom + right * 4), wx), set4(y - y0));
+	}
+
+	// panoramaToCubeMap of filter.frag for the first level, one face row per task
+	void projectPanorama(const IBLLib::HostPanorama& _panorama, CubeLevel& _level)
+	{
+		const uint32_t side = _level.side;
+
+		IBLLib::parallelFor(static_cast<size_t>(side) * 6u, [&](size_t _begin, size_t _end)
+		{
+			const float scale = 2.0f / static_cast<float>(side);
+
+			for (size_t row = _begin; row < _end; ++row)
+			{
+				const uint32_t face = static_cast<uint32_t>(row / side);
+				const int y = static_cast<int>(row % side);
+				const float v = (y + 0.5f) * scale - 1.0f;
+
+				for (int x = 0; x < static_cast<int>(side); ++x)
+				{
+					float dx, dy, dz;
+					uvToXYZ(face, (x + 0.5f) * scale - 1.0f, v, dx, dy, dz);
+					const float invLength = 1.0f / sqrtf(dx * dx + dy * dy + dz * dz);
+
+					// dirToUV
+					const float u = 0.5f + 0.5f * atan2f(dz * invLength, dx * invLength) / pi;
+					const float w = 1.0f - acosf(std::min(std::max(dy * invLength, -1.0f), 1.0f)) / pi;
+
+					IBLLib::store4(&_level.texels[_level.getOffset(face, x, y)], samplePanorama(_panorama, u, w));
+				}
+			}
+		}, 4u);
+	}
+
+	// linear blit of generateMipmapLevels: every texel is a bilinear lookup at its center with clamped edges,
+	// the average of 2x2 texels for even sides
+	void downsample(const CubeLevel& _src, CubeLevel& _dst)
+	{
+		using namespace IBLLib;
+
+		const int srcSide = static_cast<int>(_src.side);
+		const uint32_t side = _dst.side;
+
+		parallelFor(static_cast<size_t>(side) * 6u, [&](size_t _begin, size_t _end)
+		{
+			const float scale = static_cast<float>(_src.side) / static_cast<float>(side);
+
+			for (size_t row = _begin; row < _end; ++row)
+			{
+				const uint32_t face = static_cast<uint32_t>(row / side);
+				const int y = static_cast<int>(row % side);
+
+				const float sy = (y + 0.5f) * scale - 0.5f;
+				const float y0 = floorf(sy);
+				const int top = std::min(std::max(static_cast<int>(y0), 0), srcSide - 1);
+				const int bottom = std::min(std::max(static_cast<int>(y0) + 1, 0), srcSide - 1);
+				const float4 wy = set4(sy - y0);
+
+				for (int x = 0; x < static_cast<int>(side); ++x)
+				{
+					const float sx = (x + 0.5f) * scale - 0.5f;
+					const float x0 = floorf(sx);
+					const int left = std::min(std::max(static_cast<int>(x0), 0), srcSide - 1);
+					const int right = std::min(std::max(static_cast<int>(x0) + 1, 0), srcSide - 1);
+					const float4 wx = set4(sx - x0);
+
+					const float4 upper = lerp4(load4(&_src.texels[_src.getOffset(face, left, top)]), load4(&_src.texels[_src.getOffset(face, right, top)]), wx);
+					const float4 lower = lerp4(load4(&_src.texels[_src.getOffset(face, left, bottom)]), load4(&_src.texels[_src.getOffset(face, right, bottom)]), wx);
+					store4(&_dst.texels[_dst.getOffset(face, x, y)], lerp4(upper, lower, wy));
+				}
+			}
+		}, 4u);
+	}
+
+	// copies the nearest texel of the neighbouring face into every border texel,
+	// corners are the average of the three faces that meet there
+	void fillBorder(CubeLevel& _level)
+	{
+		using namespace IBLLib;
+
+		const int side = static_cast<int>(_level.side);
+		const float scale = 2.0f / static_cast<float>(side);
+
+		for (uint32_t face = 0u; face < 6u; ++face)
+		{
+			for (int i = 0; i < side; ++i)
+			{
+				const int border[4][2] = { { -1, i }, { side, i }, { i, -1 }, { i, side } };
+				for (const auto& texel : border)
+				{
+					float dx, dy, dz;
+					getFaceDirection(face, (texel[0] + 0.5f) * scale - 1.0f, (texel[1] + 0.5f) * scale - 1.0f, dx, dy, dz);
+
+					uint32_t neighbour = 0u;
+					float s = 0.0f;
+					float t = 0.0f;
+					selectFace(dx, dy, dz, neighbour, s, t);
+
+					const int x = std::min(std::max(static_cast<int>(s * side), 0), side - 1);
+					const int y = std::min(std::max(static_cast<int>(t * side), 0), side - 1);
+					store4(&_level.texels[_level.getOffset(face, texel[0], texel[1])], load4(&_level.texels[_level.getOffset(neighbour, x, y)]));
+				}
+			}
+
+			const int corners[4][2] = { { -1, -1 }, { side, -1 }, { -1, side }, { side, side } };
+			for (const auto& corner : corners)
+			{
+				const int x = std::min(std::max(corner[0], 0), side - 1);
+				const int y = std::min(std::max(corner[1], 0), side - 1);
+
+				const float4 sum = add4(add4(load4(&_level.texels[_level.getOffset(face, x, y)]),
+					load4(&_level.texels[_level.getOffset(face, corner[0], y)])), load4(&_level.texels[_level.getOffset(face, x, corner[1])]));
+				store4(&_level.texels[_level.getOffset(face, corner[0], corner[1])], mul4(sum, set4(1.0f / 3.0f)));
+			}
+		}
+	}
+
+	// bilinear lookup on one face, _s and _t in [0, 1]
+	IBLLib::float4 sampleFace(const CubeLevel& _level, uint32_t _face, float _s, float _t)
+	{
+		using namespace IBLLib;
+
+		const int side = static_cast<int>(_level.side);
+
+		const float x = _s * _level.side - 0.5f;
+		const float y = _t * _level.side - 0.5f;
+		const float x0 = floorf(x);
+		const float y0 = floorf(y);
+		const int left = std::min(std::max(static_cast<int>(x0), -1), side - 1);
+		const int top = std::min(std::max(static_cast<int>(y0), -1), side - 1);
+
+		const float* upper = &_level.texels[_level.getOffset(_face, left, top)];
+		const float* lower = &_level.texels[_level.getOffset(_face, left, top + 1)];
+
+		const float4 wx = set4(x - x0);
+		return lerp4(lerp4(load4(upper), load4(upper + 4), wx), lerp4(load4(lower), load4(lower + 4), wx), set4(y - y0));
+	}
+
+	// textureLod on the input cube map: linear filtering between and within levels, the lod is clamped to the mip chain
+	IBLLib::float4 sampleCube(const std::vector<CubeLevel>& _levels, float _x, float _y, float _z, float _lod)
+	{
+		uint32_t face = 0u;
+		float s = 0.0f;
+		float t = 0.0f;
+		selectFace(_x, _y, _z, face, s, t);
+
+		const float maxLod = static_cast<float>(_levels.size() - 1u);
+		const float lod = _lod > 0.0f ? std::min(_lod, maxLod) : 0.0f;
+		const uint32_t level = static_cast<uint32_t>(lod);
+		const float blend = lod - static_cast<float>(level);
+
+		const IBLLib::float4 color = sampleFace(_levels[level], face, s, t);
+		if (blend > 0.0f)
+		{
+			return lerp4(color, sampleFace(_levels[level + 1u], face, s, t), IBLLib::set4(blend));
+		}
+
+		return color;
+	}
+
+	// filterColor() of filter.frag for the normal _n, the samples are rotated into the frame of generateTBN() 4 at a time
+	IBLLib::float4 filterColor(const std::vector<CubeLevel>& _levels, const IBLLib::ImportanceSamples& _samples, const float _n[3])
+	{
+		using namespace IBLLib;
+
+		float bitangent[3] = { 0.0f, 1.0f, 0.0f };
+		if (1.0f - fabsf(_n[1]) <= 0.0000001f)
+		{
+			// sampling +Y or -Y
+			bitangent[1] = 0.0f;
+			bitangent[2] = _n[1] > 0.0f ? 1.0f : -1.0f;
+		}
+
+		// tangent = normalize(cross(bitangent, N)), bitangent = cross(N, tangent)
+		float tangent[3] = { bitangent[1] * _n[2] - bitangent[2] * _n[1], bitangent[2] * _n[0] - bitangent[0] * _n[2], bitangent[0] * _n[1] - bitangent[1] * _n[0] };
+		const float invLength = 1.0f / sqrtf(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2]);
+		for (float& c : tangent)
+		{
+			c *= invLength;
+		}
+
+		bitangent[0] = _n[1] * tangent[2] - _n[2] * tangent[1];
+		bitangent[1] = _n[2] * tangent[0] - _n[0] * tangent[2];
+		bitangent[2] = _n[0] * tangent[1] - _n[1] * tangent[0];
+
+		float4 frame[3][3];
+		for (size_t c = 0u; c < 3u; ++c)
+		{
+			frame[0][c] = set4(tangent[c]);
+			frame[1][c] = set4(bitangent[c]);
+			frame[2][c] = set4(_n[c]);
+		}
+
+		float4 color = set4(0.0f);
+		float weight = 0.0f;
+
+		for (size_t i = 0u; i < _samples.x.size(); i += 4u)
+		{
+			const float4 sx = load4(&_samples.x[i]);
+			const float4 sy = load4(&_samples.y[i]);
+			const float4 sz = load4(&_samples.z[i]);
+
+			// selectFace projects onto the major axis, L does not need to be normalized
+			float directions[3][4];
+			for (size_t c = 0u; c < 3u; ++c)
+			{
+				store4(directions[c], add4(add4(mul4(frame[0][c], sx), mul4(frame[1][c], sy)), mul4(frame[2][c], sz)));
+			}
+
+			for (size_t lane = 0u; lane < 4u; ++lane)
+			{
+				const float NdotL = _samples.z[i + lane];
+				if (NdotL > 0.0f)
+				{
+					const float4 sample = sampleCube(_levels, directions[0][lane], directions[1][lane], directions[2][lane], _samples.lod[i + lane]);
+					color = add4(color, mul4(sample, set4(NdotL)));
+					weight += NdotL;
+				}
+			}
+		}
+
+		return weight != 0.0f ? mul4(color, set4(1.0f / weight)) : set4(0.0f);
+	}
+
+	struct Tile
+	{
+		uint32_t level = 0u;
+		uint32_t face = 0u;
+		uint32_t x = 0u;
+		uint32_t y = 0u;
+	};
+} // !anonymous namespace
+
+IBLLib::Result IBLLib::filterCubeMapOnHost(const char* _outputPath, const HostPanorama& _panorama, Distribution _distribution, uint32_t _sideLength, uint32_t _mipLevels, uint32_t _sampleCount, float _lodBias, VkFormat _format)
+{
+	if (_outputPath == nullptr || _sideLength == 0u || _mipLevels == 0u || _sampleCount == 0u || _distribution == Distribution::Lambertian ||
+		_panorama.width == 0u || _panorama.height == 0u || _panorama.pixels.size() < static_cast<size_t>(_panorama.width) * _panorama.height * 4u)
+	{
+		return Result::InvalidArgument;
+	}
+
+	if (isHostOutputFormat(_format) == false)
+	{
+		printf("Unsupported target format %u\n", static_cast<uint32_t>(_format));
+		return Result::InvalidArgument;
+	}
+
+	std::unique_ptr<IKtxImage> ktxImage;
+	std::vector<uint8_t*> faces;
+	if (createCubeMapImage(_outputPath, _sideLength, _mipLevels, _format, ktxImage, faces) != Result::Success)
+	{
+		return Result::KtxError;
+	}
+
+	// input cube map of the output resolution with the complete mip chain, like renderInputCubeMap
+	std::vector<CubeLevel> levels;
+	for (uint32_t side = _sideLength; side > 0u; side = side >> 1)
+	{
+		levels.emplace_back();
+		levels.back().side = side;
+		levels.back().texels.resize(static_cast<size_t>(side + 2u) * (side + 2u) * 6u * 4u);
+	}
+
+	projectPanorama(_panorama, levels[0]);
+	fillBorder(levels[0]);
+
+	for (size_t level = 1u; level < levels.size(); ++level)
+	{
+		downsample(levels[level - 1u], levels[level]);
+		fillBorder(levels[level]);
+	}
+
+	std::vector<ImportanceSamples> samples(_mipLevels);
+	std::vector<Tile> tiles;
+
+	for (uint32_t level = 0u; level < _mipLevels; ++level)
+	{
+		const float roughness = _mipLevels > 1u ? static_cast<float>(level) / static_cast<float>(_mipLevels - 1u) : 0.0f;
+		getImportanceSamples(_distribution, roughness, _sampleCount, _sideLength, _sideLength, _lodBias, samples[level]);
+
+		// every tile costs about the same, the largest level comes first and the small ones fill the gaps at the end
+		const uint32_t side = std::max(_sideLength >> level, 1u);
+		for (uint32_t face = 0u; face < 6u; ++face)
+		{
+			for (uint32_t y = 0u; y < side; y += tileSize)
+			{
+				for (uint32_t x = 0u; x < side; x += tileSize)
+				{
+					tiles.push_back({ level, face, x, y });
+				}
+			}
+		}
+	}
+
+	const size_t texelSize = getFormatSize(_format);
+
+	parallelForEach(tiles.size(), [&](size_t _task)
+	{
+		const Tile& tile = tiles[_task];
+		const uint32_t side = std::max(_sideLength >> tile.level, 1u);
+		const uint32_t xEnd = std::min(tile.x + tileSize, side);
+		const uint32_t yEnd = std::min(tile.y + tileSize, side);
+		const float scale = 2.0f / static_cast<float>(side);
+
+		uint8_t* face = faces[tile.level * 6u + tile.face];
+
+		for (uint32_t y = tile.y; y < yEnd; ++y)
+		{
+			const float v = (static_cast<float>(y) + 0.5f) * scale - 1.0f;
+
+			for (uint32_t x = tile.x; x < xEnd; x += 4u)
+			{
+				const float4 u = sub4(mul4(set4(static_cast<float>(x) + 0.5f, static_cast<float>(x) + 1.5f, static_cast<float>(x) + 2.5f, static_cast<float>(x) + 3.5f), set4(scale)), set4(1.0f));
+
+				float4 nx, ny, nz;
+				getTexelDirections(static_cast<int>(tile.face), u, v, nx, ny, nz);
+
+				float normals[3][4];
+				store4(normals[0], nx);
+				store4(normals[1], ny);
+				store4(normals[2], nz);
+
+				const size_t count = std::min(xEnd - x, 4u);
+
+				float rgb[3][4] = {};
+				for (size_t i = 0u; i < count; ++i)
+				{
+					const float normal[3] = { normals[0][i], normals[1][i], normals[2][i] };
+
+					float color[4];
+					store4(color, filterColor(levels, samples[tile.level], normal));
+
+					rgb[0][i] = color[0];
+					rgb[1][i] = color[1];
+					rgb[2][i] = color[2];
+				}
+
+				storeTexels(_format, rgb[0], rgb[1], rgb[2], count, face + (static_cast<size_t>(y) * side + x) * texelSize);
+			}
+		}
+	});
+
+	const Result res = ktxImage->save(_outputPath);
+	if (res != Result::Success)
+	{
+		printf("Could not save to path %s \n", _outputPath);
+	}
+
+	return res;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include "GltfIblSampler.h"
+#include <stdint.h>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace IBLLib
+{
+	// linear rgba panorama, rows top to bottom
+	struct HostPanorama
+	{
+		uint32_t width = 0u;
+		uint32_t height = 0u;
+		std::vector<float> pixels;
+	};
+
+	// Host version of panoramaToCubeMap and the GGX, GGXCubeMap and Charlie filters of filter.frag.
+	// The panorama is projected onto a float cube map of _sideLength with a box filtered mip chain, every output texel is
+	// filtered from it with the importance samples, lods and trilinear seamless lookups of the gpu path.
+	// Tiles of all faces and levels are filtered in parallel, _format is one of the OutputFormats.
+	Result filterCubeMapOnHost(const char* _outputPath, const HostPanorama& _panorama, Distribution _distribution, uint32_t _sideLength, uint32_t _mipLevels, uint32_t _sampleCount, float _lodBias, VkFormat _format);
+} // !IBLLib
@@ -0,0 +1,95 @@
+#include "HostIrradiance.h"
+#include "HostCubeMap.h"
+#include "format.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+IBLLib::Result IBLLib::writeIrradianceCubeMap(const char* _outputPath, const float _shCoeffs[9][4], uint32_t _sideLength, VkFormat _format)
+{
+	if (_outputPath == nullptr || _sideLength == 0u)
+	{
+		return Result::InvalidArgument;
+	}
+
+	if (isHostOutputFormat(_format) == false)
+	{
+		printf("Unsupported target format %u\n", static_cast<uint32_t>(_format));
+		return Result::InvalidArgument;
+	}
+
+	std::unique_ptr<IKtxImage> ktxImage;
+	std::vector<uint8_t*> faces;
+	if (createCubeMapImage(_outputPath, _sideLength, 1u, _format, ktxImage, faces) != Result::Success)
+	{
+		return Result::KtxError;
+	}
+
+	const size_t texelSize = getFormatSize(_format);
+	const size_t rowSize = texelSize * _sideLength;
+
+	// the constants and band weights of sample_sh_irradiance are folded into the coefficients
+	const float basis[9] = { 0.282095f, 0.488603f, 0.488603f, 0.488603f, 1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f };
+	const float bandScale[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+
+	float weights[3][9];
+	for (size_t c = 0u; c < 3u; ++c)
+	{
+		for (size_t k = 0u; k < 9u; ++k)
+		{
+			weights[c][k] = _shCoeffs[k][c] * basis[k] * bandScale[k];
+		}
+	}
+
+	// one task per face row, 4 texels of a row at a time
+	parallelFor(static_cast<size_t>(_sideLength) * 6u, [&](size_t _begin, size_t _end)
+	{
+		const float4 one = set4(1.0f);
+		const float4 three = set4(3.0f);
+		const float scale = 2.0f / static_cast<float>(_sideLength);
+
+		for (size_t row = _begin; row < _end; ++row)
+		{
+			const int face = static_cast<int>(row / _sideLength);
+			const uint32_t y = static_cast<uint32_t>(row % _sideLength);
+			const float v = (static_cast<float>(y) + 0.5f) * scale - 1.0f;
+
+			uint8_t* dst = faces[face] + y * rowSize;
+
+			for (uint32_t x = 0u; x < _sideLength; x += 4u)
+			{
+				const float4 u = sub4(mul4(set4(static_cast<float>(x) + 0.5f, static_cast<float>(x) + 1.5f, static_cast<float>(x) + 2.5f, static_cast<float>(x) + 3.5f), set4(scale)), one);
+
+				float4 dx, dy, dz;
+				getTexelDirections(face, u, v, dx, dy, dz);
+
+				const float4 terms[9] = {
+					one, dy, dz, dx,
+					mul4(dx, dy), mul4(dy, dz), sub4(mul4(three, mul4(dz, dz)), one), mul4(dx, dz), sub4(mul4(dx, dx), mul4(dy, dy))
+				};
+
+				float rgb[3][4];
+				for (size_t c = 0u; c < 3u; ++c)
+				{
+					float4 color = set4(0.0f);
+					for (size_t k = 0u; k < 9u; ++k)
+					{
+						color = add4(color, mul4(set4(weights[c][k]), terms[k]));
+					}
+					store4(rgb[c], color);
+				}
+
+				storeTexels(_format, rgb[0], rgb[1], rgb[2], std::min(_sideLength - x, 4u), dst + x * texelSize);
+			}
+		}
+	}, 4u);
+
+	const Result res = ktxImage->save(_outputPath);
+	if (res != Result::Success)
+	{
+		printf("Could not save to path %s \n", _outputPath);
+	}
+
+	return res;
+}
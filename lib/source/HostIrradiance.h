@@ -0,0 +1,12 @@
+#pragma once
+#include "ResultType.h"
+#include <stdint.h>
+#include <vulkan/vulkan.h>
+
+namespace IBLLib
+{
+	// Lambertian cube map evaluated from the radiance SH on the host, same texel directions and band weights as the
+	// lambertian filter in filter.frag. Single level like the gpu path, _format is one of the OutputFormats.
+	// Paths ending in .ktx are written as KTX1, anything else as KTX2.
+	Result writeIrradianceCubeMap(const char* _outputPath, const float _shCoeffs[9][4], uint32_t _sideLength, VkFormat _format);
+} // !IBLLib
@@ -0,0 +1,97 @@
+#include "ImportanceSamples.h"
+
+#include <algorithm>
+#include <math.h>
+
+namespace
+{
+	constexpr float pi = 3.14159265358979f;
+} // !anonymous namespace
+
+float IBLLib::radicalInverse(uint32_t _bits)
+{
+	_bits = (_bits << 16u) | (_bits >> 16u);
+	_bits = ((_bits & 0x55555555u) << 1u) | ((_bits & 0xAAAAAAAAu) >> 1u);
+	_bits = ((_bits & 0x33333333u) << 2u) | ((_bits & 0xCCCCCCCCu) >> 2u);
+	_bits = ((_bits & 0x0F0F0F0Fu) << 4u) | ((_bits & 0xF0F0F0F0u) >> 4u);
+	_bits = ((_bits & 0x00FF00FFu) << 8u) | ((_bits & 0xFF00FF00u) >> 8u);
+	return float(_bits) * 2.3283064365386963e-10f;
+}
+
+void IBLLib::getImportanceSamples(Distribution _distribution, float _roughness, uint32_t _sampleCount, uint32_t _inputSide, uint32_t _outputSide, float _lodBias, ImportanceSamples& _outSamples)
+{
+	_outSamples = ImportanceSamples();
+
+	const float alpha = _roughness * _roughness;
+
+	// every GGX sample of roughness 0 is the reflection of N, a single one gives the same NdotL weighted average
+	const uint32_t sampleCount = _distribution != Distribution::Charlie && _roughness == 0.0f ? 1u : _sampleCount;
+
+	for (uint32_t i = 0u; i < sampleCount; ++i)
+	{
+		const float xiX = float(i) / float(_sampleCount);
+		const float xiY = radicalInverse(i);
+
+		float cosTheta = 0.0f;
+		float sinTheta = 0.0f;
+		float pdf = 0.0f;
+		if (_distribution == Distribution::Charlie)
+		{
+			sinTheta = powf(xiY, alpha / (2.0f * alpha + 1.0f));
+			cosTheta = sqrtf(1.0f - sinTheta * sinTheta);
+
+			// D_Charlie(alpha, cosTheta)
+			const float invR = 1.0f / std::max(alpha, 0.000001f);
+			pdf = (2.0f + invR) * powf(1.0f - cosTheta * cosTheta, invR * 0.5f) / (2.0f * pi);
+		}
+		else
+		{
+			cosTheta = std::min(std::max(sqrtf((1.0f - xiY) / (1.0f + (alpha * alpha - 1.0f) * xiY)), 0.0f), 1.0f);
+			sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+
+			// D_GGX(cosTheta, alpha)
+			const float a = cosTheta * alpha;
+			const float k = alpha / (1.0f - cosTheta * cosTheta + a * a);
+			pdf = k * k / pi;
+		}
+
+		// jacobian of the reflection, VdotH == NdotH
+		pdf /= 4.0f;
+
+		const float phi = 2.0f * pi * xiX;
+		float hx = sinTheta * cosf(phi);
+		float hy = sinTheta * sinf(phi);
+		float hz = cosTheta;
+		const float invLength = 1.0f / sqrtf(hx * hx + hy * hy + hz * hz);
+		hx *= invLength;
+		hy *= invLength;
+		hz *= invLength;
+
+		// L = reflect(-N, H) in the tangent frame, N is +z
+		const float NdotL = 2.0f * hz * hz - 1.0f;
+		if ((NdotL > 0.0f) == false)
+		{
+			continue;
+		}
+
+		// without the override the roughness 0 lod is too high, a larger input is read at the level matching the output
+		const float lod = _roughness == 0.0f ?
+			_lodBias + std::max(log2f(static_cast<float>(_inputSide) / static_cast<float>(_outputSide)), 0.0f) :
+			0.5f * log2f(6.0f * _inputSide * _inputSide / (static_cast<float>(_sampleCount) * pdf)) + _lodBias;
+
+		_outSamples.x.push_back(2.0f * hz * hx);
+		_outSamples.y.push_back(2.0f * hz * hy);
+		_outSamples.z.push_back(NdotL);
+		_outSamples.lod.push_back(lod);
+	}
+
+	_outSamples.count = static_cast<uint32_t>(_outSamples.x.size());
+
+	while (_outSamples.x.size() % 4u != 0u)
+	{
+		_outSamples.x.push_back(0.0f);
+		_outSamples.y.push_back(0.0f);
+		_outSamples.z.push_back(0.0f);
+		_outSamples.lod.push_back(0.0f);
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "GltfIblSampler.h"
+#include <stdint.h>
+#include <vector>
+
+namespace IBLLib
+{
+	// same as radicalInverse_VdC in filter.frag, the second coordinate of the hammersley points
+	float radicalInverse(uint32_t _bits);
+
+	// The GGX or Charlie importance samples of one output mip level. With V = N the reflected direction L, its NdotL weight
+	// and its lod only depend on the roughness, so they are computed once and shared by all texels.
+	// L is stored in the tangent frame of the normal, samples below the horizon are dropped.
+	// The arrays are padded to a multiple of 4 with samples of NdotL 0. GGX at roughness 0 has a single sample.
+	struct ImportanceSamples
+	{
+		uint32_t count = 0u; // samples above the horizon, without the padding
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z; // NdotL
+		std::vector<float> lod;
+	};
+
+	// getImportanceSample() and computeLod() of filter.frag for the texels of a level with _roughness.
+	// The lod refers to the mip chain of the input cube map of _inputSide, _outputSide is the side of the output's first level
+	void getImportanceSamples(Distribution _distribution, float _roughness, uint32_t _sampleCount, uint32_t _inputSide, uint32_t _outputSide, float _lodBias, ImportanceSamples& _outSamples);
+} // !IBLLib
@@ -0,0 +1,136 @@
+#include "LutCache.h"
+#include "FileHelper.h"
+#include <stdio.h>
+
+bool IBLLib::LutCache::Key::operator<(const Key& _other) const
+{
+	if (distribution != _other.distribution)
+	{
+		return distribution < _other.distribution;
+	}
+
+	if (resolution != _other.resolution)
+	{
+		return resolution < _other.resolution;
+	}
+
+	if (sampleCount != _other.sampleCount)
+	{
+		return sampleCount < _other.sampleCount;
+	}
+
+	return fileFormat < _other.fileFormat;
+}
+
+IBLLib::LutCache::FileFormat IBLLib::LutCache::getFileFormat(const char* _outputPath)
+{
+	const std::string path = _outputPath;
+
+	if (path.size() >= 5u && path.compare(path.size() - 5u, 5u, ".ktx2") == 0)
+	{
+		return FileFormat::Ktx2;
+	}
+
+	if (path.size() >= 4u && path.compare(path.size() - 4u, 4u, ".ktx") == 0)
+	{
+		return FileFormat::Ktx1;
+	}
+
+	return FileFormat::Png;
+}
+
+IBLLib::LutCache::Key IBLLib::LutCache::makeKey(Distribution _distribution, uint32_t _resolution, uint32_t _sampleCount, const char* _outputPath)
+{
+	Key key;
+	key.distribution = _distribution == Distribution::GGXCubeMap ? Distribution::GGX : _distribution;
+	key.resolution = _resolution;
+	key.sampleCount = _sampleCount;
+	key.fileFormat = getFileFormat(_outputPath);
+	return key;
+}
+
+std::string IBLLib::LutCache::getCachePath(const Key& _key, const char* _cacheDirectory)
+{
+	const char* distribution = _key.distribution == Distribution::Charlie ? "charlie" : _key.distribution == Distribution::Lambertian ? "lambertian" : "ggx";
+
+	const char* extension = _key.fileFormat == FileFormat::Ktx2 ? "ktx2" : _key.fileFormat == FileFormat::Ktx1 ? "ktx" : "png";
+
+	char name[96];
+	snprintf(name, sizeof(name), "brdf_lut_%s_%u_%u.%s", distribution, _key.resolution, _key.sampleCount, extension);
+
+	std::string path = _cacheDirectory;
+	if (path.empty() == false && path.back() != '/' && path.back() != '\\')
+	{
+		path += '/';
+	}
+
+	return path + name;
+}
+
+bool IBLLib::LutCache::write(const Key& _key, const char* _cacheDirectory, const char* _outputPath)
+{
+	std::vector<char> lut;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_luts.find(_key);
+		if (it != m_luts.end())
+		{
+			lut = it->second;
+		}
+	}
+
+	if (lut.empty() && _cacheDirectory != nullptr)
+	{
+		// probe quietly, a missing file is the common case and not an error
+		const std::string cachePath = getCachePath(_key, _cacheDirectory);
+		FILE* file = fopen(cachePath.c_str(), "rb");
+		if (file != nullptr)
+		{
+			fclose(file);
+			if (readFile(cachePath.c_str(), lut))
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_luts[_key] = lut;
+			}
+			else
+			{
+				lut.clear();
+			}
+		}
+	}
+
+	if (lut.empty())
+	{
+		return false;
+	}
+
+	if (writeFile(_outputPath, lut) == false)
+	{
+		return false;
+	}
+
+	printf("BRDF LUT taken from the cache\n");
+	return true;
+}
+
+void IBLLib::LutCache::store(const Key& _key, const char* _cacheDirectory, const char* _path)
+{
+	std::vector<char> lut;
+	if (readFile(_path, lut) == false)
+	{
+		return;
+	}
+
+	if (_cacheDirectory != nullptr)
+	{
+		const std::string cachePath = getCachePath(_key, _cacheDirectory);
+		if (cachePath != _path)
+		{
+			writeFile(cachePath.c_str(), lut);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_luts[_key] = std::move(lut);
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include "GltfIblSampler.h"
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace IBLLib
+{
+	// The BRDF LUT only depends on the distribution, its resolution and the sample count, never on the panorama.
+	// Encoded LUTs are kept in memory and optionally in a cache directory, a hit copies the file instead of computing
+	// and encoding the LUT again. Thread safe.
+	class LutCache
+	{
+	public:
+		// the same LUT encodes differently depending on the output file extension
+		enum class FileFormat : uint32_t
+		{
+			Png = 0,
+			Ktx1,
+			Ktx2
+		};
+
+		struct Key
+		{
+			Distribution distribution = Distribution::GGX;
+			uint32_t resolution = 0u;
+			uint32_t sampleCount = 0u;
+			FileFormat fileFormat = FileFormat::Png;
+
+			bool operator<(const Key& _other) const;
+		};
+
+		// .ktx and .ktx2 paths are written as float KTX, anything else as PNG
+		static FileFormat getFileFormat(const char* _outputPath);
+
+		// GGX and GGXCubeMap share their LUT
+		static Key makeKey(Distribution _distribution, uint32_t _resolution, uint32_t _sampleCount, const char* _outputPath);
+
+		// writes the cached LUT to _outputPath, false on a miss. _cacheDirectory may be nullptr.
+		bool write(const Key& _key, const char* _cacheDirectory, const char* _outputPath);
+
+		// adds the LUT that was just written to _path
+		void store(const Key& _key, const char* _cacheDirectory, const char* _path);
+
+	private:
+		static std::string getCachePath(const Key& _key, const char* _cacheDirectory);
+
+		std::mutex m_mutex;
+		std::map<Key, std::vector<char>> m_luts;
+	};
+} // !IBLLib
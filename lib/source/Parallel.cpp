@@ -0,0 +1,77 @@
+#include "Parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+size_t IBLLib::getWorkerCount()
+{
+	const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	return hardwareThreads > 0u ? static_cast<size_t>(hardwareThreads) : 1u;
+}
+
+void IBLLib::parallelFor(size_t _count, const std::function<void(size_t _begin, size_t _end)>& _func, size_t _minRange)
+{
+	if (_count == 0u)
+	{
+		return;
+	}
+
+	_minRange = std::max<size_t>(_minRange, 1u);
+	const size_t rangeCount = std::min(getWorkerCount(), (_count + _minRange - 1u) / _minRange);
+
+	if (rangeCount <= 1u)
+	{
+		_func(0u, _count);
+		return;
+	}
+
+	const size_t rangeSize = (_count + rangeCount - 1u) / rangeCount;
+
+	std::vector<std::thread> threads;
+	threads.reserve(rangeCount - 1u);
+
+	size_t begin = 0u;
+	for (; begin + rangeSize < _count; begin += rangeSize)
+	{
+		threads.emplace_back(_func, begin, begin + rangeSize);
+	}
+
+	_func(begin, _count);
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void IBLLib::parallelForEach(size_t _count, const std::function<void(size_t _task)>& _func)
+{
+	std::atomic<size_t> nextTask(0u);
+
+	const auto worker = [&]()
+	{
+		for (size_t task = nextTask++; task < _count; task = nextTask++)
+		{
+			_func(task);
+		}
+	};
+
+	const size_t threadCount = std::min(getWorkerCount(), _count);
+
+	std::vector<std::thread> threads;
+	threads.reserve(threadCount > 0u ? threadCount - 1u : 0u);
+
+	for (size_t i = 1u; i < threadCount; ++i)
+	{
+		threads.emplace_back(worker);
+	}
+
+	worker();
+
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <functional>
+#include <stddef.h>
+
+namespace IBLLib
+{
+	// number of worker threads used by parallelFor, at least one
+	size_t getWorkerCount();
+
+	// splits [0, _count) into contiguous ranges of at least _minRange items and calls _func(begin, end) for each of them
+	// on its own thread, the calling thread takes the last range and returns once all ranges are done
+	void parallelFor(size_t _count, const std::function<void(size_t _begin, size_t _end)>& _func, size_t _minRange = 1u);
+
+	// calls _func(task) for every task in [0, _count), idle threads take the next unclaimed task so tasks of uneven cost
+	// balance across the workers. The calling thread works as well and returns once all tasks are done
+	void parallelForEach(size_t _count, const std::function<void(size_t _task)>& _func);
+} // !IBLLib
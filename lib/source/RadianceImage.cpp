@@ -0,0 +1,320 @@
+#include "RadianceImage.h"
+#include "FileHelper.h"
+#include "Parallel.h"
+#include "Simd.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+namespace
+{
+	// reads a header line starting at _offset, returns false at the end of the buffer
+	bool readLine(const std::vector<char>& _file, size_t& _offset, std::string& _outLine)
+	{
+		_outLine.clear();
+		while (_offset < _file.size())
+		{
+			const char c = _file[_offset++];
+			if (c == '\n')
+			{
+				return true;
+			}
+			_outLine.push_back(c);
+		}
+		return false;
+	}
+
+	// scale for every shared exponent, same values as stb_image's ldexp(1, e - 136) and zero for e == 0
+	struct ExponentTable
+	{
+		ExponentTable()
+		{
+			scale[0] = 0.0f;
+			for (int e = 1; e < 256; ++e)
+			{
+				scale[e] = ldexpf(1.0f, e - (128 + 8));
+			}
+		}
+
+		float scale[256];
+	};
+
+	// converts a row of rgbe pixels to rgba32f with alpha 1
+	void rgbeToFloat(const uint8_t* _rgbe, float* _outRgba, size_t _count)
+	{
+		static const ExponentTable table;
+		const IBLLib::float4 alpha = IBLLib::set4(0.0f, 0.0f, 0.0f, 1.0f);
+
+		for (size_t x = 0u; x < _count; ++x, _rgbe += 4u, _outRgba += 4u)
+		{
+			// the exponent lane is multiplied by zero and replaced by the alpha
+			const float scale = table.scale[_rgbe[3]];
+			const IBLLib::float4 rgbe = IBLLib::bytesToFloat4(_rgbe);
+			IBLLib::store4(_outRgba, IBLLib::add4(IBLLib::mul4(rgbe, IBLLib::set4(scale, scale, scale, 0.0f)), alpha));
+		}
+	}
+} // !anonymous namespace
+
+IBLLib::Result IBLLib::RadianceImage::open(const char* _path)
+{
+	m_file.clear();
+	m_scanlineOffsets.clear();
+	m_width = 0;
+	m_height = 0;
+
+	FILE* file = fopen(_path, "rb");
+	if (file == nullptr)
+	{
+		return Result::FileNotFound;
+	}
+
+	// check the magic before reading the whole file
+	char magic[11] = {};
+	const size_t magicSize = fread(magic, 1u, 10u, file);
+	fclose(file);
+
+	if (magicSize < 6u || (strncmp(magic, "#?RADIANCE", 10) != 0 && strncmp(magic, "#?RGBE", 6) != 0))
+	{
+		return Result::InvalidArgument;
+	}
+
+	if (readFile(_path, m_file) == false)
+	{
+		return Result::FileNotFound;
+	}
+
+	size_t offset = 0u;
+	std::string line;
+	bool validFormat = false;
+
+	// header lines up to the first empty one
+	while (readLine(m_file, offset, line) && line.empty() == false)
+	{
+		if (line == "FORMAT=32-bit_rle_rgbe")
+		{
+			validFormat = true;
+		}
+	}
+
+	if (validFormat == false)
+	{
+		printf("Unsupported Radiance format\n");
+		return Result::InvalidArgument;
+	}
+
+	// only the common top down, left to right orientation is supported, same as stb_image
+	if (readLine(m_file, offset, line) == false || sscanf(line.c_str(), "-Y %d +X %d", &m_height, &m_width) != 2 || m_width <= 0 || m_height <= 0)
+	{
+		printf("Unsupported Radiance resolution string\n");
+		m_width = 0;
+		m_height = 0;
+		return Result::InvalidArgument;
+	}
+
+	m_dataOffset = offset;
+
+	return Result::Success;
+}
+
+size_t IBLLib::RadianceImage::skipScanline(size_t _offset) const
+{
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(m_file.data());
+	const size_t size = m_file.size();
+	const size_t width = static_cast<size_t>(m_width);
+
+	if (_offset + 4u > size)
+	{
+		return 0u;
+	}
+
+	const uint8_t* header = data + _offset;
+	const bool rle = m_width >= 8 && m_width < 32768 && header[0] == 2u && header[1] == 2u && ((size_t(header[2]) << 8) | header[3]) == width;
+
+	if (rle == false)
+	{
+		// flat scanline
+		return _offset + width * 4u <= size ? _offset + width * 4u : 0u;
+	}
+
+	// only the run headers are visited, runs occupy one byte and literals their count
+	size_t offset = _offset + 4u;
+	for (size_t component = 0u; component < 4u; ++component)
+	{
+		size_t x = 0u;
+		while (x < width)
+		{
+			if (offset >= size)
+			{
+				return 0u;
+			}
+
+			size_t count = data[offset++];
+			const bool run = count > 128u;
+			count = run ? count - 128u : count;
+
+			if (count == 0u || x + count > width)
+			{
+				return 0u;
+			}
+
+			x += count;
+			offset += run ? 1u : count;
+		}
+	}
+
+	return offset <= size ? offset : 0u;
+}
+
+void IBLLib::RadianceImage::decodeScanline(size_t _offset, float* _outRow, uint8_t* _outRgbeRow, std::vector<uint8_t>& _rgbe) const
+{
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(m_file.data());
+	const size_t width = static_cast<size_t>(m_width);
+
+	// offsets were validated by skipScanline
+	const uint8_t* header = data + _offset;
+	const bool rle = m_width >= 8 && m_width < 32768 && header[0] == 2u && header[1] == 2u && ((size_t(header[2]) << 8) | header[3]) == width;
+
+	const uint8_t* rgbe = header;
+
+	if (rle == false)
+	{
+		// flat scanline
+		if (_outRgbeRow != nullptr)
+		{
+			memcpy(_outRgbeRow, header, width * 4u);
+		}
+	}
+	else
+	{
+		// adaptive run length encoding, the four components are stored one after another
+		uint8_t* dst = _outRgbeRow;
+		if (dst == nullptr)
+		{
+			_rgbe.resize(width * 4u);
+			dst = _rgbe.data();
+		}
+
+		size_t offset = _offset + 4u;
+
+		for (size_t component = 0u; component < 4u; ++component)
+		{
+			size_t x = 0u;
+			while (x < width)
+			{
+				size_t count = data[offset++];
+				if (count > 128u)
+				{
+					// run of a single value
+					count -= 128u;
+					const uint8_t value = data[offset++];
+					for (size_t i = 0u; i < count; ++i, ++x)
+					{
+						dst[x * 4u + component] = value;
+					}
+				}
+				else
+				{
+					// literal values
+					for (size_t i = 0u; i < count; ++i, ++x)
+					{
+						dst[x * 4u + component] = data[offset++];
+					}
+				}
+			}
+		}
+
+		rgbe = dst;
+	}
+
+	if (_outRow != nullptr)
+	{
+		rgbeToFloat(rgbe, _outRow, width);
+	}
+}
+
+IBLLib::Result IBLLib::RadianceImage::decode(float* _outPixels, const ScanlineCallback& _onScanline)
+{
+	return decodeRows(_outPixels, nullptr, 0, m_height, _onScanline);
+}
+
+IBLLib::Result IBLLib::RadianceImage::decodeRgbe(uint8_t* _outRgbe, const ScanlineCallback& _onScanline)
+{
+	return decodeRows(nullptr, _outRgbe, 0, m_height, _onScanline);
+}
+
+IBLLib::Result IBLLib::RadianceImage::decodeRgbe(uint8_t* _outRgbe, int _rowBegin, int _rowEnd, const ScanlineCallback& _onScanline)
+{
+	return decodeRows(nullptr, _outRgbe, _rowBegin, _rowEnd, _onScanline);
+}
+
+IBLLib::Result IBLLib::RadianceImage::indexScanlines()
+{
+	if (m_scanlineOffsets.size() == static_cast<size_t>(m_height))
+	{
+		return Result::Success;
+	}
+
+	// scanlines are independent once their offsets are known, a quick pass over the run headers finds them
+	std::vector<size_t> offsets(m_height);
+	size_t offset = m_dataOffset;
+	for (int y = 0; y < m_height; ++y)
+	{
+		offsets[y] = offset;
+		if ((offset = skipScanline(offset)) == 0u)
+		{
+			printf("Corrupt Radiance scanline %d\n", y);
+			return Result::InvalidArgument;
+		}
+	}
+
+	m_scanlineOffsets.swap(offsets);
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::RadianceImage::decodeRows(float* _outPixels, uint8_t* _outRgbe, int _rowBegin, int _rowEnd, const ScanlineCallback& _onScanline)
+{
+	if (m_file.empty() || m_width <= 0 || m_height <= 0 || _rowBegin < 0 || _rowEnd > m_height || _rowBegin > _rowEnd)
+	{
+		return Result::InvalidArgument;
+	}
+
+	Result res = Result::Success;
+	if ((res = indexScanlines()) != Result::Success)
+	{
+		return res;
+	}
+
+	const size_t rowFloats = static_cast<size_t>(m_width) * 4u;
+	const bool needFloatRows = _outPixels != nullptr || _onScanline;
+
+	parallelFor(static_cast<size_t>(_rowEnd - _rowBegin), [&](size_t _begin, size_t _end)
+	{
+		std::vector<uint8_t> rgbe;
+
+		// without a float output image a single row per thread is converted at a time
+		std::vector<float> scratchRow;
+		if (_outPixels == nullptr && needFloatRows)
+		{
+			scratchRow.resize(rowFloats);
+		}
+
+		for (size_t i = _begin; i < _end; ++i)
+		{
+			float* row = _outPixels != nullptr ? _outPixels + i * rowFloats : (needFloatRows ? scratchRow.data() : nullptr);
+			uint8_t* rgbeRow = _outRgbe != nullptr ? _outRgbe + i * rowFloats : nullptr;
+			const int y = _rowBegin + static_cast<int>(i);
+			decodeScanline(m_scanlineOffsets[y], row, rgbeRow, rgbe);
+
+			// the row is still in cache, hand it over right away
+			if (_onScanline)
+			{
+				_onScanline(y, row);
+			}
+		}
+	}, 8u);
+
+	return Result::Success;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "ResultType.h"
+#include <functional>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace IBLLib
+{
+	// streaming decoder for Radiance .hdr (rgbe) files
+	class RadianceImage
+	{
+	public:
+		// called with the row index counted from the top and the rgba32f pixels of that row,
+		// rows are decoded in parallel so the callback may run concurrently for different rows
+		using ScanlineCallback = std::function<void(int _row, const float* _pixels)>;
+
+		// reads the file and parses its header, fails without printing if the file is not a Radiance image
+		Result open(const char* _path);
+
+		// decodes all scanlines as rgba32f into _outPixels (width * height * 4 floats), _onScanline is called for every row
+		// right after it was decoded. _outPixels may be null if the caller is only interested in the callback.
+		Result decode(float* _outPixels, const ScanlineCallback& _onScanline = nullptr);
+
+		// same as decode but keeps the pixels in their compact rgbe form (width * height * 4 bytes), the callback still receives rgba32f rows
+		Result decodeRgbe(uint8_t* _outRgbe, const ScanlineCallback& _onScanline = nullptr);
+
+		// decodes rows [_rowBegin, _rowEnd) only, _outRgbe receives the first row of the range
+		Result decodeRgbe(uint8_t* _outRgbe, int _rowBegin, int _rowEnd, const ScanlineCallback& _onScanline = nullptr);
+
+		size_t getByteSize() const { return (size_t)m_width * (size_t)m_height * 4u * sizeof(float); }
+
+		int getWidth() const { return m_width; }
+		int getHeight() const { return m_height; }
+
+	private:
+		// returns the offset of the scanline following the one at _offset without decoding it, 0 on failure
+		size_t skipScanline(size_t _offset) const;
+
+		// decodes one scanline starting at _offset into _outRow and/or _outRgbeRow, either may be null
+		void decodeScanline(size_t _offset, float* _outRow, uint8_t* _outRgbeRow, std::vector<uint8_t>& _rgbe) const;
+
+		// finds the offset of every scanline once, see m_scanlineOffsets
+		Result indexScanlines();
+
+		Result decodeRows(float* _outPixels, uint8_t* _outRgbe, int _rowBegin, int _rowEnd, const ScanlineCallback& _onScanline);
+
+		std::vector<char> m_file;
+		size_t m_dataOffset = 0u;
+		std::vector<size_t> m_scanlineOffsets;
+		int m_width = 0;
+		int m_height = 0;
+	};
+} // !IBLLib
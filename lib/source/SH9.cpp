@@ -1,28 +1,64 @@
 // https://graphics.stanford.edu/papers/envmap/prefilter.c
 
 #include "SH9.h"
+#include "Parallel.h"
+#include "Simd.h"
+#include <algorithm>
+
+using namespace IBLLib;
 
 float SH9::coeffs[9][4] = { 0 }; // 4 for alignment
 int SH9::width = 0;
 int SH9::height = 0;
 int SH9::channels = 0;
-float* SH9::data = nullptr;
+const float* SH9::data = nullptr;
+float* SH9::ownedData = nullptr;
 std::string SH9::shOutputPath = "sh9.txt";
 
 void SH9::init(const char* filename, const char* outputPath) {
-	if (outputPath) {
-		shOutputPath = outputPath;
-	}
+	release();
 
-	stbi_set_flip_vertically_on_load(true);
+	// rows are flipped while projecting, the file is decoded as is
+	stbi_set_flip_vertically_on_load(false);
 
-	data = stbi_loadf(filename, &width, &height, &channels, 0);
-	if (!data) {
+	int fileWidth = 0, fileHeight = 0, fileChannels = 0;
+	ownedData = stbi_loadf(filename, &fileWidth, &fileHeight, &fileChannels, 0);
+	if (!ownedData) {
 		std::cerr << "Failed to load HDR image: " << filename << "\n";
 		exit(1);
 	}
 
+	init(ownedData, fileWidth, fileHeight, fileChannels, outputPath);
+}
+
+void SH9::init(const float* pixels, int pixelWidth, int pixelHeight, int pixelChannels, const char* outputPath) {
+	// state is static, reset whatever the previous image left behind
+	if (pixels != ownedData) {
+		release();
+	}
+
+	shOutputPath = outputPath ? outputPath : "sh9.txt";
+	std::fill(&coeffs[0][0], &coeffs[0][0] + 9 * 4, 0.0f);
+
+	data = pixels;
+	width = pixelWidth;
+	height = pixelHeight;
+	channels = pixelChannels;
+
 	prefilter();
+
+	// borrowed pixels are not kept past the call
+	if (pixels != ownedData) {
+		data = nullptr;
+	}
+}
+
+void SH9::release() {
+	if (ownedData) {
+		stbi_image_free(ownedData);
+		ownedData = nullptr;
+	}
+	data = nullptr;
 }
 
 void SH9::updateCoeffs(const vec3& hdrColor, float domega, float x, float y, float z) {
@@ -50,53 +86,196 @@ void SH9::updateCoeffs(const vec3& hdrColor, float domega, float x, float y, flo
 	}
 }
 
-void SH9::prefilter() {
-	std::ofstream shFile(shOutputPath);
-	if (!shFile.is_open()) {
-		std::cerr << "Error: Failed to open sh.txt!\n";
-		return;
+namespace {
+	const float Pi = 3.14159265359f;
+
+	// sums of a single row, 9 coefficients times rgb
+	struct RowSums {
+		double c[9][3];
+	};
+
+	// state of the running projection, see SH9::beginRows
+	std::vector<float> sinTheta;
+	std::vector<float> cosTheta;
+	std::vector<RowSums> rowSums;
+
+	// evaluates the 9 basis functions for 4 pixels at once, weighted by their solid angle
+	inline void evalBasis4(float4 x, float4 y, float4 z, float4 domega, float4 (&basis)[9]) {
+		const float4 c0 = set4(0.282095f);
+		const float4 c1 = set4(0.488603f);
+		const float4 c2 = set4(1.092548f);
+		const float4 c3 = set4(0.375392f);
+		const float4 c4 = set4(0.546274f);
+
+		basis[0] = mul4(c0, domega);
+		basis[1] = mul4(mul4(c1, y), domega);
+		basis[2] = mul4(mul4(c1, z), domega);
+		basis[3] = mul4(mul4(c1, x), domega);
+		basis[4] = mul4(mul4(c2, mul4(x, y)), domega);
+		basis[5] = mul4(mul4(c2, mul4(y, z)), domega);
+		basis[6] = mul4(mul4(c3, sub4(mul4(set4(3.0f), mul4(z, z)), set4(1.0f))), domega);
+		basis[7] = mul4(mul4(c2, mul4(x, z)), domega);
+		basis[8] = mul4(mul4(c4, sub4(mul4(x, x), mul4(y, y))), domega);
 	}
 
-	// Sample the envrionment map
-	for (int i = 0; i < height; i++) {
-		for (int j = 0; j < width; j++) {
-			// Convert equirectangular coordinates to spherical coordinates
-			float ww = (2.0f * j / width - 1.0f); // [-1, 1]
-			float hh = (1.0f - 2.0f * i / float(height)); // [1, -1]
+	// projects the pixels of row _row counted from the bottom of the image, the direction only depends on the column through the precomputed theta tables
+	void projectRow(const float* _pixels, int _width, int _height, int _channels, int _row,
+		const std::vector<float>& _sinTheta, const std::vector<float>& _cosTheta, RowSums& _out) {
+		// phi, its sine and cosine and the solid angle are constant across a row
+		const float hh = 1.0f - 2.0f * _row / float(_height);
+		const float phi = hh * Pi * 0.5f;
+		const float cosPhi = cos(phi);
+		const float sinPhi = sin(phi);
+		const float domega = (2.0f * Pi / _width) * (Pi / _height) * cosPhi;
+
+		// the direction is mirrored in x and y to match the cubemap orientation
+		const float4 x4Scale = set4(-cosPhi);
+		const float4 y4 = set4(-sinPhi);
+		const float4 z4Scale = set4(cosPhi);
+		const float4 domega4 = set4(domega);
+
+		float4 acc[9][3];
+		for (int k = 0; k < 9; k++) {
+			for (int col = 0; col < 3; col++) {
+				acc[k][col] = set4(0.0f);
+			}
+		}
+
+		const float* row = _pixels;
 
-			float theta = ww * 3.14159265359f;
-			float phi = hh * 3.14159265359f * 0.5f; // pi/2
+		int j = 0;
+		for (; j + 4 <= _width; j += 4) {
+			float4 basis[9];
+			evalBasis4(mul4(x4Scale, load4(&_sinTheta[j])), y4, mul4(z4Scale, load4(&_cosTheta[j])), domega4, basis);
 
-			// Convert to cartesian coordinates (unit vector)
-			float x = cos(phi) * sin(theta);
-			float y = sin(phi);
-			float z = cos(phi) * cos(theta);
+			float rgb[3][4];
+			for (int lane = 0; lane < 4; lane++) {
+				const float* pixel = row + size_t(j + lane) * _channels;
+				rgb[0][lane] = pixel[0];
+				rgb[1][lane] = pixel[1];
+				rgb[2][lane] = pixel[2];
+			}
 
-			// Calculate solid angle for this pixel
-			// The cos(phi) term accounts for the changing density of pixels near poles
-			float domega = (2.0f * 3.14159265359f / width) * (3.14159265359f / height) * cos(phi);
+			for (int col = 0; col < 3; col++) {
+				const float4 color = load4(rgb[col]);
+				for (int k = 0; k < 9; k++) {
+					acc[k][col] = add4(acc[k][col], mul4(basis[k], color));
+				}
+			}
+		}
+
+		// fold the lanes in a fixed order so the result does not depend on the thread count
+		for (int k = 0; k < 9; k++) {
+			for (int col = 0; col < 3; col++) {
+				float lanes[4];
+				store4(lanes, acc[k][col]);
+				_out.c[k][col] = (double(lanes[0]) + double(lanes[1])) + (double(lanes[2]) + double(lanes[3]));
+			}
+		}
+
+		// remaining columns
+		for (; j < _width; j++) {
+			const float x = -cosPhi * _sinTheta[j];
+			const float y = -sinPhi;
+			const float z = cosPhi * _cosTheta[j];
 
-			vec3 color = getPixel(j, i);
+			const float basis[9] = {
+				0.282095f,
+				0.488603f * y,
+				0.488603f * z,
+				0.488603f * x,
+				1.092548f * x * y,
+				1.092548f * y * z,
+				0.375392f * (3 * z * z - 1),
+				1.092548f * x * z,
+				0.546274f * (x * x - y * y)
+			};
 
-			vec3 direction = vec3(x, y, z);
+			const float* pixel = row + size_t(j) * _channels;
+			for (int k = 0; k < 9; k++) {
+				for (int col = 0; col < 3; col++) {
+					_out.c[k][col] += double(pixel[col] * basis[k] * domega);
+				}
+			}
+		}
+	}
+}
 
-			direction[0] = -direction[0];
-			direction[1] = -direction[1];
+void SH9::beginRows(int pixelWidth, int pixelHeight, const char* outputPath) {
+	shOutputPath = outputPath ? outputPath : "sh9.txt";
+	std::fill(&coeffs[0][0], &coeffs[0][0] + 9 * 4, 0.0f);
+	width = pixelWidth;
+	height = pixelHeight;
+
+	// theta only depends on the column, padded so the vector loads never read past the end
+	sinTheta.assign(width + 4, 0.0f);
+	cosTheta.assign(width + 4, 0.0f);
+	for (int j = 0; j < width; j++) {
+		float ww = (2.0f * j / width - 1.0f); // [-1, 1]
+		float theta = ww * Pi;
+		sinTheta[j] = sin(theta);
+		cosTheta[j] = cos(theta);
+	}
+
+	rowSums.assign(height, RowSums());
+}
+
+void SH9::addRow(int row, const float* pixels, int pixelChannels) {
+	// the image is stored top down, the projection counts rows from the bottom
+	const int flippedRow = height - 1 - row;
+	projectRow(pixels, width, height, pixelChannels, flippedRow, sinTheta, cosTheta, rowSums[flippedRow]);
+}
 
-			updateCoeffs(color, domega, direction[0], direction[1], direction[2]);
+void SH9::endRows() {
+	// compensated reduction in row order, identical for any number of threads
+	for (int k = 0; k < 9; k++) {
+		for (int col = 0; col < 3; col++) {
+			double sum = 0.0;
+			double compensation = 0.0;
+			for (const RowSums& rowSum : rowSums) {
+				const double value = rowSum.c[k][col] - compensation;
+				const double next = sum + value;
+				compensation = (next - sum) - value;
+				sum = next;
+			}
+			coeffs[k][col] = float(sum);
 		}
 	}
 
+	rowSums.clear();
+	rowSums.shrink_to_fit();
+
+	std::ofstream shFile(shOutputPath);
+	if (!shFile.is_open()) {
+		std::cerr << "Error: Failed to open sh.txt!\n";
+		return;
+	}
+
 	for (int i = 0; i < 9; i++) {
 		shFile << coeffs[i][0] << ", " << coeffs[i][1] << ", " << coeffs[i][2] << "\n";
 	}
 	shFile.close();
 }
 
+void SH9::prefilter() {
+	const std::string outputPath = shOutputPath;
+	beginRows(width, height, outputPath.c_str());
+
+	// rows are projected in parallel into their own slot, each thread only touches its own range
+	IBLLib::parallelFor(size_t(height), [](size_t _begin, size_t _end) {
+		for (size_t i = _begin; i < _end; i++) {
+			addRow(int(i), data + i * width * channels, channels);
+		}
+	}, 16u);
+
+	endRows();
+}
+
 vec3 SH9::getPixel(int x, int y) {
 	x = std::min(std::max(x, 0), width - 1);
 	y = std::min(std::max(y, 0), height - 1);
 
-	int idx = (y * width + x) * channels;
+	// y is counted from the bottom of the image
+	size_t idx = (size_t(height - 1 - y) * width + x) * channels;
 	return vec3(data[idx], data[idx + 1], data[idx + 2]);
 }
\ No newline at end of file
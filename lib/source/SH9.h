@@ -11,10 +11,21 @@ class SH9 {
 public:
 	static float coeffs[9][4];
 	static int width, height, channels;
-	static float* data;
+	// top down rows, either borrowed from the caller or owned when the file was loaded by init
+	static const float* data;
+	static float* ownedData;
 	static std::string shOutputPath;
 
 	static void init(const char* filename, const char* outputPath = "sh.txt");
+	// projects an image that was already decoded, the pixels only need to stay alive for the duration of the call
+	static void init(const float* pixels, int pixelWidth, int pixelHeight, int pixelChannels, const char* outputPath = "sh.txt");
+	static void release();
+
+	// streaming projection: every row of a top down image is added exactly once, in any order and from any thread,
+	// endRows reduces them and writes the coefficients
+	static void beginRows(int pixelWidth, int pixelHeight, const char* outputPath = "sh.txt");
+	static void addRow(int row, const float* pixels, int pixelChannels);
+	static void endRows();
 	static void updateCoeffs(const vec3& hdrCOlor, float domega, float x, float y, float z);
 	static void prefilter();
 	static vec3 getPixel(int x, int y);
@@ -25,6 +25,11 @@ IBLLib::Result IBLLib::STBImage::savePng(const char* _path, int _width, int _hei
 	return stbi_write_png(_path, _width, _height, _channels, data, _width * _channels) == 0 ? StbError : Success;
 }
 
+bool IBLLib::STBImage::isHdrFile(const char* _path)
+{
+	return stbi_is_hdr(_path) != 0;
+}
+
 IBLLib::Result IBLLib::STBImage::loadHdr(const char* _path)
 {
 	if (m_hdrData != nullptr)
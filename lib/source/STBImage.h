@@ -13,6 +13,9 @@ namespace IBLLib
 		Result saveHdr(const char* _path, int _width, int _height, int _channels, const void* data);
 		Result savePng(const char* _path, int _width, int _height, int _channels, const void* data);
 
+		// true for files stb_image decodes as floating point
+		static bool isHdrFile(const char* _path);
+
 		// loads .hdr images
 		Result loadHdr(const char* _path);
 		Result loadPng(const char* _path);
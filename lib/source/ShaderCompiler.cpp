@@ -109,7 +109,7 @@ static const TBuiltInResource DefaultTBuiltInResource = {
 	/* .generalConstantMatrixVectorIndexing = */ 1,
  };
 
-bool IBLLib::ShaderCompiler::compile(const std::string& _glslBlob, const char* _entryPoint, Stage _stage, std::vector<uint32_t>& _outSpvBlob)
+bool IBLLib::ShaderCompiler::compile(const std::string& _glslBlob, const char* _entryPoint, Stage _stage, std::vector<uint32_t>& _outSpvBlob, const char* _preamble)
 {
 	_outSpvBlob.clear();
 
@@ -121,6 +121,12 @@ bool IBLLib::ShaderCompiler::compile(const std::string& _glslBlob, const char* _
 	const int lengths[] = { static_cast<int>(_glslBlob.size()) };
 
 	shader.setStringsWithLengths(strings, lengths, 1);
+
+	if (_preamble != nullptr)
+	{
+		shader.setPreamble(_preamble);
+	}
+
  	shader.setEntryPoint(_entryPoint);
 	shader.setSourceEntryPoint(_entryPoint);
 	shader.setAutoMapBindings(true);
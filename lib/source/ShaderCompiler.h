@@ -19,7 +19,8 @@ namespace IBLLib
 
 		static ShaderCompiler& instance() { static ShaderCompiler inst; return inst; }
 
-		bool compile(const std::string& _glslBlob, const char* _entryPoint, Stage _stage, std::vector<uint32_t>& _outSpvBlob);
+		// _preamble is inserted after the #version directive, e.g. for #defines
+		bool compile(const std::string& _glslBlob, const char* _entryPoint, Stage _stage, std::vector<uint32_t>& _outSpvBlob, const char* _preamble = nullptr);
 
 	private:
 
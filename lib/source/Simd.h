@@ -0,0 +1,186 @@
+#pragma once
+// minimal 4 wide float vector used by the cpu side loops, SSE2 or NEON with a scalar fallback
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+namespace IBLLib
+{
+	typedef __m128 float4;
+	static inline float4 load4(const float* p) { return _mm_loadu_ps(p); }
+	static inline void store4(float* p, float4 v) { _mm_storeu_ps(p, v); }
+	static inline float4 set4(float v) { return _mm_set1_ps(v); }
+	static inline float4 set4(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+	static inline float4 add4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+	static inline float4 sub4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+	static inline float4 mul4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+	static inline float4 min4(float4 a, float4 b) { return _mm_min_ps(a, b); }
+	static inline float4 max4(float4 a, float4 b) { return _mm_max_ps(a, b); }
+	static inline float4 div4(float4 a, float4 b) { return _mm_div_ps(a, b); }
+	static inline float4 sqrt4(float4 a) { return _mm_sqrt_ps(a); }
+	// converts 4 consecutive bytes to floats
+	static inline float4 bytesToFloat4(const uint8_t* p)
+	{
+		int32_t word;
+		memcpy(&word, p, 4u);
+		const __m128i zero = _mm_setzero_si128();
+		return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(word), zero), zero));
+	}
+} // !IBLLib
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+namespace IBLLib
+{
+	typedef float32x4_t float4;
+	static inline float4 load4(const float* p) { return vld1q_f32(p); }
+	static inline void store4(float* p, float4 v) { vst1q_f32(p, v); }
+	static inline float4 set4(float v) { return vdupq_n_f32(v); }
+	static inline float4 set4(float x, float y, float z, float w) { const float v[4] = { x, y, z, w }; return vld1q_f32(v); }
+	static inline float4 add4(float4 a, float4 b) { return vaddq_f32(a, b); }
+	static inline float4 sub4(float4 a, float4 b) { return vsubq_f32(a, b); }
+	static inline float4 mul4(float4 a, float4 b) { return vmulq_f32(a, b); }
+	static inline float4 min4(float4 a, float4 b) { return vminq_f32(a, b); }
+	static inline float4 max4(float4 a, float4 b) { return vmaxq_f32(a, b); }
+#if defined(__aarch64__) || defined(_M_ARM64)
+	static inline float4 div4(float4 a, float4 b) { return vdivq_f32(a, b); }
+	static inline float4 sqrt4(float4 a) { return vsqrtq_f32(a); }
+#else
+	// armv7 neon has no full precision divide or square root
+	static inline float4 div4(float4 a, float4 b) { float x[4], y[4]; vst1q_f32(x, a); vst1q_f32(y, b); for (int i = 0; i < 4; i++) x[i] /= y[i]; return vld1q_f32(x); }
+	static inline float4 sqrt4(float4 a) { float x[4]; vst1q_f32(x, a); for (int i = 0; i < 4; i++) x[i] = sqrtf(x[i]); return vld1q_f32(x); }
+#endif
+	// converts 4 consecutive bytes to floats
+	static inline float4 bytesToFloat4(const uint8_t* p)
+	{
+		uint32_t word;
+		memcpy(&word, p, 4u);
+		const uint16x8_t shorts = vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(word)));
+		return vcvtq_f32_u32(vmovl_u16(vget_low_u16(shorts)));
+	}
+} // !IBLLib
+#else
+namespace IBLLib
+{
+	// scalar fallback with the same interface
+	struct float4 { float v[4]; };
+	static inline float4 load4(const float* p) { return { { p[0], p[1], p[2], p[3] } }; }
+	static inline void store4(float* p, float4 v) { for (int i = 0; i < 4; i++) p[i] = v.v[i]; }
+	static inline float4 set4(float s) { return { { s, s, s, s } }; }
+	static inline float4 set4(float x, float y, float z, float w) { return { { x, y, z, w } }; }
+	static inline float4 add4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] += b.v[i]; return a; }
+	static inline float4 sub4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] -= b.v[i]; return a; }
+	static inline float4 mul4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] *= b.v[i]; return a; }
+	static inline float4 min4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]; return a; }
+	static inline float4 max4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]; return a; }
+	static inline float4 div4(float4 a, float4 b) { for (int i = 0; i < 4; i++) a.v[i] /= b.v[i]; return a; }
+	static inline float4 sqrt4(float4 a) { for (int i = 0; i < 4; i++) a.v[i] = sqrtf(a.v[i]); return a; }
+	static inline float4 bytesToFloat4(const uint8_t* p) { return { { float(p[0]), float(p[1]), float(p[2]), float(p[3]) } }; }
+} // !IBLLib
+#endif
+
+namespace IBLLib
+{
+	// round to nearest even, inputs must not exceed the largest half (65504)
+	static inline uint16_t floatToHalf(float f)
+	{
+		uint32_t x;
+		memcpy(&x, &f, 4u);
+
+		const uint32_t sign = (x >> 16) & 0x8000u;
+		const uint32_t absx = x & 0x7fffffffu;
+
+		if (absx > 0x7f800000u)
+		{
+			return static_cast<uint16_t>(sign | 0x7e00u); // nan
+		}
+
+		if (absx < 0x38800000u)
+		{
+			// subnormal half or zero
+			if (absx < 0x33000000u)
+			{
+				return static_cast<uint16_t>(sign);
+			}
+
+			const uint32_t exponent = absx >> 23;
+			const uint32_t mantissa = (absx & 0x7fffffu) | 0x800000u;
+			const uint32_t shift = 126u - exponent;
+			uint32_t h = mantissa >> shift;
+			const uint32_t remainder = mantissa & ((1u << shift) - 1u);
+			const uint32_t halfway = 1u << (shift - 1u);
+			if (remainder > halfway || (remainder == halfway && (h & 1u)))
+			{
+				++h;
+			}
+			return static_cast<uint16_t>(sign | h);
+		}
+
+		// rebias the exponent, a carry out of the mantissa correctly bumps it
+		uint32_t h = (absx >> 13) - (112u << 10);
+		const uint32_t remainder = absx & 0x1fffu;
+		if (remainder > 0x1000u || (remainder == 0x1000u && (h & 1u)))
+		{
+			++h;
+		}
+		return static_cast<uint16_t>(sign | h);
+	}
+
+	static inline float halfToFloat(uint16_t h)
+	{
+		const uint32_t sign = static_cast<uint32_t>(h & 0x8000u) << 16;
+		const uint32_t exponent = (h >> 10) & 0x1fu;
+		uint32_t mantissa = h & 0x3ffu;
+		uint32_t x;
+
+		if (exponent == 0x1fu)
+		{
+			x = sign | 0x7f800000u | (mantissa << 13); // inf, nan
+		}
+		else if (exponent != 0u)
+		{
+			x = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+		}
+		else if (mantissa == 0u)
+		{
+			x = sign;
+		}
+		else
+		{
+			// subnormal half, normalize the mantissa
+			uint32_t e = 113u;
+			while ((mantissa & 0x400u) == 0u)
+			{
+				mantissa <<= 1;
+				--e;
+			}
+			x = sign | (e << 23) | ((mantissa & 0x3ffu) << 13);
+		}
+
+		float f;
+		memcpy(&f, &x, 4u);
+		return f;
+	}
+
+	// stores 4 floats as halfs, same clamping requirement as floatToHalf
+	static inline void storeHalf4(uint16_t* p, float4 v)
+	{
+#if defined(__F16C__)
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(p), _mm_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+#elif (defined(__ARM_NEON) || defined(_M_ARM64)) && defined(__ARM_FP16_FORMAT_IEEE)
+		vst1_u16(p, vreinterpret_u16_f16(vcvt_f16_f32(v)));
+#else
+		float f[4];
+		store4(f, v);
+		for (int i = 0; i < 4; i++)
+		{
+			p[i] = floatToHalf(f[i]);
+		}
+#endif
+	}
+} // !IBLLib
@@ -12,6 +12,8 @@ constexpr uint32_t GL_RGBA8 = 0x8058;
 constexpr uint32_t GL_RGBA16F = 0x881A;
 constexpr uint32_t GL_RGBA32F = 0x8814;
 constexpr uint32_t GL_R11F_G11F_B10F = 0x8C3A; // 35898 decimal
+constexpr uint32_t GL_R16F = 0x822D;
+constexpr uint32_t GL_RG16F = 0x822F;
 
 uint32_t toOpenGL(VkFormat _vkFormat)
 {
@@ -25,6 +27,10 @@ uint32_t toOpenGL(VkFormat _vkFormat)
         return GL_RGBA32F;
     case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
         return GL_R11F_G11F_B10F;
+    case VK_FORMAT_R16_SFLOAT:
+        return GL_R16F;
+    case VK_FORMAT_R16G16_SFLOAT:
+        return GL_RG16F;
     }
 
     return 0;
@@ -42,6 +48,10 @@ VkFormat fromOpenGL(uint32_t _glFormat)
         return VK_FORMAT_R32G32B32A32_SFLOAT;
     case GL_R11F_G11F_B10F:
         return VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+    case GL_R16F:
+        return VK_FORMAT_R16_SFLOAT;
+    case GL_RG16F:
+        return VK_FORMAT_R16G16_SFLOAT;
     }
 
     return VK_FORMAT_UNDEFINED;
@@ -85,7 +95,7 @@ KtxImage1::~KtxImage1()
 
 Result KtxImage1::loadKtx1(const char* _pFilePath)
 {
-    assert(((void)"m_ktxTexture must be uninitialized.", m_ktxTexture != nullptr));
+    assert(((void)"m_ktxTexture must be uninitialized.", m_ktxTexture == nullptr));
 
     KTX_error_code result;
     result = ktxTexture1_CreateFromNamedFile(_pFilePath,
@@ -95,6 +105,7 @@ Result KtxImage1::loadKtx1(const char* _pFilePath)
     if (result != KTX_SUCCESS)
     {
         printf("Could not load ktx file at %s \n", _pFilePath);
+        return Result::KtxError;
     }
 
     return Result::Success;
@@ -127,33 +138,61 @@ Result KtxImage1::save(const char* _pathOut)
     return Success;
 }
 
+uint8_t* KtxImage1::getData()
+{
+    return m_ktxTexture != nullptr ? ktxTexture_GetData(ktxTexture(m_ktxTexture)) : nullptr;
+}
+
+size_t KtxImage1::getDataSize()
+{
+    return m_ktxTexture != nullptr ? ktxTexture_GetDataSize(ktxTexture(m_ktxTexture)) : 0u;
+}
+
+Result KtxImage1::getImageOffset(uint32_t _side, uint32_t _level, size_t& _outOffset)
+{
+    ktx_size_t offset = 0u;
+    if (m_ktxTexture == nullptr || ktxTexture_GetImageOffset(ktxTexture(m_ktxTexture), _level, 0u, _side, &offset) != KTX_SUCCESS)
+    {
+        printf("Could not get image offset of ktx texture\n");
+        return Result::KtxError;
+    }
+
+    _outOffset = offset;
+    return Success;
+}
+
+size_t KtxImage1::getRowPitch(uint32_t _level)
+{
+    return m_ktxTexture != nullptr ? ktxTexture_GetRowPitch(ktxTexture(m_ktxTexture), _level) : 0u;
+}
+
 uint32_t KtxImage1::getWidth() const
 {
-    assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+    assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
     return m_ktxTexture->baseWidth;
 }
 
 uint32_t KtxImage1::getHeight() const
 {
-    assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+    assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
     return m_ktxTexture->baseHeight;
 }
 
 uint32_t KtxImage1::getLevels() const
 {
-    assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+    assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
     return m_ktxTexture->numLevels;
 }
 
 bool KtxImage1::isCubeMap() const
 {
-    assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+    assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
     return m_ktxTexture->numFaces == 6u;
 }
 
 VkFormat KtxImage1::getFormat() const
 {
-    assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+    assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
     return  static_cast<VkFormat>(fromOpenGL(m_ktxTexture->glInternalformat));
 }
 
@@ -196,7 +235,7 @@ KtxImage2::~KtxImage2()
 
 Result KtxImage2::loadKtx2(const char* _pFilePath)
 {
-	assert(((void)"m_ktxTexture must be uninitialized.", m_ktxTexture != nullptr));
+	assert(((void)"m_ktxTexture must be uninitialized.", m_ktxTexture == nullptr));
 
 	KTX_error_code result;
 	result = ktxTexture2_CreateFromNamedFile(_pFilePath,
@@ -206,6 +245,7 @@ Result KtxImage2::loadKtx2(const char* _pFilePath)
 	if(result != KTX_SUCCESS)
 	{
 		printf("Could not load ktx file at %s \n", _pFilePath);
+		return Result::KtxError;
 	}
 
 	return Result::Success;
@@ -238,32 +278,60 @@ Result KtxImage2::save(const char* _pathOut)
 	return Success;
 }
 
+uint8_t* KtxImage2::getData()
+{
+	return m_ktxTexture != nullptr ? ktxTexture_GetData(ktxTexture(m_ktxTexture)) : nullptr;
+}
+
+size_t KtxImage2::getDataSize()
+{
+	return m_ktxTexture != nullptr ? ktxTexture_GetDataSize(ktxTexture(m_ktxTexture)) : 0u;
+}
+
+Result KtxImage2::getImageOffset(uint32_t _side, uint32_t _level, size_t& _outOffset)
+{
+	ktx_size_t offset = 0u;
+	if (m_ktxTexture == nullptr || ktxTexture_GetImageOffset(ktxTexture(m_ktxTexture), _level, 0u, _side, &offset) != KTX_SUCCESS)
+	{
+		printf("Could not get image offset of ktx texture\n");
+		return Result::KtxError;
+	}
+
+	_outOffset = offset;
+	return Success;
+}
+
+size_t KtxImage2::getRowPitch(uint32_t _level)
+{
+	return m_ktxTexture != nullptr ? ktxTexture_GetRowPitch(ktxTexture(m_ktxTexture), _level) : 0u;
+}
+
 uint32_t KtxImage2::getWidth() const
 {
-	assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
 	return m_ktxTexture->baseWidth;
 }
 
 uint32_t KtxImage2::getHeight() const
 {
-	assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
 	return m_ktxTexture->baseHeight;
 }
 
 uint32_t KtxImage2::getLevels() const
 {
-	assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
 	return m_ktxTexture->numLevels;
 }
 
 bool KtxImage2::isCubeMap() const
 {
-	assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
 	return m_ktxTexture->numFaces == 6u;
 }
 
 VkFormat KtxImage2::getFormat() const
 {
-	assert(((void)"Ktx texture must be initialized", m_ktxTexture == nullptr));
+	assert(((void)"Ktx texture must be initialized", m_ktxTexture != nullptr));
 	return static_cast<VkFormat>(m_ktxTexture->vkFormat);
 }
@@ -17,6 +17,13 @@ namespace IBLLib
         virtual Result writeFace(const std::vector<uint8_t>& _inData, uint32_t _side, uint32_t _level) = 0;
         virtual Result save(const char* _pathOut) = 0;
 
+        // direct access to the texture storage, lets callers write faces in place at getImageOffset
+        virtual uint8_t* getData() = 0;
+        virtual size_t getDataSize() = 0;
+        virtual Result getImageOffset(uint32_t _side, uint32_t _level, size_t& _outOffset) = 0;
+        // bytes from one row of _level to the next, KTX1 pads rows to 4 bytes
+        virtual size_t getRowPitch(uint32_t _level) = 0;
+
         virtual uint32_t getWidth() const = 0;
         virtual uint32_t getHeight() const = 0;
         virtual uint32_t getLevels() const = 0;
@@ -38,6 +45,11 @@ namespace IBLLib
         Result writeFace(const std::vector<uint8_t>& _inData, uint32_t _side, uint32_t _level) override;
         Result save(const char* _pathOut) override;
 
+        uint8_t* getData() override;
+        size_t getDataSize() override;
+        Result getImageOffset(uint32_t _side, uint32_t _level, size_t& _outOffset) override;
+        size_t getRowPitch(uint32_t _level) override;
+
         uint32_t getWidth() const override;
         uint32_t getHeight() const override;
         uint32_t getLevels() const override;
@@ -62,6 +74,11 @@ namespace IBLLib
 		Result writeFace(const std::vector<uint8_t>& _inData, uint32_t _side, uint32_t _level) override;
 		Result save(const char* _pathOut) override;
 
+		uint8_t* getData() override;
+		size_t getDataSize() override;
+		Result getImageOffset(uint32_t _side, uint32_t _level, size_t& _outOffset) override;
+		size_t getRowPitch(uint32_t _level) override;
+
 		uint32_t getWidth() const override;
 		uint32_t getHeight() const override;
 		uint32_t getLevels() const override;
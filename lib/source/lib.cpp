@@ -2,16 +2,45 @@
 #include "vkHelper.h"
 #include "ShaderCompiler.h"
 #include "STBImage.h"
+#include "RadianceImage.h"
 #include "FileHelper.h"
 #include "ktxImage.h"
 #include "SH9.h"
+#include "Parallel.h"
+#include "Simd.h"
+#include "LutCache.h"
+#include "BrdfLut.h"
+#include "HostIrradiance.h"
+#include "HostFilter.h"
+#include "ImportanceSamples.h"
 #include <algorithm>
+#include <functional>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <memory>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 //#include <string>
 
 #include "format.h"
 
+#ifdef IBLSAMPLER_EMBEDDED_SPIRV
+// generated at build time by cmake/embed_spirv.cmake
+#include "primitive_main_vert.h"
+#include "filter_panoramaToCubeMap_frag.h"
+#include "filter_filterCubeMap_frag.h"
+#include "filter_filterCubeMapCompute_comp.h"
+#include "filter_filterCubeMapComputeWithoutFormat_comp.h"
+#include "filter_generateLUT_comp.h"
+#define IBLSAMPLER_SPIRV(_variable) _variable, sizeof(_variable)
+#else
+#define IBLSAMPLER_SPIRV(_variable) nullptr, 0u
+#endif
+
 namespace IBLLib
 {
 
@@ -23,11 +52,11 @@ constexpr auto primitiveVertexShader =
 #include "shaders/primitive.vert"
 ;
 
-Result compileShader(vkHelper& _vulkan, const char* _shaderText, const char* _entryPoint, VkShaderModule& _outModule, ShaderCompiler::Stage _stage)
+Result compileShader(vkHelper& _vulkan, const char* _shaderText, const char* _entryPoint, VkShaderModule& _outModule, ShaderCompiler::Stage _stage, const char* _preamble = nullptr)
 {
 	std::vector<uint32_t> outSpvBlob;
 
-	if (ShaderCompiler::instance().compile(_shaderText, _entryPoint, _stage, outSpvBlob) == false)
+	if (ShaderCompiler::instance().compile(_shaderText, _entryPoint, _stage, outSpvBlob, _preamble) == false)
 	{
 		return Result::ShaderCompilationFailed;
 	}
@@ -40,80 +69,451 @@ Result compileShader(vkHelper& _vulkan, const char* _shaderText, const char* _en
 	return Result::Success;
 }
 
-Result uploadImage(vkHelper& _vulkan, const char* _inputPath, const char* _shOutputPath, VkImage& _outImage)
+// uses the precompiled SPIR-V if available, the glsl source is only compiled as fallback
+Result loadShader(vkHelper& _vulkan, const char* _shaderText, const uint32_t* _spirv, size_t _spirvByteSize, const char* _entryPoint, VkShaderModule& _outModule, ShaderCompiler::Stage _stage, const char* _preamble = nullptr)
+{
+	if (_spirv != nullptr)
+	{
+		if (_vulkan.loadShaderModule(_outModule, _spirv, _spirvByteSize) == VK_SUCCESS)
+		{
+			return Result::Success;
+		}
+
+		printf("Failed to load precompiled shader %s, compiling from source\n", _entryPoint);
+	}
+
+	return compileShader(_vulkan, _shaderText, _entryPoint, _outModule, _stage, _preamble);
+}
+
+// how the panorama texels are stored, must match cPanorama* in filter.frag
+enum class PanoramaEncoding : uint32_t
+{
+	Linear = 0u, // float and sRGB formats, decoded by the sampler
+	RGBE = 1u // Radiance rgbe kept as rgba8 unorm, decoded in panoramaToCubeMap
+};
+
+// panoramas are streamed through a staging buffer of this size, independent of the panorama size
+constexpr size_t panoramaStagingBytes = 64u << 20;
+
+// a panorama on the gpu, split into tiles stored as array layers (row major) when it exceeds the device's image dimensions
+struct Panorama
+{
+	VkImage image = VK_NULL_HANDLE;
+	uint32_t width = 0u;
+	uint32_t height = 0u;
+	uint32_t layers = 1u;
+	PanoramaEncoding encoding = PanoramaEncoding::Linear;
+	// the image is released by the transfer queue in this submission and has to be acquired before sampling
+	Submission uploaded;
+	// the pass rendering the panorama to the cube map, it completes after the upload
+	Submission sampled;
+	// released together with the image once the panorama is no longer used, see retirePanorama()
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	std::vector<VkCommandBuffer> uploadCommands;
+	// SH projection of the same panorama, set even if the panorama was not uploaded
+	float shCoeffs[9][4] = {};
+};
+
+// a panorama decoded and projected on the cpu, ready to be uploaded by another thread
+struct DecodedPanorama
 {
-	_outImage = VK_NULL_HANDLE;
-	STBImage panorama;
-	SH9::init(_inputPath, _shOutputPath);
+	uint32_t width = 0u;
+	uint32_t height = 0u;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	uint32_t bytesPerPixel = 0u;
+	PanoramaEncoding encoding = PanoramaEncoding::Linear;
+	// empty if the job does not sample the panorama on the gpu
+	std::vector<uint8_t> pixels;
+	float shCoeffs[9][4] = {};
+};
+
+// a copy to host memory that still runs on the transfer queue, see finishReadback()
+struct PendingReadback
+{
+	Submission submission;
+	VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	void* dst = nullptr;
+	size_t bytes = 0u;
+};
+
+// an output file that was read back but not yet encoded, written by the batch encode thread
+struct DeferredWrite
+{
+	// finished by the gpu thread before the write is handed to the encode thread
+	PendingReadback readback;
+	std::function<Result()> write;
+	size_t bytes = 0u; // host memory held until the write ran
+};
+
+// writes rows [_rowBegin, _rowEnd) of the panorama to _staging
+using FillRows = std::function<Result(void* _staging, uint32_t _rowBegin, uint32_t _rowEnd)>;
+
+// creates the panorama image and streams it in horizontal bands through a bounded host visible staging buffer.
+// the last copies may still run when it returns, the passes sampling the panorama wait for _outPanorama.uploaded
+Result uploadImage(vkHelper& _vulkan, uint32_t _width, uint32_t _height, VkFormat _format, uint32_t _bytesPerPixel, const FillRows& _fillRows, Panorama& _outPanorama)
+{
+	_outPanorama.image = VK_NULL_HANDLE;
+	_outPanorama.width = _width;
+	_outPanorama.height = _height;
+
+	const VkPhysicalDeviceLimits& limits = _vulkan.getDeviceProperties().limits;
+	const uint32_t tileWidth = std::min(_width, limits.maxImageDimension2D);
+	const uint32_t tileHeight = std::min(_height, limits.maxImageDimension2D);
+	const uint32_t tileColumns = (_width + tileWidth - 1u) / tileWidth;
+	const uint32_t tileRows = (_height + tileHeight - 1u) / tileHeight;
+	_outPanorama.layers = tileColumns * tileRows;
 
-	if (panorama.loadHdr(_inputPath) != Result::Success)
+	if (_outPanorama.layers > limits.maxImageArrayLayers)
 	{
-		return Result::InputPanoramaFileNotFound;
+		printf("Panorama %ux%u exceeds the device image limits\n", _width, _height);
+		return Result::InvalidArgument;
 	}
 
-	VkCommandBuffer uploadCmds = VK_NULL_HANDLE;
-	if (_vulkan.createCommandBuffer(uploadCmds) != VK_SUCCESS)
+	// two staging slots, the next band is filled while the previous one is copied
+	constexpr uint32_t slotCount = 2u;
+	const size_t rowBytes = static_cast<size_t>(_width) * _bytesPerPixel;
+	const uint32_t bandRows = static_cast<uint32_t>(std::max<size_t>(1u, std::min<size_t>(_height, panoramaStagingBytes / slotCount / rowBytes)));
+	const size_t slotBytes = rowBytes * bandRows;
+	const size_t stagingBytes = slotBytes * slotCount;
+
+	// create the destination image we want to sample in the shader
+	if (_vulkan.createImage2DAndAllocate(_outPanorama.image, tileWidth, tileHeight, _format, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, 1u, _outPanorama.layers) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	// create staging buffer for image data
+	const VkImageSubresourceRange allLayers = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, _outPanorama.layers };
+
+	// every failure from here on goes through the cleanup below the band loop
+	Result res = Result::Success;
+
+	std::vector<VkCommandBuffer> uploadCmds;
+	Submission slotSubmissions[slotCount] = {};
+	if (_vulkan.createCommandBuffers(uploadCmds, slotCount, VK_COMMAND_BUFFER_LEVEL_PRIMARY, QueueType::Transfer) != VK_SUCCESS)
+	{
+		res = Result::VulkanError;
+	}
+
+	// create staging buffer for two bands of image data
 	VkBuffer stagingBuffer = VK_NULL_HANDLE;
-	if (_vulkan.createBufferAndAllocate(stagingBuffer, static_cast<uint32_t>(panorama.getByteSize()), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
+	if (res == Result::Success &&
+		_vulkan.createBufferAndAllocate(stagingBuffer, stagingBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
 	{
-		return Result::VulkanError;
+		res = Result::VulkanError;
 	}
 
-	// transfer data to the host coherent staging buffer
-	if (_vulkan.writeBufferData(stagingBuffer, panorama.getHdrData(), panorama.getByteSize()) != VK_SUCCESS)
+	// the pixels are written directly into the host coherent staging buffer, it stays mapped for all bands
+	void* staging = nullptr;
+	if (res == Result::Success && _vulkan.mapBuffer(stagingBuffer, staging, stagingBytes) != VK_SUCCESS)
 	{
-		return Result::VulkanError;
+		res = Result::VulkanError;
 	}
 
-	// create the destination image we want to sample in the shader
-	if (_vulkan.createImage2DAndAllocate(_outImage, panorama.getWidth(), panorama.getHeight(), VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT) != VK_SUCCESS)
+	for (uint32_t rowBegin = 0u, band = 0u; rowBegin < _height && res == Result::Success; ++band)
 	{
-		return Result::VulkanError;
+		// bands never cross a tile row, so every tile column receives one region
+		const uint32_t tileRow = rowBegin / tileHeight;
+		const uint32_t rowEnd = std::min(std::min(rowBegin + bandRows, (tileRow + 1u) * tileHeight), _height);
+
+		// the slot's previous copy has to finish before its staging memory and command buffer are reused
+		const uint32_t slot = band % slotCount;
+		const VkCommandBuffer uploadCmd = uploadCmds[slot];
+		if (_vulkan.waitForSubmission(slotSubmissions[slot]) != VK_SUCCESS)
+		{
+			res = Result::VulkanError;
+			break;
+		}
+
+		if ((res = _fillRows(static_cast<uint8_t*>(staging) + slot * slotBytes, rowBegin, rowEnd)) != Result::Success)
+		{
+			break;
+		}
+
+		if (_vulkan.beginCommandBuffer(uploadCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+		{
+			res = Result::VulkanError;
+			break;
+		}
+
+		if (rowBegin == 0u)
+		{
+			_vulkan.imageBarrier(uploadCmd, _outPanorama.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, allLayers);
+		}
+
+		std::vector<VkBufferImageCopy> regions(tileColumns);
+		for (uint32_t column = 0u; column < tileColumns; ++column)
+		{
+			VkBufferImageCopy& region = regions[column];
+			region.bufferOffset = slot * slotBytes + static_cast<VkDeviceSize>(column) * tileWidth * _bytesPerPixel;
+			region.bufferRowLength = _width;
+			region.bufferImageHeight = 0u;
+			region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, tileRow * tileColumns + column, 1u };
+			region.imageOffset = { 0, static_cast<int32_t>(rowBegin - tileRow * tileHeight), 0 };
+			region.imageExtent = { std::min(tileWidth, _width - column * tileWidth), rowEnd - rowBegin, 1u };
+		}
+
+		vkCmdCopyBufferToImage(uploadCmd, stagingBuffer, _outPanorama.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+
+		if (rowEnd == _height)
+		{
+			_vulkan.releaseImage(uploadCmd, _outPanorama.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, QueueType::Transfer, QueueType::Graphics, allLayers);
+		}
+
+		// the copy runs while the next band is decoded into the other slot
+		if (_vulkan.endCommandBuffer(uploadCmd) != VK_SUCCESS || _vulkan.submitCommandBuffer(uploadCmd, slotSubmissions[slot], {}, QueueType::Transfer) != VK_SUCCESS)
+		{
+			res = Result::VulkanError;
+			break;
+		}
+
+		_outPanorama.uploaded = slotSubmissions[slot];
+		rowBegin = rowEnd;
 	}
 
-	if (_vulkan.beginCommandBuffer(uploadCmds, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	if (staging != nullptr)
 	{
-		return Result::VulkanError;
+		_vulkan.unmapBuffer(stagingBuffer);
+	}
+
+	if (res == Result::Success)
+	{
+		_outPanorama.stagingBuffer = stagingBuffer;
+		_outPanorama.uploadCommands = std::move(uploadCmds);
+		return res;
 	}
 
-	// transition to write dst layout
-	_vulkan.transitionImageToTransferWrite(uploadCmds, _outImage);
-	_vulkan.copyBufferToBasicImage2D(uploadCmds, stagingBuffer, _outImage);
-	_vulkan.transitionImageToShaderRead(uploadCmds, _outImage);
+	// submissions complete in order, waiting for the latest one covers both slots
+	_vulkan.waitForSubmission(_outPanorama.uploaded);
 
-	if (_vulkan.endCommandBuffer(uploadCmds) != VK_SUCCESS)
+	_vulkan.destroyBuffer(stagingBuffer);
+	for (VkCommandBuffer uploadCmd : uploadCmds)
 	{
-		return Result::VulkanError;
+		_vulkan.destroyCommandBuffer(uploadCmd, QueueType::Transfer);
 	}
 
-	if (_vulkan.executeCommandBuffer(uploadCmds) != VK_SUCCESS)
+	_vulkan.destroyImage(_outPanorama.image);
+	_outPanorama.image = VK_NULL_HANDLE;
+
+	return res;
+}
+
+// sRGB transfer function for every 8 bit value
+struct SrgbToLinearTable
+{
+	SrgbToLinearTable()
 	{
-		return Result::VulkanError;
+		for (int i = 0; i < 256; ++i)
+		{
+			const float c = i / 255.0f;
+			linear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
 	}
 
-	_vulkan.destroyBuffer(stagingBuffer);
-	_vulkan.destroyCommandBuffer(uploadCmds);
+	float linear[256];
+};
 
-	return Result::Success;
+// projects an 8 bit sRGB rgba image onto SH9, converting one row per thread at a time
+void projectSrgbImage(const STBImage& _image, const char* _outputPathSH)
+{
+	static const SrgbToLinearTable table;
+
+	const size_t width = static_cast<size_t>(_image.getWidth());
+	SH9::beginRows(_image.getWidth(), _image.getHeight(), _outputPathSH);
+
+	parallelFor(static_cast<size_t>(_image.getHeight()), [&](size_t _begin, size_t _end)
+	{
+		std::vector<float> row(width * 4u);
+		for (size_t y = _begin; y < _end; ++y)
+		{
+			const unsigned char* src = _image.getByteData() + y * width * 4u;
+			for (size_t i = 0u; i < width * 4u; ++i)
+			{
+				row[i] = table.linear[src[i]];
+			}
+			SH9::addRow(static_cast<int>(y), row.data(), 4);
+		}
+	}, 16u);
+
+	SH9::endRows();
 }
 
-Result convertVkFormat(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkImage _srcImage, VkImage& _outImage, VkFormat _dstFormat, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+// converts rgba32f to rgba16f, values are clamped to the half range so bright texels do not turn into infinity
+void convertToHalf(const float* _src, uint16_t* _dst, size_t _pixelCount)
 {
-	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
+	parallelFor(_pixelCount, [&](size_t _begin, size_t _end)
+	{
+		const float4 maxHalf = set4(65504.0f);
+		for (size_t i = _begin; i < _end; ++i)
+		{
+			storeHalf4(_dst + i * 4u, min4(load4(_src + i * 4u), maxHalf));
+		}
+	}, 1u << 16);
+}
 
-	if (pInfo == nullptr)
+// receives the decoded panorama in its upload format, _fillRows has to be called for all rows in order
+using PanoramaSink = std::function<Result(const DecodedPanorama& _layout, const FillRows& _fillRows)>;
+
+// decodes the panorama, projects it onto SH and hands it to _sink in its most compact form: rgbe for Radiance files,
+// sRGB8 for ldr images and half floats otherwise. Without a sink the panorama is only projected.
+// The pixels of _outPanorama are left to the sink. SH9 is global state, so only one thread may decode at a time.
+Result decodePanorama(const char* _inputPath, const char* _outputPathSH, const PanoramaSink& _sink, DecodedPanorama& _outPanorama)
+{
+	Result res = Result::Success;
+
+	RadianceImage radiance;
+	if (radiance.open(_inputPath) == Result::Success)
 	{
-		return Result::InvalidArgument;
+		// Radiance files are decoded scanline by scanline straight into the sink,
+		// each scanline is projected onto SH while it is still in cache
+		const RadianceImage::ScanlineCallback project = [](int _row, const float* _pixels)
+		{
+			SH9::addRow(_row, _pixels, 4);
+		};
+
+		SH9::beginRows(radiance.getWidth(), radiance.getHeight(), _outputPathSH);
+
+		_outPanorama.width = static_cast<uint32_t>(radiance.getWidth());
+		_outPanorama.height = static_cast<uint32_t>(radiance.getHeight());
+		_outPanorama.format = VK_FORMAT_R8G8B8A8_UNORM;
+		_outPanorama.bytesPerPixel = 4u;
+		_outPanorama.encoding = PanoramaEncoding::RGBE;
+
+		if (_sink)
+		{
+			res = _sink(_outPanorama, [&](void* _rows, uint32_t _rowBegin, uint32_t _rowEnd)
+			{
+				return radiance.decodeRgbe(static_cast<uint8_t*>(_rows), static_cast<int>(_rowBegin), static_cast<int>(_rowEnd), project);
+			});
+		}
+		else
+		{
+			res = radiance.decode(nullptr, project);
+		}
+
+		if (res == Result::Success)
+		{
+			SH9::endRows();
+		}
 	}
+	else if (STBImage::isHdrFile(_inputPath) == false)
+	{
+		STBImage image;
+		if (image.loadPng(_inputPath) != Result::Success)
+		{
+			return Result::InputPanoramaFileNotFound;
+		}
 
-	if (_outImage != VK_NULL_HANDLE)
+		// the sampler linearizes the sRGB texels, the projection uses the same curve
+		projectSrgbImage(image, _outputPathSH);
+
+		_outPanorama.width = static_cast<uint32_t>(image.getWidth());
+		_outPanorama.height = static_cast<uint32_t>(image.getHeight());
+		_outPanorama.format = VK_FORMAT_R8G8B8A8_SRGB;
+		_outPanorama.bytesPerPixel = 4u;
+		_outPanorama.encoding = PanoramaEncoding::Linear;
+
+		if (_sink)
+		{
+			const size_t rowBytes = static_cast<size_t>(image.getWidth()) * 4u;
+			res = _sink(_outPanorama, [&](void* _rows, uint32_t _rowBegin, uint32_t _rowEnd)
+			{
+				memcpy(_rows, image.getByteData() + _rowBegin * rowBytes, (_rowEnd - _rowBegin) * rowBytes);
+				return Result::Success;
+			});
+		}
+	}
+	else
+	{
+		// the panorama is decoded once and shared by the SH projection and the sink
+		STBImage image;
+		if (image.loadHdr(_inputPath) != Result::Success)
+		{
+			return Result::InputPanoramaFileNotFound;
+		}
+
+		// loadHdr always expands to rgba
+		SH9::init(image.getHdrData(), image.getWidth(), image.getHeight(), 4, _outputPathSH);
+
+		_outPanorama.width = static_cast<uint32_t>(image.getWidth());
+		_outPanorama.height = static_cast<uint32_t>(image.getHeight());
+		_outPanorama.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+		_outPanorama.bytesPerPixel = 4u * sizeof(uint16_t);
+		_outPanorama.encoding = PanoramaEncoding::Linear;
+
+		if (_sink)
+		{
+			const size_t width = static_cast<size_t>(image.getWidth());
+			res = _sink(_outPanorama, [&](void* _rows, uint32_t _rowBegin, uint32_t _rowEnd)
+			{
+				convertToHalf(image.getHdrData() + _rowBegin * width * 4u, static_cast<uint16_t*>(_rows), (_rowEnd - _rowBegin) * width);
+				return Result::Success;
+			});
+		}
+	}
+
+	if (res == Result::Success)
+	{
+		memcpy(_outPanorama.shCoeffs, SH9::coeffs, sizeof(SH9::coeffs));
+	}
+
+	return res;
+}
+
+// sink keeping the decoded rows in _panorama.pixels, e.g. for the batch decode thread that runs while the gpu filters
+PanoramaSink storePixels(DecodedPanorama& _panorama)
+{
+	return [&_panorama](const DecodedPanorama& _layout, const FillRows& _fillRows)
+	{
+		_panorama.pixels.resize(static_cast<size_t>(_layout.width) * _layout.height * _layout.bytesPerPixel);
+		return _fillRows(_panorama.pixels.data(), 0u, _layout.height);
+	};
+}
+
+// linear float copy of the pixels kept by storePixels, decoded like the panorama sampler and decodeRGBE in filter.frag
+void getHostPanorama(const DecodedPanorama& _decoded, HostPanorama& _outPanorama)
+{
+	static const SrgbToLinearTable table;
+
+	const size_t pixelCount = static_cast<size_t>(_decoded.width) * _decoded.height;
+	_outPanorama.width = _decoded.width;
+	_outPanorama.height = _decoded.height;
+	_outPanorama.pixels.resize(pixelCount * 4u);
+
+	parallelFor(pixelCount, [&](size_t _begin, size_t _end)
+	{
+		for (size_t i = _begin; i < _end; ++i)
+		{
+			const uint8_t* src = _decoded.pixels.data() + i * _decoded.bytesPerPixel;
+			float* dst = _outPanorama.pixels.data() + i * 4u;
+
+			if (_decoded.encoding == PanoramaEncoding::RGBE)
+			{
+				const float scale = src[3] > 0u ? ldexpf(1.0f, static_cast<int>(src[3]) - 136) : 0.0f;
+				store4(dst, set4(src[0] * scale, src[1] * scale, src[2] * scale, 1.0f));
+			}
+			else if (_decoded.format == VK_FORMAT_R8G8B8A8_SRGB)
+			{
+				store4(dst, set4(table.linear[src[0]], table.linear[src[1]], table.linear[src[2]], src[3] / 255.0f));
+			}
+			else // VK_FORMAT_R16G16B16A16_SFLOAT
+			{
+				uint16_t halfs[4];
+				memcpy(halfs, src, sizeof(halfs));
+				store4(dst, set4(halfToFloat(halfs[0]), halfToFloat(halfs[1]), halfToFloat(halfs[2]), halfToFloat(halfs[3])));
+			}
+		}
+	}, 1u << 16);
+}
+
+Result convertVkFormat(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkImage _srcImage, VkImage& _outImage, VkFormat _dstFormat, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+{
+	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
+
+	if (pInfo == nullptr)
 	{
-		printf("Expecting empty outImage\n");
 		return Result::InvalidArgument;
 	}
 
@@ -122,7 +522,19 @@ Result convertVkFormat(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer,
 	const uint32_t mipLevels = pInfo->mipLevels;
 	const uint32_t arrayLayers = pInfo->arrayLayers;
 
-	if (_vulkan.createImage2DAndAllocate(_outImage, sideLength, sideLength, _dstFormat,
+	// an existing outImage is reused (e.g. by IblSession) if it matches the source
+	if (_outImage != VK_NULL_HANDLE)
+	{
+		const VkImageCreateInfo* pOutInfo = _vulkan.getCreateInfo(_outImage);
+
+		if (pOutInfo == nullptr || pOutInfo->format != _dstFormat || pOutInfo->extent.width != sideLength ||
+				pOutInfo->mipLevels != mipLevels || pOutInfo->arrayLayers != arrayLayers)
+		{
+			printf("Expecting empty or matching outImage\n");
+			return Result::InvalidArgument;
+		}
+	}
+	else if (_vulkan.createImage2DAndAllocate(_outImage, sideLength, sideLength, _dstFormat,
 																			 VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
 																			 mipLevels, arrayLayers, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE) != VK_SUCCESS)
 	{
@@ -185,7 +597,87 @@ Result convertVkFormat(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer,
 	return Result::Success;
 }
 
-Result downloadCubemap(vkHelper& _vulkan, const VkImage _srcImage, const char* _outputPath, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
+// submits the copy of _regions of _srcImage into a readback buffer on the transfer queue, finishReadback() moves it to _dst.
+// The image has to be released to the transfer queue in _srcLayout -> TRANSFER_SRC_OPTIMAL by the _producer submission
+Result readbackImage(vkHelper& _vulkan, const VkImage _srcImage, const VkImageLayout _srcLayout, const VkImageSubresourceRange& _range,
+	const std::vector<VkBufferImageCopy>& _regions, const Submission& _producer, void* _dst, size_t _bytes, PendingReadback& _outReadback)
+{
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	if (_vulkan.createReadbackBuffer(stagingBuffer, _bytes) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	// every failure from here on releases the command buffer and the staging buffer below
+	Result res = Result::Success;
+
+	VkCommandBuffer downloadCmds = VK_NULL_HANDLE;
+	if (_vulkan.createCommandBuffer(downloadCmds, VK_COMMAND_BUFFER_LEVEL_PRIMARY, QueueType::Transfer) != VK_SUCCESS ||
+		_vulkan.beginCommandBuffer(downloadCmds, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	{
+		res = Result::VulkanError;
+	}
+	else
+	{
+		_vulkan.acquireImage(downloadCmds, _srcImage,
+												 _srcLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+												 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, //dst stage, access
+												 QueueType::Graphics, QueueType::Transfer,
+												 _range);
+
+		vkCmdCopyImageToBuffer(downloadCmds, _srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingBuffer, static_cast<uint32_t>(_regions.size()), _regions.data());
+
+		// copies run on the transfer queue once the producing submission released the image
+		if (_vulkan.endCommandBuffer(downloadCmds) != VK_SUCCESS ||
+			_vulkan.submitCommandBuffer(downloadCmds, _outReadback.submission, _producer, QueueType::Transfer) != VK_SUCCESS)
+		{
+			res = Result::VulkanError;
+		}
+	}
+
+	if (res == Result::Success)
+	{
+		_outReadback.commandBuffer = downloadCmds;
+		_outReadback.buffer = stagingBuffer;
+		_outReadback.dst = _dst;
+		_outReadback.bytes = _bytes;
+		return res;
+	}
+
+	if (downloadCmds != VK_NULL_HANDLE)
+	{
+		_vulkan.destroyCommandBuffer(downloadCmds, QueueType::Transfer);
+	}
+	_vulkan.destroyBuffer(stagingBuffer);
+
+	return res;
+}
+
+// waits for the copy of a readbackImage() call, moves the data to its destination and releases the readback resources
+Result finishReadback(vkHelper& _vulkan, PendingReadback& _readback)
+{
+	if (_readback.buffer == VK_NULL_HANDLE)
+	{
+		return Result::Success;
+	}
+
+	Result res = Result::Success;
+	if (_vulkan.waitForSubmission(_readback.submission) != VK_SUCCESS ||
+		_vulkan.readBufferData(_readback.buffer, _readback.dst, _readback.bytes) != VK_SUCCESS)
+	{
+		res = Result::VulkanError;
+	}
+
+	_vulkan.destroyCommandBuffer(_readback.commandBuffer, QueueType::Transfer);
+	_vulkan.destroyBuffer(_readback.buffer);
+	_readback = PendingReadback{};
+
+	return res;
+}
+
+// the image has to be released to the transfer queue in inputImageLayout -> TRANSFER_SRC_OPTIMAL by the _producer submission
+// if _deferredWrites is set the file is appended to it together with the running readback instead of being written
+Result downloadCubemap(vkHelper& _vulkan, const VkImage _srcImage, const char* _outputPath, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, const Submission& _producer = {}, std::vector<DeferredWrite>* _deferredWrites = nullptr)
 {
 	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
 	if (pInfo == nullptr)
@@ -200,46 +692,59 @@ Result downloadCubemap(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 	const uint32_t cubeMapSideLength = pInfo->extent.width;
 	const uint32_t mipLevels = pInfo->mipLevels;
 
-	using Faces = std::vector<VkBuffer>;
-	using MipLevels = std::vector<Faces>;
+	// the texture storage is allocated first, the staging buffer mirrors its level/face layout so it can be read back in one copy
+	std::string path = _outputPath;
+	std::shared_ptr<IKtxImage> ktxImage;
+
+	if (path.size() >= 4u && path.substr(path.size() - 4).compare(".ktx") == 0)
+		ktxImage = std::make_unique<KtxImage1>(cubeMapSideLength, cubeMapSideLength, cubeMapFormat, mipLevels, true);
+	else
+		ktxImage = std::make_unique<KtxImage2>(cubeMapSideLength, cubeMapSideLength, cubeMapFormat, mipLevels, true);
+
+	const size_t dataSize = ktxImage->getDataSize();
+	if (ktxImage->getData() == nullptr || dataSize == 0u)
+	{
+		return Result::KtxError;
+	}
 
-	MipLevels stagingBuffer(mipLevels);
+	std::vector<VkBufferImageCopy> regions;
+	regions.reserve(mipLevels * 6u);
 
 	{
 		uint32_t currentSideLength = cubeMapSideLength;
 
 		for (uint32_t level = 0; level < mipLevels; level++)
 		{
-			Faces& faces = stagingBuffer[level];
-			faces.resize(6u);
-
 			for (uint32_t face = 0; face < 6u; face++)
 			{
-				if (_vulkan.createBufferAndAllocate(
-																						faces[face], currentSideLength * currentSideLength * cubeMapFormatByteSize,
-																						VK_BUFFER_USAGE_TRANSFER_DST_BIT,// VkBufferUsageFlags _usage,
-																						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)//VkMemoryPropertyFlags _memoryFlags,
-						!= VK_SUCCESS)
+				size_t offset = 0u;
+				if ((res = ktxImage->getImageOffset(face, level, offset)) != Result::Success)
 				{
-					return Result::VulkanError;
+					return res;
+				}
+
+				// buffer offsets of image copies must be texel and 4 byte aligned
+				if (offset % cubeMapFormatByteSize != 0u || offset % 4u != 0u)
+				{
+					printf("Unaligned ktx image offset %zu\n", offset);
+					return Result::KtxError;
 				}
+
+				VkBufferImageCopy region{};
+				region.bufferOffset = offset;
+				region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				region.imageSubresource.mipLevel = level;
+				region.imageSubresource.baseArrayLayer = face;
+				region.imageSubresource.layerCount = 1u;
+				region.imageExtent = { currentSideLength, currentSideLength, 1u };
+
+				regions.push_back(region);
 			}
 
 			currentSideLength = currentSideLength >> 1;
 		}
 	}
 
-	VkCommandBuffer downloadCmds = VK_NULL_HANDLE;
-	if (_vulkan.createCommandBuffer(downloadCmds) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
-
-	if (_vulkan.beginCommandBuffer(downloadCmds, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
-
 	// barrier on complete image
 	VkImageSubresourceRange  subresourceRange{};
 	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -248,222 +753,119 @@ Result downloadCubemap(vkHelper& _vulkan, const VkImage _srcImage, const char* _
 	subresourceRange.baseMipLevel = 0u;
 	subresourceRange.levelCount = mipLevels;
 
-	_vulkan.imageBarrier(downloadCmds, _srcImage,
-											 inputImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-											 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // src stage, access
-											 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
-											 subresourceRange);//dst stage, access
-
-	// copy all faces & levels into staging buffers
+	// the whole mip chain lands in the ktx storage with a single copy at the ktx offsets
+	PendingReadback readback;
+	if ((res = readbackImage(_vulkan, _srcImage, inputImageLayout, subresourceRange, regions, _producer, ktxImage->getData(), dataSize, readback)) != Result::Success)
 	{
-		uint32_t currentSideLength = cubeMapSideLength;
-
-		VkBufferImageCopy region{};
-
-		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		region.imageSubresource.layerCount = 1u;
+		return res;
+	}
 
-		for (uint32_t level = 0; level < mipLevels; level++)
+	if (_deferredWrites != nullptr)
+	{
+		_deferredWrites->push_back({ readback, [ktxImage, path]()
 		{
-			region.imageSubresource.mipLevel = level;
-			Faces& faces = stagingBuffer[level];
-
-			for (uint32_t face = 0; face < 6u; face++)
+			const Result saved = ktxImage->save(path.c_str());
+			if (saved != Result::Success)
 			{
-				region.imageSubresource.baseArrayLayer = face;
-				region.imageExtent = { currentSideLength , currentSideLength , 1u };
-
-				_vulkan.copyImage2DToBuffer(downloadCmds, _srcImage, faces[face], region);
+				printf("Could not save to path %s \n", path.c_str());
 			}
+			return saved;
+		}, dataSize });
 
-			currentSideLength = currentSideLength >> 1;
-		}
+		return Result::Success;
 	}
 
-	if (_vulkan.endCommandBuffer(downloadCmds) != VK_SUCCESS)
+	if ((res = finishReadback(_vulkan, readback)) != Result::Success)
 	{
-		return Result::VulkanError;
+		return res;
 	}
 
-	if (_vulkan.executeCommandBuffer(downloadCmds) != VK_SUCCESS)
+	res = ktxImage->save(_outputPath);
+	if (res != Result::Success)
 	{
-		return Result::VulkanError;
+		printf("Could not save to path %s \n", _outputPath);
+		return res;
 	}
 
-	_vulkan.destroyCommandBuffer(downloadCmds);
+	return Result::Success;
+}
 
-	// Image is copied to buffer
-	// Now map buffer and copy to ram
+// reads back the rgba16f LUT, the image has to be released to the transfer queue in GENERAL -> TRANSFER_SRC_OPTIMAL by the _producer submission.
+// see encodeLUT for the file formats, if _deferredWrites is set the file is appended to it together with the running readback and encoded by the write
+Result downloadLUT(vkHelper& _vulkan, const VkImage _srcImage, Distribution _distribution, const char* _outputPath, const Submission& _producer = {}, std::vector<DeferredWrite>* _deferredWrites = nullptr)
+{
+	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
+	if (pInfo == nullptr || pInfo->format != VK_FORMAT_R16G16B16A16_SFLOAT)
 	{
-        std::string path = _outputPath;
-        std::unique_ptr<IKtxImage> ktxImage;
+		return Result::InvalidArgument;
+	}
 
-        if (path.substr(path.size()-4).compare(".ktx") == 0)
-            ktxImage = std::make_unique<KtxImage1>(cubeMapSideLength, cubeMapSideLength, cubeMapFormat, mipLevels, true);
-        else
-            ktxImage = std::make_unique<KtxImage2>(cubeMapSideLength, cubeMapSideLength, cubeMapFormat, mipLevels, true);
+	const uint32_t width = pInfo->extent.width;
+	const uint32_t height = pInfo->extent.height;
+	const size_t pixelCount = static_cast<size_t>(width) * height;
+	const size_t imageByteSize = pixelCount * 4u * sizeof(uint16_t);
 
-        std::vector<uint8_t> imageData;
+	VkBufferImageCopy region{};
+	region.imageExtent = pInfo->extent;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1u;
+	region.imageSubresource.mipLevel = 0;
+	region.imageSubresource.baseArrayLayer = 0;
 
-		uint32_t currentSideLength = cubeMapSideLength;
-
-		for (uint32_t level = 0; level < mipLevels; level++)
-		{
-			const size_t imageByteSize = (size_t)currentSideLength * (size_t)currentSideLength * (size_t)cubeMapFormatByteSize;
-			imageData.resize(imageByteSize);
-
-			Faces& faces = stagingBuffer[level];
-
-			for (uint32_t face = 0; face < 6u; face++)
-			{
-				if (_vulkan.readBufferData(faces[face], imageData.data(), imageByteSize) != VK_SUCCESS)
-				{
-					return Result::VulkanError;
-				}
-
-				res = ktxImage->writeFace(imageData, face, level);
-
-				if (res != Result::Success)
-				{
-					return res;
-				}
-
-				_vulkan.destroyBuffer(faces[face]);
-			}
-
-			currentSideLength = currentSideLength >> 1;
-		}
-
-		res = ktxImage->save(_outputPath);
-		if (res != Result::Success)
-		{
-			printf("Could not save to path %s \n", _outputPath);
-			return res;
-		}
-	}
+	const std::shared_ptr<std::vector<uint16_t>> lut = std::make_shared<std::vector<uint16_t>>(pixelCount * 4u);
 
-	return Result::Success;
-}
-
-Result download2DImage(vkHelper& _vulkan, const VkImage _srcImage, const char* _outputPath, const VkImageLayout inputImageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL)
-{
-	const VkImageCreateInfo* pInfo = _vulkan.getCreateInfo(_srcImage);
-	if (pInfo == nullptr)
+	PendingReadback readback;
+	Result res = readbackImage(_vulkan, _srcImage, VK_IMAGE_LAYOUT_GENERAL, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u }, { region }, _producer, lut->data(), imageByteSize, readback);
+	if (res != Result::Success)
 	{
-		return Result::InvalidArgument;
+		return res;
 	}
 
-	Result res = Success;
-
-	const VkFormat format = pInfo->format;
-	const uint32_t formatByteSize = getFormatSize(format);
-	const uint32_t width = pInfo->extent.width;
-	const uint32_t height = pInfo->extent.width;
-	const size_t imageByteSize = width * height * formatByteSize;
-
-	VkBuffer stagingBuffer{};
+	const std::string path = _outputPath;
 
-	if (_vulkan.createBufferAndAllocate(
-																			stagingBuffer, static_cast<uint32_t>(imageByteSize),
-																			VK_BUFFER_USAGE_TRANSFER_DST_BIT,// VkBufferUsageFlags _usage,
-																			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)//VkMemoryPropertyFlags _memoryFlags,
-			!= VK_SUCCESS)
+	if (_deferredWrites != nullptr)
 	{
-		return Result::VulkanError;
-	}
+		_deferredWrites->push_back({ readback, [lut, path, _distribution, width]()
+		{
+			std::function<Result()> write;
+			size_t bytes = 0u;
 
-	VkCommandBuffer downloadCmds = VK_NULL_HANDLE;
-	if (_vulkan.createCommandBuffer(downloadCmds) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
+			Result saved = encodeLUT(path.c_str(), _distribution, width, *lut, write, bytes);
+			if (saved == Result::Success)
+			{
+				saved = write();
+			}
+			if (saved != Result::Success)
+			{
+				printf("Could not save to path %s \n", path.c_str());
+			}
+			return saved;
+		}, imageByteSize });
 
-	if (_vulkan.beginCommandBuffer(downloadCmds, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
+		return Result::Success;
 	}
 
-	// barrier on complete image
-	VkImageSubresourceRange  subresourceRange{};
-	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	subresourceRange.baseArrayLayer = 0u;
-	subresourceRange.layerCount = 1u;
-	subresourceRange.baseMipLevel = 0u;
-	subresourceRange.levelCount = 1u;
-
-	_vulkan.imageBarrier(downloadCmds, _srcImage,
-											 inputImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-											 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // src stage, access
-											 VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
-											 subresourceRange);//dst stage, access
-
-	// copy 2D image to buffer
+	if ((res = finishReadback(_vulkan, readback)) != Result::Success)
 	{
-		VkBufferImageCopy region{};
-
-		region.imageExtent = pInfo->extent;
-		region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		region.imageSubresource.layerCount = 1u;
-		region.imageSubresource.mipLevel = 0;
-		region.imageSubresource.baseArrayLayer = 0;
-
-		_vulkan.copyImage2DToBuffer(downloadCmds, _srcImage, stagingBuffer, region);
+		return res;
 	}
 
-	if (_vulkan.endCommandBuffer(downloadCmds) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
+	std::function<Result()> write;
+	size_t bytes = 0u;
 
-	if (_vulkan.executeCommandBuffer(downloadCmds) != VK_SUCCESS)
+	res = encodeLUT(_outputPath, _distribution, width, *lut, write, bytes);
+	if (res != Result::Success)
 	{
-		return Result::VulkanError;
+		return res;
 	}
 
-	_vulkan.destroyCommandBuffer(downloadCmds);
-
-	// Image is copied to buffer
-	// Now map buffer and copy to ram
+	res = write();
+	if (res != Result::Success)
 	{
-
-		std::vector<uint8_t> imageData;
-		imageData.resize(imageByteSize);
-
-		if (_vulkan.readBufferData(stagingBuffer, imageData.data(), imageByteSize) != VK_SUCCESS)
-		{
-			return Result::VulkanError;
-		}
-
-		// Compute channel count by dividing the pixel byte length through each channels byte length.
-		const uint32_t channels = getChannelCount(pInfo->format);
-
-		// Copy the outputted image (format with 1, 2 or 4 channels) into a 3-channel image.
-		// This is kind of a hack (this function is currently only used to write the BRDF LUT to disk):
-		// It seems that stb_write_image is not able to write PNGs with 4 components,
-		// and 2-channel images are displayed as grey-alpha,
-		// which makes is impossible to compare the outputted LUT with already
-		// existing LUT PNGs.
-		std::vector<uint8_t> imageDataThreeChannel(imageData.size() * (4 / channels), 0);
-		for (uint32_t x = 0; x < width; x++) {
-			for (uint32_t y = 0; y < height; y++) {
-				for (uint32_t c = 0; c < std::min(channels, 3u); c++) {
-					imageDataThreeChannel[3 * (x * width + y) + c] =
-					imageData[channels * (x * width + y) + c];
-				}
-			}
-		}
-
-		STBImage stb_image;
-		res = stb_image.savePng(_outputPath, width, height, 3, imageDataThreeChannel.data());
-		if (res != Result::Success)
-		{
-			return res;
-		}
-
-		_vulkan.destroyBuffer(stagingBuffer);
+		printf("Could not save to path %s \n", _outputPath);
 	}
 
-	return Result::Success;
+	return res;
 }
 
 void generateMipmapLevels(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, const VkImage _image, uint32_t _maxMipLevels, uint32_t _sideLength, const VkImageLayout _currentImageLayout)
@@ -545,528 +947,2171 @@ void generateMipmapLevels(vkHelper& _vulkan, const VkCommandBuffer _commandBuffe
 		_vulkan.imageBarrier(_commandBuffer, _image,
 												 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
 												 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-												 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,//dst stage, access
+												 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,//dst stage, access
 												 completeRange);
 	}
 }
 
-Result panoramaToCubemap(vkHelper& _vulkan, const VkCommandBuffer _commandBuffer, /*const VkRenderPass _renderPass,*/ const VkShaderModule fullscreenVertexShader, const VkImage _panoramaImage, const VkImage _cubeMapImage)
+// output cube map extent of a job, the side length defaults to half the panorama height
+Result getCubeMapExtent(Distribution _distribution, uint32_t _cubemapResolution, uint32_t _mipmapCount, uint32_t _panoramaHeight, uint32_t& _outSideLength, uint32_t& _outMipLevels)
 {
-	IBLLib::Result res = Result::Success;
-
-	const VkImageCreateInfo* textureInfo = _vulkan.getCreateInfo(_cubeMapImage);
+	// it is best to sample an nxn cube map from a 4nx2n equirectangular image, e.g. a 1024x512 equirectangular images becomes a 256x256 cube map.
+	const uint32_t cubeMapSideLength = _cubemapResolution != 0 ? _cubemapResolution : _panoramaHeight / 2;
+	const uint32_t mipmapCount = _mipmapCount != 0 ? _mipmapCount : static_cast<uint32_t>(floor(log2(cubeMapSideLength)));
+	const uint32_t outputMipLevels = _distribution == Distribution::Lambertian ? 1u : mipmapCount;
 
-	if (textureInfo == nullptr)
+	if (cubeMapSideLength == 0u || outputMipLevels == 0u || (cubeMapSideLength >> (outputMipLevels - 1)) < 1)
 	{
+		printf("Error: CubemapResolution incompatible with MipmapCount\n");
 		return Result::InvalidArgument;
 	}
 
-	const uint32_t cubeMapSideLength = textureInfo->extent.width;
-	const uint32_t maxMipLevels = textureInfo->mipLevels;
-	const VkFormat format = textureInfo->format;
+	_outSideLength = cubeMapSideLength;
+	_outMipLevels = outputMipLevels;
 
-	VkShaderModule panoramaToCubeMapFragmentShader = VK_NULL_HANDLE;
-	if ((res = compileShader(_vulkan, filterFragmentShader, "panoramaToCubeMap", panoramaToCubeMapFragmentShader, ShaderCompiler::Stage::Fragment)) != Result::Success)
+	return Result::Success;
+}
+
+// uri of _path relative to the directory of the glTF file, paths outside of it are kept as they are
+std::string getGltfUri(const char* _gltfPath, const char* _path)
+{
+	std::string gltfPath = _gltfPath;
+	std::string path = _path;
+	std::replace(gltfPath.begin(), gltfPath.end(), '\\', '/');
+	std::replace(path.begin(), path.end(), '\\', '/');
+
+	const size_t slash = gltfPath.find_last_of('/');
+	const std::string directory = slash == std::string::npos ? std::string() : gltfPath.substr(0u, slash + 1u);
+
+	if (directory.empty() == false && path.compare(0u, directory.size(), directory) == 0)
 	{
-		return res;
+		return path.substr(directory.size());
 	}
 
-	VkRenderPass renderPass = VK_NULL_HANDLE;
-	{
-		RenderPassDesc renderPassDesc;
+	return path;
+}
 
-		// add rendertargets (cubemap faces)
-		for (int face = 0; face < 6; ++face)
-		{
-			renderPassDesc.addAttachment(format);
-		}
-		if (_vulkan.createRenderPass(renderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
+std::string getGltfMimeType(const char* _path)
+{
+	const std::string path = _path;
+	return path.size() >= 4u && path.substr(path.size() - 4).compare(".ktx") == 0 ? "image/ktx" : "image/ktx2";
+}
+
+// glTF scene with an EXT_lights_image_based light, the irradiance is given by the SH coefficients
+Result writeEnvironmentGltf(const char* _path, const char* _specularPath, const char* _skyboxPath, const float _shCoeffs[9][4])
+{
+	std::string images;
+	const char* const imagePaths[] = { _specularPath, _skyboxPath };
+	for (const char* imagePath : imagePaths)
+	{
+		if (imagePath == nullptr)
 		{
-			return Result::VulkanError;
+			continue;
 		}
-	}
 
-	VkSamplerCreateInfo samplerInfo{};
-	_vulkan.fillSamplerCreateInfo(samplerInfo);
+		const std::string uri = getGltfUri(_path, imagePath);
+		const std::string name = uri.substr(uri.find_last_of('/') + 1u);
+		images += images.empty() ? "" : ",\n";
+		images += "\t\t{\n\t\t\t\"name\": \"" + name + "\",\n\t\t\t\"uri\": \"" + uri + "\",\n\t\t\t\"mimeType\": \"" + getGltfMimeType(imagePath) + "\"\n\t\t}";
+	}
 
-	samplerInfo.maxLod = float(maxMipLevels + 1);
-	VkSampler panoramaSampler = VK_NULL_HANDLE;
-	if (_vulkan.createSampler(panoramaSampler, samplerInfo) != VK_SUCCESS)
+	std::string coefficients;
+	for (int i = 0; i < 9; ++i)
 	{
-		return Result::VulkanError;
+		char line[128];
+		snprintf(line, sizeof(line), "%s\t\t\t\t\t[ %.9g, %.9g, %.9g ]", i == 0 ? "" : ",\n", _shCoeffs[i][0], _shCoeffs[i][1], _shCoeffs[i][2]);
+		coefficients += line;
 	}
 
-	VkImageView panoramaImageView = VK_NULL_HANDLE;
-	if (_vulkan.createImageView(panoramaImageView, _panoramaImage) != VK_SUCCESS)
+	const std::string skybox = _skyboxPath != nullptr ? "\t\t\t\t\t\"skymapImage\": 1,\n\t\t\t\t\t\"skymapImageLodLevel\": 0,\n" : "";
+
+	const std::string gltf =
+		"{\n"
+		"\t\"asset\": {\n\t\t\"version\": \"2.0\"\n\t},\n"
+		"\t\"images\": [\n" + images + "\n\t],\n"
+		"\t\"scenes\": [\n\t\t{\n\t\t\t\"name\": \"scene\",\n\t\t\t\"extensions\": {\n\t\t\t\t\"EXT_lights_image_based\": {\n\t\t\t\t\t\"light\": 0\n\t\t\t\t}\n\t\t\t}\n\t\t}\n\t],\n"
+		"\t\"scene\": 0,\n"
+		"\t\"extensions\": {\n\t\t\"EXT_lights_image_based\": {\n\t\t\t\"lights\": [\n\t\t\t\t{\n"
+		"\t\t\t\t\t\"intensity\": 1,\n"
+		"\t\t\t\t\t\"irradianceCoefficients\": [\n" + coefficients + "\n\t\t\t\t\t],\n"
+		"\t\t\t\t\t\"name\": \"imageBasedLight\",\n"
+		"\t\t\t\t\t\"extras\": {\n" + skybox + "\t\t\t\t\t\t\"specularCubeImage\": 0\n\t\t\t\t\t}\n"
+		"\t\t\t\t}\n\t\t\t]\n\t\t}\n\t},\n"
+		"\t\"extensionsUsed\": [\n\t\t\"EXT_lights_image_based\"\n\t]\n"
+		"}\n";
+
+	if (writeFile(_path, gltf.data(), gltf.size()) == false)
 	{
-		return Result::VulkanError;
+		printf("Could not save to path %s \n", _path);
+		return Result::FileNotFound;
 	}
 
-	VkPipelineLayout panoramaPipelineLayout = VK_NULL_HANDLE;
+	return Result::Success;
+}
+
+//Push Constants for specular and diffuse filter passes
+struct PushConstant
+{
+	float roughness = 0.f;
+	uint32_t mipLevel = 1u;
+	uint32_t width = 1024u;
+	float lodBias = 0.f;
+	uint32_t mipLevelCount = 1u; // compute filter only
+	PanoramaEncoding panoramaEncoding = PanoramaEncoding::Linear; // panorama pass only
+	uint32_t panoramaWidth = 0u; // panorama pass only
+	uint32_t panoramaHeight = 0u; // panorama pass only
+};
+
+constexpr VkFormat cubeMapFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
+// rgb: GGX scale and bias, Charlie scale. rgba16f is a mandatory storage image format, the output files are converted on the host
+constexpr VkFormat LUTFormat = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+// must match MAX_MIP_LEVELS in filter.frag, the sample table and the compute filter support at most this many output levels
+constexpr uint32_t filterMaxMipLevels = 16u;
+// must match GROUP_SIZE in filter.frag
+constexpr uint32_t computeFilterGroupSize = 8u;
+
+// uSampleTable in filter.frag: first sample and sample count of every level, followed by the vec4 samples of all levels
+constexpr size_t sampleTableHeaderBytes = filterMaxMipLevels * 2u * sizeof(uint32_t);
+// initial size of the sample table buffer, enough for the default 1024 samples on all levels
+constexpr size_t sampleTableDefaultBytes = sampleTableHeaderBytes + filterMaxMipLevels * 1024u * 4u * sizeof(float);
+
+const char* const computeFilterPreamble = "#define IBLSAMPLER_COMPUTE\n";
+const char* const computeFilterWithoutFormatPreamble = "#define IBLSAMPLER_COMPUTE\n#define IBLSAMPLER_OUTPUT_WITHOUT_FORMAT\n";
+const char* const lutPreamble = "#define IBLSAMPLER_COMPUTE\n#define IBLSAMPLER_LUT\n";
+
+// must match GROUP_SIZE in filter.frag
+constexpr uint32_t lutGroupSize = 8u;
+} // !IBLLib
+
+struct IBLLib::IblSession::Impl
+{
+	// render targets depending on the job parameters, recreated if one of the keys changes
+	struct Targets
+	{
+		// input key, the outputs are recreated with the input cube map
+		uint32_t inputSideLength = 0u;
+
+		uint32_t inputMipLevels = 0u;
+		VkImage inputCubeMap = VK_NULL_HANDLE;
+		VkImageView inputCubeMapCompleteView = VK_NULL_HANDLE;
+		VkFramebuffer inputCubeMapFramebuffer = VK_NULL_HANDLE;
+
+		// output keys
+		uint32_t sideLength = 0u;
+		uint32_t outputMipLevels = 0u;
+		VkFormat targetFormat = VK_FORMAT_UNDEFINED;
+		// the compute filter storage images are bound instead of the framebuffers
+		bool compute = false;
+
+		// the target format if the filter can write it, cubeMapFormat otherwise
+		VkFormat renderFormat = VK_FORMAT_UNDEFINED;
+		VkImage outputCubeMap = VK_NULL_HANDLE;
+		VkRenderPass filterRenderPass = VK_NULL_HANDLE;
+		std::vector<VkFramebuffer> filterFramebuffers; // one per output mip level
+
+		// created by convertVkFormat on first use if the render format differs from the target format
+		VkImage convertedCubeMap = VK_NULL_HANDLE;
+
+		// the BRDF LUT is independent of the cube maps
+		uint32_t lutResolution = 0u;
+		VkImage lut = VK_NULL_HANDLE;
+	};
+
+	vkHelper vulkan;
+	bool initialized = false;
+
+	VkSampler sampler = VK_NULL_HANDLE;
+	VkBuffer shUniformBuffer = VK_NULL_HANDLE;
+	// importance samples of the current job, see prepareSampleTable()
+	VkBuffer sampleTableBuffer = VK_NULL_HANDLE;
+	size_t sampleTableBytes = 0u;
+
+	VkRenderPass panoramaRenderPass = VK_NULL_HANDLE;
 	VkDescriptorSet panoramaSet = VK_NULL_HANDLE;
-	VkPipeline panoramaToCubeMapPipeline = VK_NULL_HANDLE;
+	VkPipelineLayout panoramaPipelineLayout = VK_NULL_HANDLE;
+	VkPipeline panoramaPipeline = VK_NULL_HANDLE;
+
+	// one per render format, see getFilterRenderPass()
+	std::map<VkFormat, VkRenderPass> filterRenderPasses;
+	VkDescriptorSet filterSet = VK_NULL_HANDLE;
+	VkPipelineLayout filterPipelineLayout = VK_NULL_HANDLE;
+
+	// VK_NULL_HANDLE if the device does not support the compute filter
+	VkDescriptorSet computeFilterSet = VK_NULL_HANDLE;
+	VkPipelineLayout computeFilterPipelineLayout = VK_NULL_HANDLE;
+
+	VkDescriptorSet lutSet = VK_NULL_HANDLE;
+	VkPipelineLayout lutPipelineLayout = VK_NULL_HANDLE;
+
+	// the filter and LUT pipelines are created on first use, see getPipeline()
+	VkShaderModule fullscreenVertexShader = VK_NULL_HANDLE;
+	VkShaderModule filterCubeMapFragmentShader = VK_NULL_HANDLE;
+	VkShaderModule filterCubeMapComputeShader = VK_NULL_HANDLE;
+	// writes any storage format, VK_NULL_HANDLE without shaderStorageImageWriteWithoutFormat
+	VkShaderModule filterCubeMapComputeWithoutFormatShader = VK_NULL_HANDLE;
+	VkShaderModule generateLUTShader = VK_NULL_HANDLE;
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+
+	enum class FilterPass : uint32_t
 	{
-		//
-		// Create pipeline layout
-		//
-		VkDescriptorSetLayout panoramaSetLayout = VK_NULL_HANDLE;
-		DescriptorSetInfo setLayout0;
-		setLayout0.addCombinedImageSampler(panoramaSampler, panoramaImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		Fragment = 0,
+		Compute,
+		LUT
+	};
 
-		if (setLayout0.create(_vulkan, panoramaSetLayout, panoramaSet) != VK_SUCCESS)
-		{
-			return Result::VulkanError;
-		}
+	struct PipelineKey
+	{
+		FilterPass pass = FilterPass::Fragment;
+		Distribution distribution = Distribution::Lambertian;
+		uint32_t sampleCount = 0u;
+		VkFormat format = VK_FORMAT_UNDEFINED;
 
-		_vulkan.updateDescriptorSets(setLayout0.getWrites());
+		bool operator<(const PipelineKey& _other) const;
+	};
 
-		if (_vulkan.createPipelineLayout(panoramaPipelineLayout, panoramaSetLayout) != VK_SUCCESS)
-		{
-			return Result::VulkanError;
-		}
+	// destroyed with the device
+	std::map<PipelineKey, VkPipeline> pipelines;
 
-		GraphicsPipelineDesc panormaToCubePipeline;
+	Targets targets;
 
-		panormaToCubePipeline.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
-		panormaToCubePipeline.addShaderStage(panoramaToCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "panoramaToCubeMap");
+	// the latest submissions using the targets, they are only rewritten or destroyed once these completed
+	Submission lastGraphics;
+	Submission cubeMapReadback;
+	Submission lutReadback;
 
-		panormaToCubePipeline.setRenderPass(renderPass);
-		panormaToCubePipeline.setPipelineLayout(panoramaPipelineLayout);
+	// resources of submitted work, released once their submission completed, see releaseRetired()
+	struct Retired
+	{
+		Submission submission;
+		QueueType queue = QueueType::Graphics; // of the command buffer
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkImage image = VK_NULL_HANDLE;
+	};
+	std::vector<Retired> retired;
+
+	// encoded BRDF LUTs of this session
+	LutCache lutCache;
+
+	Result initialize(bool _debugOutput);
+	Result run(const IblJob& _job);
+	Result runBundle(const IblBundle& _bundle);
+	Result runBatch(const std::vector<IblJob>& _jobs, const BatchOptions& _options, std::vector<Result>* _outResults);
+
+private:
+	void describePanoramaSet(DescriptorSetInfo& _info, VkImageView _panoramaView) const;
+	void describeFilterSet(DescriptorSetInfo& _info, VkImageView _cubeMapView) const;
+	void describeComputeFilterSet(DescriptorSetInfo& _info, VkImageView _cubeMapView, const std::vector<VkImageView>& _outputMipViews) const;
+	void describeLUTSet(DescriptorSetInfo& _info, VkImageView _lutView) const;
+
+	// pipeline of _pass, created on first use. the LUT is specialized per distribution and sample count,
+	// the filters only distinguish the lambertian SH evaluation from the sample table.
+	// _renderFormat is the format of the filter output, ignored by the LUT pass
+	Result getPipeline(FilterPass _pass, Distribution _distribution, uint32_t _sampleCount, VkFormat _renderFormat, VkPipeline& _outPipeline);
+	// render pass with six attachments of _format, created on first use
+	Result getFilterRenderPass(VkFormat _format, VkRenderPass& _outRenderPass);
+
+	// the input cube map can be larger than the outputs filtered from it, several outputs share one input
+	Result prepareInputCubeMap(uint32_t _sideLength);
+	// the output is rendered or stored directly in _targetFormat if the device supports it
+	Result prepareTargets(uint32_t _sideLength, uint32_t _outputMipLevels, VkFormat _targetFormat, bool _compute);
+	Result prepareLUT(uint32_t _resolution);
+	// uploads the importance samples of every output level of _job, grows the buffer if needed
+	Result prepareSampleTable(const IblJob& _job, uint32_t _sideLength, uint32_t _outputMipLevels);
+	void destroyOutputTargets();
+	void destroyTargets();
+	// blocks until no filter, LUT pass or readback uses the targets anymore
+	void waitForTargets();
+
+	// frees _commandBuffer once _submission completed, the host does not wait for it
+	void retire(const Submission& _submission, VkCommandBuffer _commandBuffer, QueueType _queue = QueueType::Graphics);
+	// releases the panorama image and its upload resources once the last pass using them completed
+	void retirePanorama(Panorama& _panorama);
+	// releases the retired resources whose submission completed, all of them if _wait is set
+	void releaseRetired(bool _wait);
+
+	Result validateJob(const IblJob& _job) const;
+	// decodes the panorama, projects it onto SH and uploads it if _upload is set
+	Result loadPanorama(const char* _inputPath, const char* _outputPathSH, bool _upload, Panorama& _outPanorama);
+	// uploads and filters a panorama decoded by decodePanorama, the outputs are appended to _deferredWrites
+	Result runDecoded(const IblJob& _job, const DecodedPanorama& _decoded, std::vector<DeferredWrite>& _deferredWrites);
+	Result filter(const IblJob& _job, Panorama& _panorama, std::vector<DeferredWrite>* _deferredWrites = nullptr);
+	// panorama to cube map and mip chain, submitted on the graphics queue
+	Result renderInputCubeMap(Panorama& _panorama, uint32_t _sideLength, VkCommandBuffer& _outCommandBuffer, Submission& _outSubmission);
+	// filters the input cube map into the output targets once _input completed and reads them back
+	Result filterCubeMap(const IblJob& _job, uint32_t _sideLength, uint32_t _outputMipLevels, VkFormat _targetFormat, const Submission& _input, std::vector<DeferredWrite>* _deferredWrites);
+	void recordFragmentFilter(VkCommandBuffer _commandBuffer, VkPipeline _pipeline, const IblJob& _job, uint32_t _sideLength, uint32_t _outputMipLevels);
+	void recordComputeFilter(VkCommandBuffer _commandBuffer, VkPipeline _pipeline, const IblJob& _job, uint32_t _sideLength, uint32_t _outputMipLevels);
+	// BRDF LUT of _distribution in its own compute pass, taken from the cache if possible
+	Result generateLUT(Distribution _distribution, uint32_t _resolution, uint32_t _sampleCount, const char* _outputPath, const char* _cacheDirectory, std::vector<DeferredWrite>* _deferredWrites);
+};
+
+void IBLLib::IblSession::Impl::describePanoramaSet(DescriptorSetInfo& _info, VkImageView _panoramaView) const
+{
+	_info.addCombinedImageSampler(sampler, _panoramaView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+}
 
-		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_FALSE;
+void IBLLib::IblSession::Impl::describeFilterSet(DescriptorSetInfo& _info, VkImageView _cubeMapView) const
+{
+	_info.addCombinedImageSampler(sampler, _cubeMapView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1u, VK_SHADER_STAGE_FRAGMENT_BIT);
+	_info.addUniform(shUniformBuffer, 0u, sizeof(SH9::coeffs), 2u, VK_SHADER_STAGE_FRAGMENT_BIT);
+	_info.addStorageBuffer(sampleTableBuffer, 0u, VK_WHOLE_SIZE, 5u, VK_SHADER_STAGE_FRAGMENT_BIT);
+}
 
-		panormaToCubePipeline.addColorBlendAttachment(colorBlendAttachment,6);
+void IBLLib::IblSession::Impl::describeComputeFilterSet(DescriptorSetInfo& _info, VkImageView _cubeMapView, const std::vector<VkImageView>& _outputMipViews) const
+{
+	_info.addCombinedImageSampler(sampler, _cubeMapView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1u, VK_SHADER_STAGE_COMPUTE_BIT);
+	_info.addUniform(shUniformBuffer, 0u, sizeof(SH9::coeffs), 2u, VK_SHADER_STAGE_COMPUTE_BIT);
+	_info.addStorageImages(_outputMipViews, VK_IMAGE_LAYOUT_GENERAL, 3u, VK_SHADER_STAGE_COMPUTE_BIT);
+	_info.addStorageBuffer(sampleTableBuffer, 0u, VK_WHOLE_SIZE, 5u, VK_SHADER_STAGE_COMPUTE_BIT);
+}
 
-		panormaToCubePipeline.setViewportExtent(VkExtent2D{ cubeMapSideLength, cubeMapSideLength });
+void IBLLib::IblSession::Impl::describeLUTSet(DescriptorSetInfo& _info, VkImageView _lutView) const
+{
+	_info.addStorageImages({ _lutView }, VK_IMAGE_LAYOUT_GENERAL, 4u, VK_SHADER_STAGE_COMPUTE_BIT);
+}
 
-		if (_vulkan.createPipeline(panoramaToCubeMapPipeline, panormaToCubePipeline.getInfo()) != VK_SUCCESS)
-		{
-			return Result::VulkanError;
-		}
+bool IBLLib::IblSession::Impl::PipelineKey::operator<(const PipelineKey& _other) const
+{
+	if (pass != _other.pass)
+		return pass < _other.pass;
+	if (distribution != _other.distribution)
+		return distribution < _other.distribution;
+	if (sampleCount != _other.sampleCount)
+		return sampleCount < _other.sampleCount;
+	return format < _other.format;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::getFilterRenderPass(VkFormat _format, VkRenderPass& _outRenderPass)
+{
+	const auto it = filterRenderPasses.find(_format);
+	if (it != filterRenderPasses.end())
+	{
+		_outRenderPass = it->second;
+		return Result::Success;
+	}
+
+	RenderPassDesc renderPassDesc;
+
+	// add rendertargets (cubemap faces)
+	for (int face = 0; face < 6; ++face)
+	{
+		renderPassDesc.addAttachment(_format);
 	}
 
-	/// Render Pass
-	std::vector<VkImageView> inputCubeMapViews(6u, VK_NULL_HANDLE);
-	for (size_t i = 0; i < inputCubeMapViews.size(); i++)
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	if (vulkan.createRenderPass(renderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
 	{
-		if (_vulkan.createImageView(inputCubeMapViews[i], _cubeMapImage, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, static_cast<uint32_t>(i), 1u }) != VK_SUCCESS)
+		return Result::VulkanError;
+	}
+
+	filterRenderPasses.emplace(_format, renderPass);
+	_outRenderPass = renderPass;
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::getPipeline(FilterPass _pass, Distribution _distribution, uint32_t _sampleCount, VkFormat _renderFormat, VkPipeline& _outPipeline)
+{
+	PipelineKey key;
+	key.pass = _pass;
+	// GGXCubeMap only differs in the output file names
+	key.distribution = _distribution == Distribution::GGXCubeMap ? Distribution::GGX : _distribution;
+	key.sampleCount = _sampleCount;
+
+	if (_pass != FilterPass::LUT)
+	{
+		// the lambertian filter evaluates the SH, the others read the distribution and the sample count of every level
+		// from the sample table, so all of them share one variant
+		key.sampleCount = 1u;
+		if (key.distribution != Distribution::Lambertian)
 		{
-			return Result::VulkanError;
+			key.distribution = Distribution::GGX;
 		}
+
+		// the compute shader without format qualifier stores any format
+		key.format = _pass == FilterPass::Compute && _renderFormat != cubeMapFormat ? VK_FORMAT_UNDEFINED : _renderFormat;
 	}
 
-	VkFramebuffer cubeMapInputFramebuffer = VK_NULL_HANDLE;
-	if (_vulkan.createFramebuffer(cubeMapInputFramebuffer, renderPass, cubeMapSideLength, cubeMapSideLength, inputCubeMapViews, 1u) != VK_SUCCESS)
+	const auto it = pipelines.find(key);
+	if (it != pipelines.end())
 	{
-		return Result::VulkanError;
+		_outPipeline = it->second;
+		return Result::Success;
 	}
 
+	// constant_id order of filter.frag
+	SpecConstantFactory specConstants;
+	specConstants.addConstant(static_cast<uint32_t>(key.distribution));
+	specConstants.addConstant(key.sampleCount);
+
+	IBLLib::Result res = Result::Success;
+	VkPipeline pipeline = VK_NULL_HANDLE;
+
+	switch (_pass)
 	{
-		VkImageSubresourceRange  subresourceRangeBaseMiplevel = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u };
+		case FilterPass::Fragment:
+		{
+			VkRenderPass renderPass = VK_NULL_HANDLE;
+			if ((res = getFilterRenderPass(key.format, renderPass)) != Result::Success)
+			{
+				return res;
+			}
 
-		_vulkan.imageBarrier(_commandBuffer, _cubeMapImage,
-												 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-												 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,// src stage, access
-												 VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, //dst stage, access
-												 subresourceRangeBaseMiplevel);
-	}
+			GraphicsPipelineDesc filterCubeMapPipelineDesc;
 
-	_vulkan.bindDescriptorSet(_commandBuffer, panoramaPipelineLayout, panoramaSet);
+			filterCubeMapPipelineDesc.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
+			filterCubeMapPipelineDesc.addShaderStage(filterCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "filterCubeMap", specConstants.getInfo());
 
-	vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, panoramaToCubeMapPipeline);
+			filterCubeMapPipelineDesc.setRenderPass(renderPass);
+			filterCubeMapPipelineDesc.setPipelineLayout(filterPipelineLayout);
 
-	const std::vector<VkClearValue> clearValues(6u, { 0.0f, 0.0f, 1.0f, 1.0f });
+			filterCubeMapPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 6u); // TODO: rgb only
 
-	_vulkan.beginRenderPass(_commandBuffer, renderPass, cubeMapInputFramebuffer, VkRect2D{ 0u, 0u, cubeMapSideLength, cubeMapSideLength }, clearValues);
-	vkCmdDraw(_commandBuffer, 3, 1u, 0, 0);
-	_vulkan.endRenderPass(_commandBuffer);
+			filterCubeMapPipelineDesc.setDynamicViewport();
 
-	return res;
-}
-} // !IBLLib
+			if (vulkan.createPipeline(pipeline, filterCubeMapPipelineDesc.getInfo()) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+			break;
+		}
+		case FilterPass::Compute:
+		{
+			const bool withoutFormat = key.format == VK_FORMAT_UNDEFINED;
+			if (withoutFormat && filterCubeMapComputeWithoutFormatShader == VK_NULL_HANDLE)
+			{
+				return Result::InvalidArgument;
+			}
 
+			if (vulkan.createComputePipeline(pipeline, computeFilterPipelineLayout,
+																			 withoutFormat ? filterCubeMapComputeWithoutFormatShader : filterCubeMapComputeShader,
+																			 withoutFormat ? "filterCubeMapComputeWithoutFormat" : "filterCubeMapCompute", specConstants.getInfo()) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+			break;
+		}
+		case FilterPass::LUT:
+			if (vulkan.createComputePipeline(pipeline, lutPipelineLayout, generateLUTShader, "generateLUT", specConstants.getInfo()) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+			break;
+	}
 
-IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, const char* _outputPathSH, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput)
-{
-	const VkFormat cubeMapFormat = VK_FORMAT_R32G32B32A32_SFLOAT;
-	const VkFormat LUTFormat = VK_FORMAT_R8G8B8A8_UNORM;
+	pipelines.emplace(key, pipeline);
+	_outPipeline = pipeline;
 
-	IBLLib::Result res = Result::Success;
+	return Result::Success;
+}
 
-	vkHelper vulkan;
+IBLLib::Result IBLLib::IblSession::Impl::initialize(bool _debugOutput)
+{
+	IBLLib::Result res = Result::Success;
 
-	if (vulkan.initialize(0u, 1u, _debugOutput) != VK_SUCCESS)
+	// the compute filter binds one storage image per mip level
+	if (vulkan.initialize(0u, 4u, _debugOutput) != VK_SUCCESS)
 	{
 		return Result::VulkanInitializationFailed;
 	}
 
-	VkImage panoramaImage;
-	if ((res = uploadImage(vulkan, _inputPath, _outputPathSH, panoramaImage)) != Result::Success)
+	if ((res = loadShader(vulkan, primitiveVertexShader, IBLSAMPLER_SPIRV(primitive_main_vert), "main", fullscreenVertexShader, ShaderCompiler::Stage::Vertex)) != Result::Success)
 	{
 		return res;
 	}
 
-	VkShaderModule fullscreenVertexShader = VK_NULL_HANDLE;
-	if ((res = compileShader(vulkan, primitiveVertexShader, "main", fullscreenVertexShader, ShaderCompiler::Stage::Vertex)) != Result::Success)
+	VkShaderModule panoramaToCubeMapFragmentShader = VK_NULL_HANDLE;
+	if ((res = loadShader(vulkan, filterFragmentShader, IBLSAMPLER_SPIRV(filter_panoramaToCubeMap_frag), "panoramaToCubeMap", panoramaToCubeMapFragmentShader, ShaderCompiler::Stage::Fragment)) != Result::Success)
 	{
 		return res;
 	}
 
-	VkShaderModule filterCubeMapFragmentShader = VK_NULL_HANDLE;
-	if ((res = compileShader(vulkan, filterFragmentShader, "filterCubeMap", filterCubeMapFragmentShader, ShaderCompiler::Stage::Fragment)) != Result::Success)
+	if ((res = loadShader(vulkan, filterFragmentShader, IBLSAMPLER_SPIRV(filter_filterCubeMap_frag), "filterCubeMap", filterCubeMapFragmentShader, ShaderCompiler::Stage::Fragment)) != Result::Success)
 	{
 		return res;
 	}
 
-	VkExtent3D panoramaExtent = vulkan.getCreateInfo(panoramaImage)->extent;
-	// it is best to sample an nxn cube map from a 4nx2n equirectangular image, e.g. a 1024x512 equirectangular images becomes a 256x256 cube map.
-	_cubemapResolution = _cubemapResolution != 0 ? _cubemapResolution : panoramaExtent.height / 2;
-	_mipmapCount = _mipmapCount != 0 ? _mipmapCount : static_cast<uint32_t>(floor(log2(_cubemapResolution)));
-
-	const uint32_t cubeMapSideLength = _cubemapResolution;
-	const uint32_t outputMipLevels = _distribution == Distribution::Lambertian ? 1u : _mipmapCount;
-
-	uint32_t maxMipLevels = 0u;
-	for (uint32_t m = cubeMapSideLength; m > 0; m = m >> 1, ++maxMipLevels) {}
-
-	if ((_cubemapResolution >> (outputMipLevels - 1)) < 1)
-	{
-		printf("Error: CubemapResolution incompatible with MipmapCount\n");
-		return Result::InvalidArgument;
-	}
-	
-	VkSampler cubeMipMapSampler = VK_NULL_HANDLE;
+	// the sampler is shared by all jobs, so the lod range is not clamped to a specific cube map size
 	{
 		VkSamplerCreateInfo samplerInfo{};
 		vulkan.fillSamplerCreateInfo(samplerInfo);
-		samplerInfo.maxLod = float(maxMipLevels + 1);
+		samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
-		if (vulkan.createSampler(cubeMipMapSampler, samplerInfo) != VK_SUCCESS)
+		if (vulkan.createSampler(sampler, samplerInfo) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 	}
-	
-	VkImage inputCubeMap = VK_NULL_HANDLE;
-	VkImageLayout currentInputCubeMapLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-	//VK_IMAGE_USAGE_TRANSFER_SRC_BIT needed for transfer to staging buffer
-	if (vulkan.createImage2DAndAllocate(inputCubeMap, cubeMapSideLength, cubeMapSideLength, cubeMapFormat,
-																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-																			maxMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
-	
-	VkImageView inputCubeMapCompleteView = VK_NULL_HANDLE;
-	if (vulkan.createImageView(inputCubeMapCompleteView, inputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
+	if (vulkan.createBufferAndAllocate(shUniformBuffer, static_cast<uint32_t>(sizeof(SH9::coeffs)), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+																		 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
-	
-	VkImage outputCubeMap = VK_NULL_HANDLE;
-	if (vulkan.createImage2DAndAllocate(outputCubeMap, cubeMapSideLength, cubeMapSideLength, cubeMapFormat,
-																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-																			outputMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
+
+	// the filter sets are created with this buffer, prepareSampleTable() replaces it if a job needs more samples
+	if (vulkan.createBufferAndAllocate(sampleTableBuffer, sampleTableDefaultBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+																		 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
+	sampleTableBytes = sampleTableDefaultBytes;
+
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
 
-	std::vector< std::vector<VkImageView> > outputCubeMapViews(outputMipLevels);
-	for (uint32_t i = 0; i < outputMipLevels; ++i)
+	////////////////////////////////////////////////////////////////////////////////////////
+	// Panorama to CubeMap Pipeline
 	{
-		outputCubeMapViews[i].resize(6, VK_NULL_HANDLE); //sides of the cube
+		RenderPassDesc renderPassDesc;
 
-		for (uint32_t j = 0; j < 6; j++)
+		// add rendertargets (cubemap faces)
+		for (int face = 0; face < 6; ++face)
 		{
-			VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
-			subresourceRange.baseMipLevel = i;
-			subresourceRange.baseArrayLayer = j;
-			if (vulkan.createImageView(outputCubeMapViews[i][j], outputCubeMap, subresourceRange) != VK_SUCCESS)
-			{
-				return Result::VulkanError;
-			}
+			renderPassDesc.addAttachment(cubeMapFormat);
 		}
-	}
 
-	VkImageView outputCubeMapCompleteView = VK_NULL_HANDLE;
-	{
-		VkImageSubresourceRange subresourceRange{};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.baseArrayLayer = 0u;
-		subresourceRange.baseMipLevel = 0u;
-		subresourceRange.layerCount = 6u;
-		subresourceRange.levelCount = outputMipLevels;
+		if (vulkan.createRenderPass(panoramaRenderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		// the panorama view is bound per job, see filter()
+		DescriptorSetInfo setLayout0;
+		describePanoramaSet(setLayout0, VK_NULL_HANDLE);
 
-		if (vulkan.createImageView(outputCubeMapCompleteView, outputCubeMap, subresourceRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
+		VkDescriptorSetLayout panoramaSetLayout = VK_NULL_HANDLE;
+		if (setLayout0.create(vulkan, panoramaSetLayout, panoramaSet) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
-	}
 
-	VkImage outputLUT = VK_NULL_HANDLE;
-	if (vulkan.createImage2DAndAllocate(outputLUT, cubeMapSideLength, cubeMapSideLength, LUTFormat,
-																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT /*| VK_IMAGE_USAGE_SAMPLED_BIT*/,
-																			1u, 1u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE) != VK_SUCCESS)
-	{
-		return Result::VulkanError;
-	}
+		std::vector<VkPushConstantRange> ranges(1u);
+		VkPushConstantRange& range = ranges.front();
 
-	VkImageView outputLUTView = VK_NULL_HANDLE;
-	{
-		VkImageSubresourceRange subresourceRange{};
-		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.layerCount = 1u;
-		subresourceRange.levelCount = 1u;
+		range.offset = 0u;
+		range.size = sizeof(PushConstant);
+		range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+		if (vulkan.createPipelineLayout(panoramaPipelineLayout, panoramaSetLayout, ranges) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		GraphicsPipelineDesc panormaToCubePipeline;
 
-		if (vulkan.createImageView(outputLUTView, outputLUT, subresourceRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D) != VK_SUCCESS)
+		panormaToCubePipeline.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
+		panormaToCubePipeline.addShaderStage(panoramaToCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "panoramaToCubeMap");
+
+		panormaToCubePipeline.setRenderPass(panoramaRenderPass);
+		panormaToCubePipeline.setPipelineLayout(panoramaPipelineLayout);
+		panormaToCubePipeline.addColorBlendAttachment(colorBlendAttachment, 6u);
+		panormaToCubePipeline.setDynamicViewport();
+
+		if (vulkan.createPipeline(panoramaPipeline, panormaToCubePipeline.getInfo()) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 	}
 
-	VkRenderPass renderPass = VK_NULL_HANDLE;
+	////////////////////////////////////////////////////////////////////////////////////////
+	// Filter CubeMap Pipeline
 	{
-		RenderPassDesc renderPassDesc;
+		// the cube map view is bound when the targets are (re)created, see prepareTargets()
+		DescriptorSetInfo setLayout0;
+		describeFilterSet(setLayout0, VK_NULL_HANDLE);
 
-		// add rendertargets (cubemap faces)
-		for (int face = 0; face < 6; ++face)
+		VkDescriptorSetLayout filterSetLayout = VK_NULL_HANDLE;
+		if (setLayout0.create(vulkan, filterSetLayout, filterSet) != VK_SUCCESS)
 		{
-			renderPassDesc.addAttachment(cubeMapFormat);
+			return Result::VulkanError;
 		}
 
-		renderPassDesc.addAttachment(LUTFormat);		
+		std::vector<VkPushConstantRange> ranges(1u);
+		VkPushConstantRange& range = ranges.front();
+
+		range.offset = 0u;
+		range.size = sizeof(PushConstant);
+		range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-		if (vulkan.createRenderPass(renderPass, renderPassDesc.getInfo()) != VK_SUCCESS)
+		// the render passes and pipelines are created per render format, see getPipeline()
+		if (vulkan.createPipelineLayout(filterPipelineLayout, filterSetLayout, ranges) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 	}
 
-	//Push Constants for specular and diffuse filter passes
-	struct PushConstant
+	////////////////////////////////////////////////////////////////////////////////////////
+	// Filter CubeMap Compute Pipeline
+	// the mip level index into the storage image array is only uniform per work group
+	if (vulkan.getEnabledFeatures().shaderStorageImageArrayDynamicIndexing)
 	{
-		float roughness = 0.f;
-		uint32_t sampleCount = 1u;
-		uint32_t mipLevel = 1u;
-		uint32_t width = 1024u;
-		float lodBias = 0.f;
-		Distribution distribution = Distribution::Lambertian;
-	};
-
-	std::vector<VkPushConstantRange> ranges(1u);
-	VkPushConstantRange& range = ranges.front();
+		if ((res = loadShader(vulkan, filterFragmentShader, IBLSAMPLER_SPIRV(filter_filterCubeMapCompute_comp), "filterCubeMapCompute", filterCubeMapComputeShader, ShaderCompiler::Stage::Compute, computeFilterPreamble)) != Result::Success)
+		{
+			return res;
+		}
 
-	range.offset = 0u;
-	range.size = sizeof(PushConstant);
-	range.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+		// stores the target format directly instead of rgba32f, see prepareTargets()
+		if (vulkan.getEnabledFeatures().shaderStorageImageWriteWithoutFormat)
+		{
+			if ((res = loadShader(vulkan, filterFragmentShader, IBLSAMPLER_SPIRV(filter_filterCubeMapComputeWithoutFormat_comp), "filterCubeMapComputeWithoutFormat", filterCubeMapComputeWithoutFormatShader, ShaderCompiler::Stage::Compute, computeFilterWithoutFormatPreamble)) != Result::Success)
+			{
+				return res;
+			}
+		}
 
-	////////////////////////////////////////////////////////////////////////////////////////
-	// Filter CubeMap Pipeline
-	VkDescriptorSet filterDescriptorSet = VK_NULL_HANDLE;
-	VkPipelineLayout filterPipelineLayout = VK_NULL_HANDLE;
-	VkPipeline filterPipeline = VK_NULL_HANDLE;
-	{
+		// the views are bound when the targets are (re)created, see prepareTargets()
 		DescriptorSetInfo setLayout0;
-		uint32_t binding = 1u;
-		setLayout0.addCombinedImageSampler(cubeMipMapSampler, inputCubeMapCompleteView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, binding, VK_SHADER_STAGE_FRAGMENT_BIT); // change sampler ?
+		describeComputeFilterSet(setLayout0, VK_NULL_HANDLE, std::vector<VkImageView>(filterMaxMipLevels, VK_NULL_HANDLE));
 
-		VkBuffer uniformBuffer = nullptr;
-		VkDeviceSize bufferSize = sizeof(float) * 9 * 4; // 9 coefficients
-		vulkan.createBufferAndAllocate(
-			uniformBuffer,
-			static_cast<uint32_t>(bufferSize),
-			VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			VK_SHARING_MODE_EXCLUSIVE, 0);
+		VkDescriptorSetLayout computeFilterSetLayout = VK_NULL_HANDLE;
+		if (setLayout0.create(vulkan, computeFilterSetLayout, computeFilterSet) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
 
-		vulkan.writeBufferData(uniformBuffer, SH9::coeffs, bufferSize);
+		std::vector<VkPushConstantRange> ranges(1u);
+		VkPushConstantRange& range = ranges.front();
 
-		binding = 2u;
-		setLayout0.addUniform(uniformBuffer, 0, bufferSize, binding, VK_SHADER_STAGE_FRAGMENT_BIT);
+		range.offset = 0u;
+		range.size = sizeof(PushConstant);
+		range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
-		VkDescriptorSetLayout filterSetLayout = VK_NULL_HANDLE;
-		if (setLayout0.create(vulkan, filterSetLayout, filterDescriptorSet) != VK_SUCCESS)
+		if (vulkan.createPipelineLayout(computeFilterPipelineLayout, computeFilterSetLayout, ranges) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+	else
+	{
+		printf("shaderStorageImageArrayDynamicIndexing not supported, using the fragment filter\n");
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////
+	// BRDF LUT Compute Pipeline
+	{
+		if ((res = loadShader(vulkan, filterFragmentShader, IBLSAMPLER_SPIRV(filter_generateLUT_comp), "generateLUT", generateLUTShader, ShaderCompiler::Stage::Compute, lutPreamble)) != Result::Success)
+		{
+			return res;
+		}
+
+		// the view is bound when the LUT is (re)created, see prepareLUT()
+		DescriptorSetInfo setLayout0;
+		describeLUTSet(setLayout0, VK_NULL_HANDLE);
+
+		VkDescriptorSetLayout lutSetLayout = VK_NULL_HANDLE;
+		if (setLayout0.create(vulkan, lutSetLayout, lutSet) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 
-		vulkan.updateDescriptorSets(setLayout0.getWrites());
+		std::vector<VkPushConstantRange> ranges(1u);
+		VkPushConstantRange& range = ranges.front();
 
-		if (vulkan.createPipelineLayout(filterPipelineLayout, filterSetLayout, ranges) != VK_SUCCESS)
+		range.offset = 0u;
+		range.size = sizeof(PushConstant);
+		range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+		if (vulkan.createPipelineLayout(lutPipelineLayout, lutSetLayout, ranges) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
+	}
+
+	initialized = true;
+
+	return Result::Success;
+}
+
+void IBLLib::IblSession::Impl::destroyOutputTargets()
+{
+	waitForTargets();
+
+	// views are destroyed with their images
+	for (VkFramebuffer framebuffer : targets.filterFramebuffers)
+	{
+		vulkan.destroyFramebuffer(framebuffer);
+	}
+	targets.filterFramebuffers.clear();
+
+	vulkan.destroyImage(targets.outputCubeMap);
+	vulkan.destroyImage(targets.convertedCubeMap);
+
+	targets.outputCubeMap = VK_NULL_HANDLE;
+	targets.convertedCubeMap = VK_NULL_HANDLE;
+	targets.filterRenderPass = VK_NULL_HANDLE;
+	targets.renderFormat = VK_FORMAT_UNDEFINED;
+	targets.sideLength = 0u;
+	targets.outputMipLevels = 0u;
+	targets.targetFormat = VK_FORMAT_UNDEFINED;
+	targets.compute = false;
+}
+
+void IBLLib::IblSession::Impl::destroyTargets()
+{
+	destroyOutputTargets();
+
+	vulkan.destroyFramebuffer(targets.inputCubeMapFramebuffer);
+	vulkan.destroyImage(targets.inputCubeMap);
+	vulkan.destroyImage(targets.lut);
 
-		GraphicsPipelineDesc filterCubeMapPipelineDesc;
+	targets = Targets{};
+}
+
+void IBLLib::IblSession::Impl::waitForTargets()
+{
+	// a failed wait means the device is lost, the targets are released anyway
+	vulkan.waitForSubmission(lastGraphics);
+	vulkan.waitForSubmission(cubeMapReadback);
+	vulkan.waitForSubmission(lutReadback);
+}
 
-		filterCubeMapPipelineDesc.addShaderStage(fullscreenVertexShader, VK_SHADER_STAGE_VERTEX_BIT, "main");
-		filterCubeMapPipelineDesc.addShaderStage(filterCubeMapFragmentShader, VK_SHADER_STAGE_FRAGMENT_BIT, "filterCubeMap");
+void IBLLib::IblSession::Impl::retire(const Submission& _submission, VkCommandBuffer _commandBuffer, QueueType _queue)
+{
+	Retired resource;
+	resource.submission = _submission;
+	resource.queue = _queue;
+	resource.commandBuffer = _commandBuffer;
+	retired.push_back(resource);
+}
 
-		filterCubeMapPipelineDesc.setRenderPass(renderPass);
-		filterCubeMapPipelineDesc.setPipelineLayout(filterPipelineLayout);
+void IBLLib::IblSession::Impl::retirePanorama(Panorama& _panorama)
+{
+	// the upload resources only exist together with the image
+	if (_panorama.image == VK_NULL_HANDLE)
+	{
+		return;
+	}
 
-		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT; // TODO: rgb only
-		colorBlendAttachment.blendEnable = VK_FALSE;
+	// the cube map pass waited for the upload, without it the upload is the last use
+	Retired resource;
+	resource.submission = _panorama.sampled.value != 0u ? _panorama.sampled : _panorama.uploaded;
+	resource.buffer = _panorama.stagingBuffer;
+	resource.image = _panorama.image;
+	retired.push_back(resource);
 
-		filterCubeMapPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 6u);
+	for (VkCommandBuffer uploadCmd : _panorama.uploadCommands)
+	{
+		retire(resource.submission, uploadCmd, QueueType::Transfer);
+	}
 
-		//colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT;
-		filterCubeMapPipelineDesc.addColorBlendAttachment(colorBlendAttachment, 1u);
+	_panorama.image = VK_NULL_HANDLE;
+	_panorama.stagingBuffer = VK_NULL_HANDLE;
+	_panorama.uploadCommands.clear();
+}
 
-		filterCubeMapPipelineDesc.setViewportExtent(VkExtent2D{ cubeMapSideLength, cubeMapSideLength });
+void IBLLib::IblSession::Impl::releaseRetired(bool _wait)
+{
+	size_t kept = 0u;
+	for (size_t i = 0u; i < retired.size(); ++i)
+	{
+		const Retired& resource = retired[i];
 
-		if (vulkan.createPipeline(filterPipeline, filterCubeMapPipelineDesc.getInfo()) != VK_SUCCESS)
+		const bool complete = _wait ? vulkan.waitForSubmission(resource.submission) == VK_SUCCESS : vulkan.isSubmissionComplete(resource.submission);
+		if (complete == false)
 		{
-			return Result::VulkanError;
+			retired[kept++] = resource;
+			continue;
 		}
+
+		vulkan.destroyCommandBuffer(resource.commandBuffer, resource.queue);
+		vulkan.destroyBuffer(resource.buffer);
+		vulkan.destroyImage(resource.image);
 	}
 
-	const std::vector<VkClearValue> clearValues(6u, { 0.0f, 0.0f, 1.0f, 1.0f });
+	retired.resize(kept);
+}
 
-	VkCommandBuffer cubeMapCmd;
-	if (vulkan.createCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+IBLLib::Result IBLLib::IblSession::Impl::prepareInputCubeMap(uint32_t _sideLength)
+{
+	if (targets.inputSideLength == _sideLength)
+	{
+		return Result::Success;
+	}
+
+	// the filter descriptor sets of the outputs reference the input cube map
+	destroyTargets();
+
+	uint32_t maxMipLevels = 0u;
+	for (uint32_t m = _sideLength; m > 0; m = m >> 1, ++maxMipLevels) {}
+
+	targets.inputMipLevels = maxMipLevels;
+
+	//VK_IMAGE_USAGE_TRANSFER_SRC_BIT needed for transfer to staging buffer
+	if (vulkan.createImage2DAndAllocate(targets.inputCubeMap, _sideLength, _sideLength, cubeMapFormat,
+																			VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+																			maxMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	if (vulkan.beginCommandBuffer(cubeMapCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	if (vulkan.createImageView(targets.inputCubeMapCompleteView, targets.inputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_CUBE) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	////////////////////////////////////////////////////////////////////////////////////////
-	// Transform panorama image to cube map
+	{
+		std::vector<VkImageView> inputCubeMapViews(6u, VK_NULL_HANDLE);
+		for (size_t i = 0; i < inputCubeMapViews.size(); i++)
+		{
+			if (vulkan.createImageView(inputCubeMapViews[i], targets.inputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, static_cast<uint32_t>(i), 1u }) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+		}
+
+		if (vulkan.createFramebuffer(targets.inputCubeMapFramebuffer, panoramaRenderPass, _sideLength, _sideLength, inputCubeMapViews, 1u) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+	}
+
+	targets.inputSideLength = _sideLength;
 
-	printf("Transform panorama image to cube map\n");
+	return Result::Success;
+}
 
-	res = panoramaToCubemap(vulkan, cubeMapCmd, fullscreenVertexShader, panoramaImage, inputCubeMap);
-	if (res != VK_SUCCESS)
+IBLLib::Result IBLLib::IblSession::Impl::prepareTargets(uint32_t _sideLength, uint32_t _outputMipLevels, VkFormat _targetFormat, bool _compute)
+{
+	if (targets.sideLength == _sideLength && targets.outputMipLevels == _outputMipLevels && targets.targetFormat == _targetFormat && targets.compute == _compute)
 	{
-		printf("Failed to transform panorama image to cube map\n");
-		return res;
+		return Result::Success;
 	}
 
-	currentInputCubeMapLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	if (targets.inputCubeMap == VK_NULL_HANDLE)
+	{
+		return Result::InvalidArgument;
+	}
 
-	////////////////////////////////////////////////////////////////////////////////////////
-	//Generate MipLevels
-	printf("Generating mipmap levels\n");
-	generateMipmapLevels(vulkan, cubeMapCmd, inputCubeMap, maxMipLevels, cubeMapSideLength, currentInputCubeMapLayout);
-	currentInputCubeMapLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	destroyOutputTargets();
 
-	// Filter
+	// Write the target format directly if the device can render or store it, this saves the float image and the blit
+	// of convertVkFormat. The compute filter needs the shader without format qualifier for anything but rgba32f.
+	const VkFormatFeatureFlags targetFeatures = vulkan.getOptimalTilingFeatures(_targetFormat);
+	const bool direct = _compute ?
+		(targetFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) != 0u && (_targetFormat == cubeMapFormat || filterCubeMapComputeWithoutFormatShader != VK_NULL_HANDLE) :
+		(targetFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT) != 0u;
+	const VkFormat renderFormat = direct ? _targetFormat : cubeMapFormat;
+
+	const VkImageUsageFlags filterUsage = _compute ? VK_IMAGE_USAGE_STORAGE_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-	switch (_distribution)
+	if (vulkan.createImage2DAndAllocate(targets.outputCubeMap, _sideLength, _sideLength, renderFormat,
+																			filterUsage | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+																			_outputMipLevels, 6u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT) != VK_SUCCESS)
 	{
-		case IBLLib::Distribution::Lambertian:
-			printf("Filtering lambertian\n");
-			break;
-		case IBLLib::Distribution::GGX:
-			printf("Filtering GGX\n");
-			break;
-		case IBLLib::Distribution::Charlie:
-			printf("Filtering Charlie\n");
-			break;
-		default:
-			break;
+		return Result::VulkanError;
 	}
 
-	vulkan.bindDescriptorSet(cubeMapCmd, filterPipelineLayout, filterDescriptorSet);
+	if (_compute)
+	{
+		// one view with all 6 faces per mip level, the remaining array elements alias the last level
+		std::vector<VkImageView> outputMipViews(filterMaxMipLevels, VK_NULL_HANDLE);
+		for (uint32_t i = 0; i < _outputMipLevels; ++i)
+		{
+			if (vulkan.createImageView(outputMipViews[i], targets.outputCubeMap, { VK_IMAGE_ASPECT_COLOR_BIT, i, 1u, 0u, 6u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D_ARRAY) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+		}
+		std::fill(outputMipViews.begin() + _outputMipLevels, outputMipViews.end(), outputMipViews[_outputMipLevels - 1u]);
+
+		DescriptorSetInfo setLayout0;
+		describeComputeFilterSet(setLayout0, targets.inputCubeMapCompleteView, outputMipViews);
 
-	vkCmdBindPipeline(cubeMapCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, filterPipeline);
+		if (setLayout0.fillWrites(computeFilterSet) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
 
-	// Filter every mip level: from inputCubeMap->currentMipLevel
-	// The mip levels are filtered from the smallest mipmap to the largest mipmap,
-	// i.e. the last mipmap is filtered last.
-	// This has the desirable side effect that the framebuffer size of the last filter pass
-	// matches with the LUT size, allowing the LUT to only be written in the last pass
-	// without worrying to preserve the LUT's image contents between the previous render passes.
-	for (uint32_t currentMipLevel = outputMipLevels - 1; currentMipLevel != -1; currentMipLevel--)
+		vulkan.updateDescriptorSets(setLayout0.getWrites());
+	}
+	else
 	{
-		unsigned int currentFramebufferSideLength = cubeMapSideLength >> currentMipLevel;
-		std::vector<VkImageView> renderTargetViews(outputCubeMapViews[currentMipLevel]);
+		IBLLib::Result res = Result::Success;
+		if ((res = getFilterRenderPass(renderFormat, targets.filterRenderPass)) != Result::Success)
+		{
+			return res;
+		}
+
+		targets.filterFramebuffers.resize(_outputMipLevels, VK_NULL_HANDLE);
+		for (uint32_t i = 0; i < _outputMipLevels; ++i)
+		{
+			std::vector<VkImageView> renderTargetViews(6u, VK_NULL_HANDLE); //sides of the cube
+
+			for (uint32_t j = 0; j < 6; j++)
+			{
+				VkImageSubresourceRange subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
+				subresourceRange.baseMipLevel = i;
+				subresourceRange.baseArrayLayer = j;
+				if (vulkan.createImageView(renderTargetViews[j], targets.outputCubeMap, subresourceRange) != VK_SUCCESS)
+				{
+					return Result::VulkanError;
+				}
+			}
+
+			const uint32_t currentFramebufferSideLength = _sideLength >> i;
+			if (vulkan.createFramebuffer(targets.filterFramebuffers[i], targets.filterRenderPass, currentFramebufferSideLength, currentFramebufferSideLength, renderTargetViews, 1u) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+		}
 
-		renderTargetViews.emplace_back(outputLUTView);
+		DescriptorSetInfo setLayout0;
+		describeFilterSet(setLayout0, targets.inputCubeMapCompleteView);
 
-		//Framebuffer will be destroyed automatically at shutdown
-		VkFramebuffer filterOutputFramebuffer = VK_NULL_HANDLE;
-		if (vulkan.createFramebuffer(filterOutputFramebuffer, renderPass, currentFramebufferSideLength, currentFramebufferSideLength, renderTargetViews, 1u) != VK_SUCCESS)
+		if (setLayout0.fillWrites(filterSet) != VK_SUCCESS)
 		{
 			return Result::VulkanError;
 		}
 
-		VkImageSubresourceRange  subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, currentMipLevel, 1u, 0u, 6u };
-
-		vulkan.imageBarrier(cubeMapCmd, outputCubeMap,
-												VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-												VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,//src stage, access
-												VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // dst stage, access
-												subresourceRange);
+		vulkan.updateDescriptorSets(setLayout0.getWrites());
+	}
 
-		PushConstant values{};
-		values.roughness = static_cast<float>(currentMipLevel) / static_cast<float>(outputMipLevels - 1);
-		values.sampleCount = _sampleCount;
-		values.mipLevel = currentMipLevel;
-		values.width = cubeMapSideLength;
-		values.lodBias = _lodBias;
-		values.distribution = _distribution;
+	// only set the keys once everything has been created, a failed job must not leave half initialized targets behind
+	targets.sideLength = _sideLength;
+	targets.outputMipLevels = _outputMipLevels;
+	targets.targetFormat = _targetFormat;
+	targets.compute = _compute;
+	targets.renderFormat = renderFormat;
 
-		vkCmdPushConstants(cubeMapCmd, filterPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant), &values);
+	return Result::Success;
+}
 
-		vulkan.beginRenderPass(cubeMapCmd, renderPass, filterOutputFramebuffer, VkRect2D{ 0u, 0u, currentFramebufferSideLength, currentFramebufferSideLength }, clearValues);
-		vkCmdDraw(cubeMapCmd, 3, 1u, 0, 0);
-		vulkan.endRenderPass(cubeMapCmd);
+IBLLib::Result IBLLib::IblSession::Impl::prepareSampleTable(const IblJob& _job, uint32_t _sideLength, uint32_t _outputMipLevels)
+{
+	// the lambertian filter evaluates the SH and reads no samples
+	if (_job.distribution == Distribution::Lambertian)
+	{
+		return Result::Success;
 	}
 
-	////////////////////////////////////////////////////////////////////////////////////////
-	//Output
+	if (_outputMipLevels > filterMaxMipLevels)
+	{
+		printf("At most %u mip levels can be filtered\n", filterMaxMipLevels);
+		return Result::InvalidArgument;
+	}
 
-	VkFormat targetFormat = static_cast<VkFormat>(_targetFormat);
-	VkImageLayout currentCubeMapImageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-	VkImage convertedCubeMap = VK_NULL_HANDLE;
+	// header with the sample range of every level, then xyz: L in the tangent frame, w: lod
+	std::vector<uint32_t> levelSamples(filterMaxMipLevels * 2u, 0u);
+	std::vector<float> samples;
 
-	if(targetFormat != cubeMapFormat)
+	for (uint32_t level = 0u; level < _outputMipLevels; ++level)
 	{
-		if ((res = convertVkFormat(vulkan, cubeMapCmd, outputCubeMap, convertedCubeMap, targetFormat, currentCubeMapImageLayout)) != Success)
+		const float roughness = _outputMipLevels > 1u ? static_cast<float>(level) / static_cast<float>(_outputMipLevels - 1u) : 0.0f;
+
+		ImportanceSamples levelTable;
+		getImportanceSamples(_job.distribution, roughness, _job.sampleCount, targets.inputSideLength, _sideLength, _job.lodBias, levelTable);
+
+		levelSamples[level * 2u] = static_cast<uint32_t>(samples.size() / 4u);
+		levelSamples[level * 2u + 1u] = levelTable.count;
+
+		for (uint32_t i = 0u; i < levelTable.count; ++i)
 		{
-			printf("Failed to convert Image \n");
-			return res;
+			const float sample[4] = { levelTable.x[i], levelTable.y[i], levelTable.z[i], levelTable.lod[i] };
+			samples.insert(samples.end(), sample, sample + 4);
 		}
-		currentCubeMapImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
 	}
-	else
+
+	std::vector<uint8_t> table(sampleTableHeaderBytes + samples.size() * sizeof(float));
+	memcpy(table.data(), levelSamples.data(), sampleTableHeaderBytes);
+	memcpy(table.data() + sampleTableHeaderBytes, samples.data(), samples.size() * sizeof(float));
+
+	// the previous filter completed, see renderInputCubeMap(), so the buffer can be replaced and rewritten
+	if (table.size() > sampleTableBytes)
 	{
-		convertedCubeMap = outputCubeMap;
+		vulkan.destroyBuffer(sampleTableBuffer);
+		sampleTableBuffer = VK_NULL_HANDLE;
+		sampleTableBytes = 0u;
+
+		if (vulkan.createBufferAndAllocate(sampleTableBuffer, table.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+																			 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+		sampleTableBytes = table.size();
+
+		// only the table binding of the filter sets changes
+		for (VkDescriptorSet set : { filterSet, computeFilterSet })
+		{
+			if (set == VK_NULL_HANDLE)
+			{
+				continue;
+			}
+
+			DescriptorSetInfo tableBinding;
+			tableBinding.addStorageBuffer(sampleTableBuffer, 0u, VK_WHOLE_SIZE, 5u);
+
+			if (tableBinding.fillWrites(set) != VK_SUCCESS)
+			{
+				return Result::VulkanError;
+			}
+
+			vulkan.updateDescriptorSets(tableBinding.getWrites());
+		}
 	}
 
-	if (vulkan.endCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	if (vulkan.writeBufferData(sampleTableBuffer, table.data(), table.size()) != VK_SUCCESS)
 	{
 		return Result::VulkanError;
 	}
 
-	if (vulkan.executeCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::prepareLUT(uint32_t _resolution)
+{
+	if (targets.lutResolution == _resolution)
 	{
-		return Result::VulkanError;
+		return Result::Success;
 	}
 
-	if (downloadCubemap(vulkan, convertedCubeMap, _outputPathCubeMap, currentCubeMapImageLayout) != VK_SUCCESS)
+	waitForTargets();
+
+	vulkan.destroyImage(targets.lut);
+	targets.lut = VK_NULL_HANDLE;
+	targets.lutResolution = 0u;
+
+	if (vulkan.createImage2DAndAllocate(targets.lut, _resolution, _resolution, LUTFormat,
+																			VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+																			1u, 1u, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_SHARING_MODE_EXCLUSIVE) != VK_SUCCESS)
 	{
-		printf("Failed to download Image \n");
 		return Result::VulkanError;
 	}
 
-	if (_outputPathLUT != nullptr)
+	// view is destroyed together with the LUT
+	VkImageView lutView = VK_NULL_HANDLE;
+	if (vulkan.createImageView(lutView, targets.lut, { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u }, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D) != VK_SUCCESS)
 	{
-		if (download2DImage(vulkan, outputLUT, _outputPathLUT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) != VK_SUCCESS)
-		{
-			printf("Failed to download Image \n");
-			return Result::VulkanError;
-		}
+		return Result::VulkanError;
 	}
 
-	return Result::Success;
+	DescriptorSetInfo setLayout0;
+	describeLUTSet(setLayout0, lutView);
+
+	if (setLayout0.fillWrites(lutSet) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	vulkan.updateDescriptorSets(setLayout0.getWrites());
+
+	targets.lutResolution = _resolution;
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::validateJob(const IblJob& _job) const
+{
+	if (initialized == false)
+	{
+		printf("IblSession is not initialized\n");
+		return Result::InvalidArgument;
+	}
+
+	if (_job.inputPath == nullptr || (_job.outputPathCubeMap == nullptr && _job.outputPathLUT == nullptr && _job.outputPathSH == nullptr))
+	{
+		return Result::InvalidArgument;
+	}
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::run(const IblJob& _job)
+{
+	IBLLib::Result res = Result::Success;
+
+	if ((res = validateJob(_job)) != Result::Success)
+	{
+		return res;
+	}
+
+	releaseRetired(false);
+
+	// the lambertian filter evaluates the SH coefficients analytically and never samples the environment on the gpu
+	Panorama panorama;
+	res = loadPanorama(_job.inputPath, _job.outputPathSH, _job.outputPathCubeMap != nullptr && _job.distribution != Distribution::Lambertian, panorama);
+
+	if (res == Result::Success)
+	{
+		res = filter(_job, panorama);
+	}
+
+	// the panorama is the only per job resource, everything else is kept for the next job
+	retirePanorama(panorama);
+
+	if (res != Result::Success)
+	{
+		destroyTargets();
+	}
+
+	return res;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::loadPanorama(const char* _inputPath, const char* _outputPathSH, bool _upload, Panorama& _outPanorama)
+{
+	// the rows are decoded straight into the staging buffer band by band
+	PanoramaSink upload;
+	if (_upload)
+	{
+		upload = [&](const DecodedPanorama& _layout, const FillRows& _fillRows)
+		{
+			return uploadImage(vulkan, _layout.width, _layout.height, _layout.format, _layout.bytesPerPixel, _fillRows, _outPanorama);
+		};
+	}
+
+	DecodedPanorama decoded;
+	IBLLib::Result res = decodePanorama(_inputPath, _outputPathSH, upload, decoded);
+
+	if (res == Result::Success)
+	{
+		_outPanorama.width = decoded.width;
+		_outPanorama.height = decoded.height;
+		_outPanorama.encoding = decoded.encoding;
+		memcpy(_outPanorama.shCoeffs, decoded.shCoeffs, sizeof(decoded.shCoeffs));
+	}
+
+	return res;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::runBundle(const IblBundle& _bundle)
+{
+	if (initialized == false)
+	{
+		printf("IblSession is not initialized\n");
+		return Result::InvalidArgument;
+	}
+
+	const int cubeMapCount = static_cast<int>(_bundle.cubeMaps.size());
+	if (_bundle.inputPath == nullptr || cubeMapCount == 0 ||
+		(_bundle.outputPathGltf != nullptr && (_bundle.gltfSpecularCubeMap < 0 || _bundle.gltfSpecularCubeMap >= cubeMapCount || _bundle.gltfSkyboxCubeMap >= cubeMapCount)))
+	{
+		return Result::InvalidArgument;
+	}
+
+	bool uploadPanorama = false;
+	for (const IblBundleOutput& output : _bundle.cubeMaps)
+	{
+		if (output.outputPath == nullptr)
+		{
+			return Result::InvalidArgument;
+		}
+		uploadPanorama |= output.distribution != Distribution::Lambertian;
+	}
+
+	IBLLib::Result res = Result::Success;
+
+	releaseRetired(false);
+
+	Panorama panorama;
+	res = loadPanorama(_bundle.inputPath, _bundle.outputPathSH, uploadPanorama, panorama);
+
+	// the shared input cube map has the resolution of the largest output, smaller outputs read its finer levels
+	std::vector<uint32_t> sideLengths(_bundle.cubeMaps.size(), 0u);
+	std::vector<uint32_t> mipLevels(_bundle.cubeMaps.size(), 0u);
+	uint32_t inputSideLength = 0u;
+	for (size_t i = 0u; i < _bundle.cubeMaps.size() && res == Result::Success; ++i)
+	{
+		const IblBundleOutput& output = _bundle.cubeMaps[i];
+		res = getCubeMapExtent(output.distribution, output.cubemapResolution, output.mipmapCount, panorama.height, sideLengths[i], mipLevels[i]);
+		inputSideLength = std::max(inputSideLength, sideLengths[i]);
+	}
+
+	VkCommandBuffer inputCmd = VK_NULL_HANDLE;
+	Submission inputSubmission{};
+	if (res == Result::Success)
+	{
+		res = renderInputCubeMap(panorama, inputSideLength, inputCmd, inputSubmission);
+	}
+
+	for (size_t i = 0u; i < _bundle.cubeMaps.size() && res == Result::Success; ++i)
+	{
+		const IblBundleOutput& output = _bundle.cubeMaps[i];
+
+		IblJob job;
+		job.inputPath = _bundle.inputPath;
+		job.outputPathCubeMap = output.outputPath;
+		job.distribution = output.distribution;
+		job.sampleCount = _bundle.sampleCount;
+		job.targetFormat = output.targetFormat;
+		job.lodBias = _bundle.lodBias;
+		job.computeFilter = _bundle.computeFilter;
+
+		res = filterCubeMap(job, sideLengths[i], mipLevels[i], static_cast<VkFormat>(output.targetFormat), inputSubmission, nullptr);
+	}
+
+	if (inputCmd != VK_NULL_HANDLE)
+	{
+		retire(inputSubmission, inputCmd);
+	}
+
+	retirePanorama(panorama);
+
+	if (res == Result::Success && _bundle.outputPathLUT != nullptr)
+	{
+		const uint32_t lutResolution = _bundle.lutResolution != 0u ? _bundle.lutResolution : inputSideLength;
+		const uint32_t lutSampleCount = _bundle.lutSampleCount != 0u ? _bundle.lutSampleCount : _bundle.sampleCount;
+		res = generateLUT(_bundle.lutDistribution, lutResolution, lutSampleCount, _bundle.outputPathLUT, _bundle.lutCacheDirectory, nullptr);
+	}
+
+	if (res == Result::Success && _bundle.outputPathGltf != nullptr)
+	{
+		const char* skyboxPath = _bundle.gltfSkyboxCubeMap >= 0 ? _bundle.cubeMaps[_bundle.gltfSkyboxCubeMap].outputPath : nullptr;
+		res = writeEnvironmentGltf(_bundle.outputPathGltf, _bundle.cubeMaps[_bundle.gltfSpecularCubeMap].outputPath, skyboxPath, panorama.shCoeffs);
+	}
+
+	if (res != Result::Success)
+	{
+		destroyTargets();
+	}
+
+	return res;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::runBatch(const std::vector<IblJob>& _jobs, const BatchOptions& _options, std::vector<Result>* _outResults)
+{
+	if (initialized == false)
+	{
+		printf("IblSession is not initialized\n");
+		return Result::InvalidArgument;
+	}
+
+	// three stage pipeline: a decode thread, the gpu on the calling thread (vkHelper is not thread safe) and an encode thread.
+	// a job is in flight from the start of its decode until its files are written.
+	struct Decoded
+	{
+		size_t index = 0u;
+		Result res = Result::Success;
+		DecodedPanorama panorama;
+	};
+
+	struct Encoded
+	{
+		size_t index = 0u;
+		std::vector<DeferredWrite> writes;
+		size_t bytes = 0u;
+	};
+
+	const size_t maxJobsInFlight = std::max(_options.maxJobsInFlight, 1u);
+
+	std::vector<Result> results(_jobs.size(), Result::Success);
+
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<std::unique_ptr<Decoded>> decodedJobs;
+	std::deque<Encoded> encodedJobs;
+	size_t inFlight = 0u;
+	size_t heldBytes = 0u;
+	bool filteringDone = false;
+
+	std::thread decoder([&]()
+	{
+		for (size_t i = 0u; i < _jobs.size(); ++i)
+		{
+			{
+				// a single job is always admitted so a panorama larger than the budget cannot stall the batch
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&]() { return inFlight == 0u || (inFlight < maxJobsInFlight && heldBytes < _options.memoryBudget); });
+				++inFlight;
+			}
+
+			std::unique_ptr<Decoded> decoded = std::make_unique<Decoded>();
+			decoded->index = i;
+			const IblJob& job = _jobs[i];
+			if ((decoded->res = validateJob(job)) == Result::Success)
+			{
+				// only jobs sampling the panorama on the gpu keep its pixels
+				const bool keepPixels = job.outputPathCubeMap != nullptr && job.distribution != Distribution::Lambertian;
+				decoded->res = decodePanorama(job.inputPath, job.outputPathSH, keepPixels ? storePixels(decoded->panorama) : PanoramaSink(), decoded->panorama);
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				heldBytes += decoded->panorama.pixels.size();
+				decodedJobs.push_back(std::move(decoded));
+			}
+			changed.notify_all();
+		}
+	});
+
+	std::thread encoder([&]()
+	{
+		for (;;)
+		{
+			Encoded encoded;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				changed.wait(lock, [&]() { return encodedJobs.empty() == false || filteringDone; });
+				if (encodedJobs.empty())
+				{
+					break;
+				}
+				encoded = std::move(encodedJobs.front());
+				encodedJobs.pop_front();
+			}
+
+			Result res = Result::Success;
+			for (DeferredWrite& write : encoded.writes)
+			{
+				const Result written = write.write();
+				if (res == Result::Success)
+				{
+					res = written;
+				}
+			}
+			encoded.writes.clear();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (results[encoded.index] == Result::Success)
+				{
+					results[encoded.index] = res;
+				}
+				--inFlight;
+				heldBytes -= encoded.bytes;
+			}
+			changed.notify_all();
+		}
+	});
+
+	// filtered jobs whose readbacks still run on the transfer queue, in filter order
+	std::deque<Encoded> readbackJobs;
+
+	// hands the jobs whose readbacks completed to the encode thread, waits for all of them if _wait is set
+	const auto finishReadbacks = [&](bool _wait)
+	{
+		while (readbackJobs.empty() == false)
+		{
+			Encoded& encoded = readbackJobs.front();
+
+			bool complete = true;
+			for (const DeferredWrite& write : encoded.writes)
+			{
+				complete = complete && vulkan.isSubmissionComplete(write.readback.submission);
+			}
+
+			if (complete == false && _wait == false)
+			{
+				break;
+			}
+
+			Result res = Result::Success;
+			for (DeferredWrite& write : encoded.writes)
+			{
+				const Result finished = finishReadback(vulkan, write.readback);
+				if (res == Result::Success)
+				{
+					res = finished;
+				}
+			}
+
+			// files of a failed job are not written
+			if (res != Result::Success)
+			{
+				encoded.writes.clear();
+			}
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (res != Result::Success)
+				{
+					results[encoded.index] = res;
+				}
+				encodedJobs.push_back(std::move(encoded));
+			}
+			readbackJobs.pop_front();
+			changed.notify_all();
+		}
+	};
+
+	for (size_t filtered = 0u; filtered < _jobs.size(); ++filtered)
+	{
+		// the gpu thread may not wait for the decoder while it holds readbacks, the decoder may be waiting for the encoder
+		bool idle = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			idle = decodedJobs.empty();
+		}
+		finishReadbacks(idle);
+
+		std::unique_ptr<Decoded> decoded;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			changed.wait(lock, [&]() { return decodedJobs.empty() == false; });
+			decoded = std::move(decodedJobs.front());
+			decodedJobs.pop_front();
+		}
+
+		const IblJob& job = _jobs[decoded->index];
+		printf("Batch job %zu/%zu: %s\n", decoded->index + 1u, _jobs.size(), job.inputPath != nullptr ? job.inputPath : "");
+
+		Encoded encoded;
+		encoded.index = decoded->index;
+
+		Result res = decoded->res;
+		if (res == Result::Success)
+		{
+			res = runDecoded(job, decoded->panorama, encoded.writes);
+		}
+
+		// files of a failed job are not written, its readbacks are only released
+		if (res != Result::Success)
+		{
+			for (DeferredWrite& write : encoded.writes)
+			{
+				finishReadback(vulkan, write.readback);
+			}
+			encoded.writes.clear();
+		}
+
+		for (const DeferredWrite& write : encoded.writes)
+		{
+			encoded.bytes += write.bytes;
+		}
+
+		// the decoded pixels are released here, the job now holds its readback until it is encoded
+		const size_t decodedBytes = decoded->panorama.pixels.size();
+		decoded.reset();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			results[encoded.index] = res;
+			heldBytes = heldBytes - decodedBytes + encoded.bytes;
+		}
+		changed.notify_all();
+
+		// the previous job's readbacks usually completed while this one was uploaded and filtered
+		readbackJobs.push_back(std::move(encoded));
+		finishReadbacks(false);
+	}
+
+	finishReadbacks(true);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		filteringDone = true;
+	}
+	changed.notify_all();
+
+	decoder.join();
+	encoder.join();
+
+	Result res = Result::Success;
+	for (size_t i = 0u; i < results.size(); ++i)
+	{
+		if (results[i] != Result::Success)
+		{
+			printf("Batch job %zu failed: %s\n", i + 1u, _jobs[i].inputPath != nullptr ? _jobs[i].inputPath : "");
+			if (res == Result::Success)
+			{
+				res = results[i];
+			}
+		}
+	}
+
+	if (_outResults != nullptr)
+	{
+		*_outResults = std::move(results);
+	}
+
+	return res;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::runDecoded(const IblJob& _job, const DecodedPanorama& _decoded, std::vector<DeferredWrite>& _deferredWrites)
+{
+	IBLLib::Result res = Result::Success;
+
+	releaseRetired(false);
+
+	Panorama panorama;
+	panorama.width = _decoded.width;
+	panorama.height = _decoded.height;
+	panorama.encoding = _decoded.encoding;
+	memcpy(panorama.shCoeffs, _decoded.shCoeffs, sizeof(_decoded.shCoeffs));
+
+	if (_decoded.pixels.empty() == false)
+	{
+		const size_t rowBytes = static_cast<size_t>(_decoded.width) * _decoded.bytesPerPixel;
+		res = uploadImage(vulkan, _decoded.width, _decoded.height, _decoded.format, _decoded.bytesPerPixel, [&](void* _staging, uint32_t _rowBegin, uint32_t _rowEnd)
+		{
+			memcpy(_staging, _decoded.pixels.data() + _rowBegin * rowBytes, (_rowEnd - _rowBegin) * rowBytes);
+			return Result::Success;
+		}, panorama);
+	}
+
+	if (res == Result::Success)
+	{
+		res = filter(_job, panorama, &_deferredWrites);
+	}
+
+	retirePanorama(panorama);
+
+	if (res != Result::Success)
+	{
+		destroyTargets();
+	}
+
+	return res;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::filter(const IblJob& _job, Panorama& _panorama, std::vector<DeferredWrite>* _deferredWrites)
+{
+	IBLLib::Result res = Result::Success;
+
+	// SH only jobs are done once the panorama is projected
+	if (_job.outputPathCubeMap == nullptr && _job.outputPathLUT == nullptr)
+	{
+		return Result::Success;
+	}
+
+	// the panorama extent is known even if the panorama was not uploaded
+	uint32_t cubeMapSideLength = 0u;
+	uint32_t outputMipLevels = 0u;
+	if ((res = getCubeMapExtent(_job.distribution, _job.cubemapResolution, _job.mipmapCount, _panorama.height, cubeMapSideLength, outputMipLevels)) != Result::Success)
+	{
+		return res;
+	}
+
+	if (_job.outputPathCubeMap != nullptr)
+	{
+		VkCommandBuffer inputCmd = VK_NULL_HANDLE;
+		Submission inputSubmission{};
+		if ((res = renderInputCubeMap(_panorama, cubeMapSideLength, inputCmd, inputSubmission)) != Result::Success)
+		{
+			return res;
+		}
+
+		res = filterCubeMap(_job, cubeMapSideLength, outputMipLevels, static_cast<VkFormat>(_job.targetFormat), inputSubmission, _deferredWrites);
+
+		retire(inputSubmission, inputCmd);
+	}
+
+	// the LUT has its own pass, by default it matches the cube map resolution and sample count
+	if (res == Result::Success && _job.outputPathLUT != nullptr)
+	{
+		const uint32_t lutResolution = _job.lutResolution != 0u ? _job.lutResolution : cubeMapSideLength;
+		const uint32_t lutSampleCount = _job.lutSampleCount != 0u ? _job.lutSampleCount : _job.sampleCount;
+		res = generateLUT(_job.distribution, lutResolution, lutSampleCount, _job.outputPathLUT, _job.lutCacheDirectory, _deferredWrites);
+	}
+
+	return res;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::renderInputCubeMap(Panorama& _panorama, uint32_t _sideLength, VkCommandBuffer& _outCommandBuffer, Submission& _outSubmission)
+{
+	IBLLib::Result res = Result::Success;
+
+	// the previous job's passes read the uniforms, descriptor sets and sample table rewritten for this one.
+	// the panorama was uploaded before, so its upload overlaps them
+	if (vulkan.waitForSubmission(lastGraphics) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if ((res = prepareInputCubeMap(_sideLength)) != Result::Success)
+	{
+		return res;
+	}
+
+	const uint32_t maxMipLevels = targets.inputMipLevels;
+
+	if (vulkan.writeBufferData(shUniformBuffer, _panorama.shCoeffs, sizeof(_panorama.shCoeffs)) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (_panorama.image != VK_NULL_HANDLE)
+	{
+		// view is destroyed together with the panorama image
+		VkImageView panoramaImageView = VK_NULL_HANDLE;
+		const VkImageSubresourceRange panoramaRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, _panorama.layers };
+		if (vulkan.createImageView(panoramaImageView, _panorama.image, panoramaRange, VK_FORMAT_UNDEFINED, VK_IMAGE_VIEW_TYPE_2D_ARRAY) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		DescriptorSetInfo setLayout0;
+		describePanoramaSet(setLayout0, panoramaImageView);
+
+		if (setLayout0.fillWrites(panoramaSet) != VK_SUCCESS)
+		{
+			return Result::VulkanError;
+		}
+
+		vulkan.updateDescriptorSets(setLayout0.getWrites());
+	}
+
+	const std::vector<VkClearValue> clearValues(6u, { 0.0f, 0.0f, 1.0f, 1.0f });
+
+	VkCommandBuffer cubeMapCmd = VK_NULL_HANDLE;
+	if (vulkan.createCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (vulkan.beginCommandBuffer(cubeMapCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	{
+		vulkan.destroyCommandBuffer(cubeMapCmd);
+		return Result::VulkanError;
+	}
+
+	if (_panorama.image != VK_NULL_HANDLE)
+	{
+		////////////////////////////////////////////////////////////////////////////////////////
+		// Transform panorama image to cube map
+
+		printf("Transform panorama image to cube map\n");
+
+		// take the panorama over from the transfer queue that uploaded it
+		vulkan.acquireImage(cubeMapCmd, _panorama.image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+			QueueType::Transfer, QueueType::Graphics,
+			{ VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, _panorama.layers });
+
+		{
+			VkImageSubresourceRange  subresourceRangeBaseMiplevel = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u };
+
+			vulkan.imageBarrier(cubeMapCmd, targets.inputCubeMap,
+													VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+													VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,// src stage, access
+													VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, //dst stage, access
+													subresourceRangeBaseMiplevel);
+		}
+
+		vulkan.bindDescriptorSet(cubeMapCmd, panoramaPipelineLayout, panoramaSet);
+
+		vkCmdBindPipeline(cubeMapCmd, VK_PIPELINE_BIND_POINT_GRAPHICS, panoramaPipeline);
+
+		PushConstant values{};
+		values.panoramaEncoding = _panorama.encoding;
+		values.panoramaWidth = _panorama.width;
+		values.panoramaHeight = _panorama.height;
+		vkCmdPushConstants(cubeMapCmd, panoramaPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant), &values);
+		vulkan.setViewportAndScissor(cubeMapCmd, VkExtent2D{ _sideLength, _sideLength });
+
+		vulkan.beginRenderPass(cubeMapCmd, panoramaRenderPass, targets.inputCubeMapFramebuffer, VkRect2D{ 0u, 0u, _sideLength, _sideLength }, clearValues);
+		vkCmdDraw(cubeMapCmd, 3, 1u, 0, 0);
+		vulkan.endRenderPass(cubeMapCmd);
+
+		////////////////////////////////////////////////////////////////////////////////////////
+		//Generate MipLevels
+		printf("Generating mipmap levels\n");
+		generateMipmapLevels(vulkan, cubeMapCmd, targets.inputCubeMap, maxMipLevels, _sideLength, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
+	}
+	else
+	{
+		// the cube map is bound to the filter but never sampled, it only needs a valid layout
+		vulkan.imageBarrier(cubeMapCmd, targets.inputCubeMap,
+												VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+												VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u,// src stage, access
+												VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, //dst stage, access
+												{ VK_IMAGE_ASPECT_COLOR_BIT, 0u, maxMipLevels, 0u, 6u });
+	}
+
+	if (vulkan.endCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	{
+		vulkan.destroyCommandBuffer(cubeMapCmd);
+		return Result::VulkanError;
+	}
+
+	// the upload and the previous readback both run on the transfer queue, which completes in order.
+	// waiting for the later one also keeps the filters behind this pass from overwriting targets that are still copied
+	const Submission& transfer = _panorama.uploaded.value >= cubeMapReadback.value ? _panorama.uploaded : cubeMapReadback;
+
+	// the filter submissions wait for this one, the command buffer is freed by the caller once it completed
+	if (vulkan.submitCommandBuffer(cubeMapCmd, _outSubmission, transfer) != VK_SUCCESS)
+	{
+		vulkan.destroyCommandBuffer(cubeMapCmd);
+		return Result::VulkanError;
+	}
+
+	lastGraphics = _outSubmission;
+	_panorama.sampled = _outSubmission;
+	_outCommandBuffer = cubeMapCmd;
+
+	return Result::Success;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::filterCubeMap(const IblJob& _job, uint32_t _sideLength, uint32_t _outputMipLevels, VkFormat _targetFormat, const Submission& _input, std::vector<DeferredWrite>* _deferredWrites)
+{
+	IBLLib::Result res = Result::Success;
+
+	// the compute filter binds one storage image per mip level
+	const bool compute = _job.computeFilter && computeFilterPipelineLayout != VK_NULL_HANDLE && _outputMipLevels <= filterMaxMipLevels;
+
+	if ((res = prepareTargets(_sideLength, _outputMipLevels, _targetFormat, compute)) != Result::Success)
+	{
+		return res;
+	}
+
+	if ((res = prepareSampleTable(_job, _sideLength, _outputMipLevels)) != Result::Success)
+	{
+		return res;
+	}
+
+	VkPipeline filterPipeline = VK_NULL_HANDLE;
+	if ((res = getPipeline(compute ? FilterPass::Compute : FilterPass::Fragment, _job.distribution, _job.sampleCount, targets.renderFormat, filterPipeline)) != Result::Success)
+	{
+		return res;
+	}
+
+	VkCommandBuffer cubeMapCmd = VK_NULL_HANDLE;
+	if (vulkan.createCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (vulkan.beginCommandBuffer(cubeMapCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	{
+		vulkan.destroyCommandBuffer(cubeMapCmd);
+		return Result::VulkanError;
+	}
+
+	// Filter
+
+	switch (_job.distribution)
+	{
+		case IBLLib::Distribution::Lambertian:
+			printf("Filtering lambertian\n");
+			break;
+		case IBLLib::Distribution::GGX:
+			printf("Filtering GGX\n");
+			break;
+		case IBLLib::Distribution::Charlie:
+			printf("Filtering Charlie\n");
+			break;
+		default:
+			break;
+	}
+
+	// layout of the filtered cube map after filtering
+	VkImageLayout outputLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+	if (compute)
+	{
+		recordComputeFilter(cubeMapCmd, filterPipeline, _job, _sideLength, _outputMipLevels);
+		outputLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+	}
+	else
+	{
+		recordFragmentFilter(cubeMapCmd, filterPipeline, _job, _sideLength, _outputMipLevels);
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////
+	//Output
+
+	VkImageLayout currentCubeMapImageLayout = outputLayout;
+	VkImage outputCubeMap = targets.outputCubeMap;
+
+	if (_targetFormat != targets.renderFormat)
+	{
+		if ((res = convertVkFormat(vulkan, cubeMapCmd, targets.outputCubeMap, targets.convertedCubeMap, _targetFormat, currentCubeMapImageLayout)) != Success)
+		{
+			printf("Failed to convert Image \n");
+			vulkan.destroyCommandBuffer(cubeMapCmd);
+			return res;
+		}
+		currentCubeMapImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		outputCubeMap = targets.convertedCubeMap;
+	}
+
+	// hand the results to the transfer queue for the readback
+	vulkan.releaseImage(cubeMapCmd, outputCubeMap,
+		currentCubeMapImageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_WRITE_BIT,
+		QueueType::Graphics, QueueType::Transfer,
+		{ VK_IMAGE_ASPECT_COLOR_BIT, 0u, _outputMipLevels, 0u, 6u });
+
+	if (vulkan.endCommandBuffer(cubeMapCmd) != VK_SUCCESS)
+	{
+		vulkan.destroyCommandBuffer(cubeMapCmd);
+		return Result::VulkanError;
+	}
+
+	// the host prepares the readback while the gpu filters, the download submissions wait for the filter
+	Submission filterSubmission{};
+	if (vulkan.submitCommandBuffer(cubeMapCmd, filterSubmission, _input) != VK_SUCCESS)
+	{
+		vulkan.destroyCommandBuffer(cubeMapCmd);
+		return Result::VulkanError;
+	}
+	lastGraphics = filterSubmission;
+
+	// with _deferredWrites the readback is still running, the batch finishes it once it completed
+	res = downloadCubemap(vulkan, outputCubeMap, _job.outputPathCubeMap, currentCubeMapImageLayout, filterSubmission, _deferredWrites);
+	if (res != Result::Success)
+	{
+		printf("Failed to download Image \n");
+	}
+	else if (_deferredWrites != nullptr)
+	{
+		cubeMapReadback = _deferredWrites->back().readback.submission;
+	}
+
+	// the command buffer is freed once the filter completed, even if a download failed
+	retire(filterSubmission, cubeMapCmd);
+
+	return res != Result::Success ? Result::VulkanError : Result::Success;
+}
+
+IBLLib::Result IBLLib::IblSession::Impl::generateLUT(Distribution _distribution, uint32_t _resolution, uint32_t _sampleCount, const char* _outputPath, const char* _cacheDirectory, std::vector<DeferredWrite>* _deferredWrites)
+{
+	if (_distribution == Distribution::Lambertian)
+	{
+		printf("There is no lambertian LUT, %s is not written\n", _outputPath);
+		return Result::Success;
+	}
+
+	if (_resolution == 0u || _sampleCount == 0u)
+	{
+		return Result::InvalidArgument;
+	}
+
+	// reuse an identical LUT if it was computed before
+	const LutCache::Key lutKey = LutCache::makeKey(_distribution, _resolution, _sampleCount, _outputPath);
+	if (lutCache.write(lutKey, _cacheDirectory, _outputPath))
+	{
+		return Result::Success;
+	}
+
+	IBLLib::Result res = Result::Success;
+
+	if ((res = prepareLUT(_resolution)) != Result::Success)
+	{
+		return res;
+	}
+
+	VkPipeline lutPipeline = VK_NULL_HANDLE;
+	if ((res = getPipeline(FilterPass::LUT, _distribution, _sampleCount, VK_FORMAT_UNDEFINED, lutPipeline)) != Result::Success)
+	{
+		return res;
+	}
+
+	VkCommandBuffer lutCmd = VK_NULL_HANDLE;
+	if (vulkan.createCommandBuffer(lutCmd) != VK_SUCCESS)
+	{
+		return Result::VulkanError;
+	}
+
+	if (vulkan.beginCommandBuffer(lutCmd, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT) != VK_SUCCESS)
+	{
+		vulkan.destroyCommandBuffer(lutCmd);
+		return Result::VulkanError;
+	}
+
+	printf("Generating BRDF LUT\n");
+
+	const VkImageSubresourceRange lutRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u };
+
+	vulkan.imageBarrier(lutCmd, targets.lut,
+											VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+											VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u,//src stage, access
+											VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, // dst stage, access
+											lutRange);
+
+	vulkan.bindDescriptorSet(lutCmd, lutPipelineLayout, lutSet, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+	vkCmdBindPipeline(lutCmd, VK_PIPELINE_BIND_POINT_COMPUTE, lutPipeline);
+
+	PushConstant values{};
+	values.width = _resolution;
+
+	vkCmdPushConstants(lutCmd, lutPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant), &values);
+
+	const uint32_t groupCount = (_resolution + lutGroupSize - 1u) / lutGroupSize;
+	vkCmdDispatch(lutCmd, groupCount, groupCount, 1u);
+
+	// hand the LUT to the transfer queue for the readback
+	vulkan.releaseImage(lutCmd, targets.lut,
+		VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+		QueueType::Graphics, QueueType::Transfer,
+		lutRange);
+
+	if (vulkan.endCommandBuffer(lutCmd) != VK_SUCCESS)
+	{
+		vulkan.destroyCommandBuffer(lutCmd);
+		return Result::VulkanError;
+	}
+
+	// the previous LUT may still be copied by the transfer queue
+	Submission lutSubmission{};
+	if (vulkan.submitCommandBuffer(lutCmd, lutSubmission, lutReadback) != VK_SUCCESS)
+	{
+		vulkan.destroyCommandBuffer(lutCmd);
+		return Result::VulkanError;
+	}
+	lastGraphics = lutSubmission;
+
+	res = downloadLUT(vulkan, targets.lut, _distribution, _outputPath, lutSubmission, _deferredWrites);
+	if (res != Result::Success)
+	{
+		printf("Failed to download LUT \n");
+	}
+	else if (_deferredWrites != nullptr)
+	{
+		// the LUT enters the cache once the encode thread wrote it
+		DeferredWrite& write = _deferredWrites->back();
+		lutReadback = write.readback.submission;
+		const std::function<Result()> encode = write.write;
+		const std::string path = _outputPath;
+		const std::string cacheDirectory = _cacheDirectory != nullptr ? _cacheDirectory : "";
+		LutCache& cache = lutCache;
+		write.write = [encode, path, cacheDirectory, lutKey, &cache]()
+		{
+			const Result written = encode();
+			if (written == Result::Success)
+			{
+				cache.store(lutKey, cacheDirectory.empty() ? nullptr : cacheDirectory.c_str(), path.c_str());
+			}
+			return written;
+		};
+	}
+	else
+	{
+		lutCache.store(lutKey, _cacheDirectory, _outputPath);
+	}
+
+	// the command buffer is freed once the LUT pass completed, even if the download failed
+	retire(lutSubmission, lutCmd);
+
+	return res != Result::Success ? Result::VulkanError : Result::Success;
+}
+
+void IBLLib::IblSession::Impl::recordFragmentFilter(VkCommandBuffer _commandBuffer, VkPipeline _pipeline, const IblJob& _job, uint32_t _sideLength, uint32_t _outputMipLevels)
+{
+	const std::vector<VkClearValue> clearValues(6u, { 0.0f, 0.0f, 1.0f, 1.0f });
+
+	vulkan.bindDescriptorSet(_commandBuffer, filterPipelineLayout, filterSet);
+
+	vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, _pipeline);
+
+	// the filter shader scales its uv by the mip level, so the viewport always covers the base level
+	vulkan.setViewportAndScissor(_commandBuffer, VkExtent2D{ _sideLength, _sideLength });
+
+	// Filter every mip level: from inputCubeMap->currentMipLevel
+	// The mip levels are filtered from the smallest mipmap to the largest mipmap,
+	// i.e. the last mipmap is filtered last.
+	for (uint32_t currentMipLevel = _outputMipLevels - 1; currentMipLevel != -1; currentMipLevel--)
+	{
+		unsigned int currentFramebufferSideLength = _sideLength >> currentMipLevel;
+
+		VkImageSubresourceRange  subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, currentMipLevel, 1u, 0u, 6u };
+
+		vulkan.imageBarrier(_commandBuffer, targets.outputCubeMap,
+												VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+												VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,//src stage, access
+												VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, // dst stage, access
+												subresourceRange);
+
+		PushConstant values{};
+		values.roughness = _outputMipLevels > 1u ? static_cast<float>(currentMipLevel) / static_cast<float>(_outputMipLevels - 1) : 0.0f;
+		values.mipLevel = currentMipLevel;
+		values.width = _sideLength;
+		values.lodBias = _job.lodBias;
+
+		vkCmdPushConstants(_commandBuffer, filterPipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant), &values);
+
+		vulkan.beginRenderPass(_commandBuffer, targets.filterRenderPass, targets.filterFramebuffers[currentMipLevel], VkRect2D{ 0u, 0u, currentFramebufferSideLength, currentFramebufferSideLength }, clearValues);
+		vkCmdDraw(_commandBuffer, 3, 1u, 0, 0);
+		vulkan.endRenderPass(_commandBuffer);
+	}
+}
+
+void IBLLib::IblSession::Impl::recordComputeFilter(VkCommandBuffer _commandBuffer, VkPipeline _pipeline, const IblJob& _job, uint32_t _sideLength, uint32_t _outputMipLevels)
+{
+	const VkImageSubresourceRange cubeMapRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, _outputMipLevels, 0u, 6u };
+
+	vulkan.imageBarrier(_commandBuffer, targets.outputCubeMap,
+											VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+											VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u,//src stage, access
+											VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT, // dst stage, access
+											cubeMapRange);
+
+	vulkan.bindDescriptorSet(_commandBuffer, computeFilterPipelineLayout, computeFilterSet, VK_PIPELINE_BIND_POINT_COMPUTE);
+
+	vkCmdBindPipeline(_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+
+	PushConstant values{};
+	values.width = _sideLength;
+	values.lodBias = _job.lodBias;
+	values.mipLevelCount = _outputMipLevels;
+
+	vkCmdPushConstants(_commandBuffer, computeFilterPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant), &values);
+
+	// the work groups of all mip levels are enumerated one after the other, see filterCubeMapCompute
+	uint32_t groupCount = 0u;
+	for (uint32_t level = 0u; level < _outputMipLevels; ++level)
+	{
+		const uint32_t groupsPerRow = (std::max(_sideLength >> level, 1u) + computeFilterGroupSize - 1u) / computeFilterGroupSize;
+		groupCount += groupsPerRow * groupsPerRow;
+	}
+
+	const uint32_t groupCountX = std::min(groupCount, vulkan.getDeviceProperties().limits.maxComputeWorkGroupCount[0]);
+	const uint32_t groupCountY = (groupCount + groupCountX - 1u) / groupCountX;
+
+	// z: 6 faces
+	vkCmdDispatch(_commandBuffer, groupCountX, groupCountY, 6u);
+
+	vulkan.imageBarrier(_commandBuffer, targets.outputCubeMap,
+											VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+											VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,//src stage, access
+											VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, // dst stage, access
+											cubeMapRange);
+}
+
+IBLLib::IblSession::IblSession() :
+	m_impl(std::make_unique<Impl>())
+{
+}
+
+IBLLib::IblSession::~IblSession()
+{
+}
+
+IBLLib::Result IBLLib::IblSession::initialize(bool _debugOutput)
+{
+	if (m_impl->initialized)
+	{
+		return Result::Success;
+	}
+
+	IBLLib::Result res = m_impl->initialize(_debugOutput);
+
+	if (res != Result::Success)
+	{
+		shutdown();
+	}
+
+	return res;
+}
+
+IBLLib::Result IBLLib::IblSession::run(const IblJob& _job)
+{
+	return m_impl->run(_job);
+}
+
+IBLLib::Result IBLLib::IblSession::runBundle(const IblBundle& _bundle)
+{
+	return m_impl->runBundle(_bundle);
+}
+
+IBLLib::Result IBLLib::IblSession::runBatch(const std::vector<IblJob>& _jobs, const BatchOptions& _options, std::vector<Result>* _outResults)
+{
+	return m_impl->runBatch(_jobs, _options, _outResults);
+}
+
+void IBLLib::IblSession::shutdown()
+{
+	// vkHelper releases all vulkan objects on destruction
+	m_impl = std::make_unique<Impl>();
+}
+
+bool IBLLib::canRunOnHost(const IblJob& _job)
+{
+	return _job.distribution == Distribution::Lambertian || (_job.outputPathCubeMap == nullptr && _job.outputPathLUT == nullptr);
+}
+
+IBLLib::Result IBLLib::runOnHost(const IblJob& _job)
+{
+	if (_job.inputPath == nullptr)
+	{
+		return Result::InvalidArgument;
+	}
+
+	// only jobs filtered on the host keep the panorama pixels, the others are just projected onto SH
+	const bool filterOnHost = _job.outputPathCubeMap != nullptr && _job.distribution != Distribution::Lambertian;
+
+	DecodedPanorama panorama;
+	IBLLib::Result res = decodePanorama(_job.inputPath, _job.outputPathSH, filterOnHost ? storePixels(panorama) : PanoramaSink(), panorama);
+	if (res != Result::Success)
+	{
+		return res;
+	}
+
+	// SH only jobs are done once the panorama is projected
+	if (_job.outputPathCubeMap == nullptr && _job.outputPathLUT == nullptr)
+	{
+		return Result::Success;
+	}
+
+	uint32_t cubeMapSideLength = 0u;
+	uint32_t outputMipLevels = 0u;
+	if ((res = getCubeMapExtent(filterOnHost ? _job.distribution : Distribution::Lambertian, _job.cubemapResolution, _job.mipmapCount, panorama.height, cubeMapSideLength, outputMipLevels)) != Result::Success)
+	{
+		return res;
+	}
+
+	if (filterOnHost)
+	{
+		HostPanorama hostPanorama;
+		getHostPanorama(panorama, hostPanorama);
+		std::vector<uint8_t>().swap(panorama.pixels);
+
+		printf("Filtering %u mip levels on the host\n", outputMipLevels);
+		if ((res = filterCubeMapOnHost(_job.outputPathCubeMap, hostPanorama, _job.distribution, cubeMapSideLength, outputMipLevels, _job.sampleCount, _job.lodBias, static_cast<VkFormat>(_job.targetFormat))) != Result::Success)
+		{
+			return res;
+		}
+	}
+	else if (_job.outputPathCubeMap != nullptr)
+	{
+		printf("Filtering lambertian on the host\n");
+		if ((res = writeIrradianceCubeMap(_job.outputPathCubeMap, panorama.shCoeffs, cubeMapSideLength, static_cast<VkFormat>(_job.targetFormat))) != Result::Success)
+		{
+			return res;
+		}
+	}
+
+	if (_job.outputPathLUT != nullptr)
+	{
+		if (_job.distribution == Distribution::Lambertian)
+		{
+			printf("There is no lambertian LUT, %s is not written\n", _job.outputPathLUT);
+			return Result::Success;
+		}
+
+		// same defaults as the gpu pass
+		LutJob lutJob;
+		lutJob.outputPath = _job.outputPathLUT;
+		lutJob.distribution = _job.distribution == Distribution::GGXCubeMap ? Distribution::GGX : _job.distribution;
+		lutJob.resolution = _job.lutResolution != 0u ? _job.lutResolution : cubeMapSideLength;
+		lutJob.sampleCount = _job.lutSampleCount != 0u ? _job.lutSampleCount : _job.sampleCount;
+		res = computeLUT(lutJob);
+	}
+
+	return res;
+}
+
+IBLLib::Result IBLLib::sample(const char* _inputPath, const char* _outputPathCubeMap, const char* _outputPathLUT, const char* _outputPathSH, Distribution _distribution, unsigned int _cubemapResolution, unsigned int _mipmapCount, unsigned int _sampleCount, OutputFormat _targetFormat, float _lodBias, bool _debugOutput)
+{
+	IblJob job;
+	job.inputPath = _inputPath;
+	job.outputPathCubeMap = _outputPathCubeMap;
+	job.outputPathLUT = _outputPathLUT;
+	job.outputPathSH = _outputPathSH;
+	job.distribution = _distribution;
+	job.cubemapResolution = _cubemapResolution;
+	job.mipmapCount = _mipmapCount;
+	job.sampleCount = _sampleCount;
+	job.targetFormat = _targetFormat;
+	job.lodBias = _lodBias;
+
+	// the device is only created if the job has to be filtered on the gpu
+	if (canRunOnHost(job))
+	{
+		return runOnHost(job);
+	}
+
+	IblSession session;
+
+	IBLLib::Result res = session.initialize(_debugOutput);
+	if (res != Result::Success)
+	{
+		return res;
+	}
+
+	return session.run(job);
 }
@@ -5,12 +5,24 @@ R""(
 #define UX3D_MATH_PI 3.1415926535897932384626433832795
 #define UX3D_MATH_INV_PI (1.0 / UX3D_MATH_PI)
 
-layout(set = 0, binding = 0) uniform sampler2D uPanorama;
+// one layer unless the panorama exceeds the image dimension limit, then it is split into row major tiles
+layout(set = 0, binding = 0) uniform sampler2DArray uPanorama;
 layout(set = 0, binding = 1) uniform samplerCube uCubeMap;
 layout(set = 0, binding = 2) uniform uSH9 {
     vec4 coefficients[9];    
 };
 
+// must match the host side filterMaxMipLevels
+#define MAX_MIP_LEVELS 16
+
+// GGX and Charlie importance samples of every output mip level, precomputed on the host by getImportanceSamples().
+// They only depend on the roughness: xyz is the reflected direction in the tangent frame of the normal (z = NdotL), w the lod.
+// Samples below the horizon are not in the table.
+layout(std430, set = 0, binding = 5) readonly buffer uSampleTable {
+    uvec2 levelSamples[MAX_MIP_LEVELS]; // x: first sample of the level, y: sample count
+    vec4 importanceSamples[];
+};
+
 
 // enum
 const uint cLambertian = 0;
@@ -18,15 +30,47 @@ const uint cGGX = 1;
 const uint cCharlie = 2;
 const uint cGGXCubeMap = 3;
 
+// Specialization constants, see getPipeline(). The LUT pipelines are built per distribution and sample count,
+// so its distribution branches are folded and its sample loop has a constant trip count.
+// The filters only specialize lambertian against the sample table, whose per level counts bound their loop.
+layout(constant_id = 0) const uint cDistribution = 0u; // enum
+layout(constant_id = 1) const uint cSampleCount = 1024u;
+
 layout(push_constant) uniform FilterParameters {
   float roughness;
-  uint sampleCount;
   uint currentMipLevel;
   uint width;
   float lodBias;
-  uint distribution; // enum
+  uint mipLevelCount; // compute path only
+  uint panoramaEncoding; // panorama pass only
+  uint panoramaWidth; // panorama pass only
+  uint panoramaHeight; // panorama pass only
 } pFilterParameters;
 
+// panorama encodings, must match PanoramaEncoding on the host side
+const uint cPanoramaLinear = 0; // float and sRGB formats, decoded by the sampler
+const uint cPanoramaRGBE = 1; // Radiance rgbe stored in rgba8 unorm
+
+#ifdef IBLSAMPLER_COMPUTE
+
+// must match the host side ComputeFilter constants
+#define GROUP_SIZE 8
+
+layout(local_size_x = GROUP_SIZE, local_size_y = GROUP_SIZE, local_size_z = 1) in;
+
+#ifdef IBLSAMPLER_LUT
+// rgb: GGX scale and bias, Charlie scale
+layout(set = 0, binding = 4, rgba16f) uniform writeonly image2D uOutputLUT;
+#elif defined(IBLSAMPLER_OUTPUT_WITHOUT_FORMAT)
+// same as below in the output format of the job, needs shaderStorageImageWriteWithoutFormat
+layout(set = 0, binding = 3) uniform writeonly image2DArray uOutputCubeMap[MAX_MIP_LEVELS];
+#else
+// one 6 layer view per output mip level, unused elements alias the last level
+layout(set = 0, binding = 3, rgba32f) uniform writeonly image2DArray uOutputCubeMap[MAX_MIP_LEVELS];
+#endif
+
+#else
+
 layout (location = 0) in vec2 inUV;
 
 // output cubemap faces
@@ -37,8 +81,6 @@ layout(location = 3) out vec4 outFace3;
 layout(location = 4) out vec4 outFace4;
 layout(location = 5) out vec4 outFace5;
 
-layout(location = 6) out vec3 outLUT;
-
 void writeFace(int face, vec3 colorIn)
 {
 	vec4 color = vec4(colorIn.rgb, 1.0f);
@@ -57,6 +99,8 @@ void writeFace(int face, vec3 colorIn)
 		outFace5 = color;
 }
 
+#endif // IBLSAMPLER_COMPUTE
+
 vec3 uvToXYZ(int face, vec2 uv)
 {
     if(face == 0)
@@ -90,7 +134,8 @@ float saturate(float v)
     return clamp(v, 0.0f, 1.0f);
 }
 
-vec3 sample_sh(const vec3 direction) {
+// bandScale weights the SH bands, e.g. to convolve the radiance with a cosine lobe
+vec3 sample_sh(const vec3 direction, const vec3 bandScale) {
     float x = direction.x;
     float y = direction.y;
     float z = direction.z;
@@ -112,24 +157,32 @@ vec3 sample_sh(const vec3 direction) {
     // Combine coefficients with basis functions
     vec3 color = vec3(0.0, 0.0, 0.0);
     for (int i = 0; i < 3; i++) {
-        float sum = coefficients[0][i] * Y00;   // L_{00}
+        float band0 = coefficients[0][i] * Y00;   // L_{00}
 
-        sum += coefficients[1][i] * Y1_1;       // L_{1-1}
-        sum += coefficients[2][i] * Y10;        // L_{10}
-        sum += coefficients[3][i] * Y11;        // L_{11}
+        float band1 = coefficients[1][i] * Y1_1;  // L_{1-1}
+        band1 += coefficients[2][i] * Y10;        // L_{10}
+        band1 += coefficients[3][i] * Y11;        // L_{11}
         
-        sum += coefficients[4][i] * Y2_2;       // L_{2-2}
-        sum += coefficients[5][i] * Y2_1;       // L_{2-1}
-        sum += coefficients[6][i] * Y20;        // L_{20}
-        sum += coefficients[7][i] * Y21;        // L_{21}
-        sum += coefficients[8][i] * Y22;        // L_{22}
+        float band2 = coefficients[4][i] * Y2_2;  // L_{2-2}
+        band2 += coefficients[5][i] * Y2_1;       // L_{2-1}
+        band2 += coefficients[6][i] * Y20;        // L_{20}
+        band2 += coefficients[7][i] * Y21;        // L_{21}
+        band2 += coefficients[8][i] * Y22;        // L_{22}
 
-        color[i] = sum;
+        color[i] = dot(vec3(band0, band1, band2), bandScale);
     }
 
     return color;
 }
 
+// Irradiance / pi from the radiance SH, i.e. the cosine weighted hemisphere average of sample_sh.
+// The clamped cosine lobe convolution scales the bands by A_l / pi = 1, 2/3, 1/4
+// (Ramamoorthi & Hanrahan, "An Efficient Representation for Irradiance Environment Maps")
+vec3 sample_sh_irradiance(const vec3 normal)
+{
+    return sample_sh(normal, vec3(1.0, 2.0 / 3.0, 0.25));
+}
+
 // Hammersley Points on the Hemisphere
 // CC BY 3.0 (Holger Dammertz)
 // http://holger.dammertz.org/stuff/notes_HammersleyOnHemisphere.html
@@ -283,23 +336,23 @@ MicrofacetDistributionSample Lambertian(vec2 xi, float roughness)
 vec4 getImportanceSample(int sampleIndex, vec3 N, float roughness)
 {
     // generate a quasi monte carlo point in the unit square [0.1)^2
-    vec2 xi = hammersley2d(sampleIndex, int(pFilterParameters.sampleCount));
+    vec2 xi = hammersley2d(sampleIndex, int(cSampleCount));
 
     MicrofacetDistributionSample importanceSample;
 
     // generate the points on the hemisphere with a fitting mapping for
     // the distribution (e.g. lambertian uses a cosine importance)
-    if(pFilterParameters.distribution == cLambertian)
+    if(cDistribution == cLambertian)
     {
         importanceSample = Lambertian(xi, roughness);
     }
-    else if(pFilterParameters.distribution == cGGX || pFilterParameters.distribution == cGGXCubeMap)
+    else if(cDistribution == cGGX || cDistribution == cGGXCubeMap)
     {
         // Trowbridge-Reitz / GGX microfacet model (Walter et al)
         // https://www.cs.cornell.edu/~srm/publications/EGSR07-btdf.html
         importanceSample = GGX(xi, roughness);
     }
-    else if(pFilterParameters.distribution == cCharlie)
+    else if(cDistribution == cCharlie)
     {
         importanceSample = Charlie(xi, roughness);
     }
@@ -317,82 +370,38 @@ vec4 getImportanceSample(int sampleIndex, vec3 N, float roughness)
     return vec4(direction, importanceSample.pdf);
 }
 
-// Mipmap Filtered Samples (GPU Gems 3, 20.4)
-// https://developer.nvidia.com/gpugems/gpugems3/part-iii-rendering/chapter-20-gpu-based-importance-sampling
-// https://cgg.mff.cuni.cz/~jaroslav/papers/2007-sketch-fis/Final_sap_0073.pdf
-float computeLod(float pdf)
+vec3 filterColor(vec3 N, uint mipLevel)
 {
-    // removed comments, look at original repo
-
-    // We achieved good results by using the original formulation from Krivanek & Colbert adapted to cubemaps
+    // closed form instead of averaging sampleCount evaluations of the SH
+    if(cDistribution == cLambertian)
+    {
+        return sample_sh_irradiance(N);
+    }
 
+    // the samples of the level are rotated into the frame of N, lod and NdotL are part of the table.
+    // Mipmap filtered samples (GPU Gems 3, 20.4): the lod follows Krivanek & Colbert adapted to cube maps
+    // https://developer.nvidia.com/gpugems/gpugems3/part-iii-rendering/chapter-20-gpu-based-importance-sampling
     // https://cgg.mff.cuni.cz/~jaroslav/papers/2007-sketch-fis/Final_sap_0073.pdf
-    float lod = 0.5 * log2( 6.0 * float(pFilterParameters.width) * float(pFilterParameters.width) / (float(pFilterParameters.sampleCount) * pdf));
-
-
-    return lod;
-}
+    mat3 TBN = generateTBN(N);
+    uvec2 samples = levelSamples[mipLevel];
 
-vec3 filterColor(vec3 N)
-{
-    //return  textureLod(uCubeMap, N, 3.0).rgb;
     vec3 color = vec3(0.f);
     float weight = 0.0f;
 
-    for(int i = 0; i < int(pFilterParameters.sampleCount); ++i)
+    // the samples below the horizon were culled, so the count differs per level
+    for(uint i = 0u; i < samples.y; ++i)
     {
-        vec4 importanceSample = getImportanceSample(i, N, pFilterParameters.roughness);
-
-        vec3 H = vec3(importanceSample.xyz);
-        float pdf = importanceSample.w;
-
-        // mipmap filtered samples (GPU Gems 3, 20.4)
-        float lod = computeLod(pdf);
-
-        // apply the bias to the lod
-        lod += pFilterParameters.lodBias;
-
-        if(pFilterParameters.distribution == cLambertian)
-        {
-            // sample lambertian at a lower resolution to avoid fireflies
-            // vec3 lambertian = textureLod(uCubeMap, H, lod).rgb;
-            // Use spherical harmonics for diffuse
-            vec3 lambertian = sample_sh(H);
-            
+        vec4 importanceSample = importanceSamples[samples.x + i];
+        float NdotL = importanceSample.z;
 
-            color += lambertian;
-        }
-        else if(pFilterParameters.distribution == cGGX || pFilterParameters.distribution == cGGXCubeMap || pFilterParameters.distribution == cCharlie)
-        {
-            // Note: reflect takes incident vector.
-            vec3 V = N;
-            vec3 L = normalize(reflect(-V, H));
-            float NdotL = dot(N, L);
-
-            if (NdotL > 0.0)
-            {
-                if(pFilterParameters.roughness == 0.0)
-                {
-                    // without this the roughness=0 lod is too high
-                    lod = pFilterParameters.lodBias;
-                }
-
-                vec3 sampleColor = textureLod(uCubeMap, L, lod).rgb;
-
-                color += sampleColor * NdotL;
-                weight += NdotL;
-            }
-        }
+        color += textureLod(uCubeMap, TBN * importanceSample.xyz, importanceSample.w).rgb * NdotL;
+        weight += NdotL;
     }
 
     if(weight != 0.0f)
     {
         color /= weight;
     }
-    else
-    {
-        color /= float(pFilterParameters.sampleCount);
-    }
 
     return color.rgb ;
 }
@@ -416,6 +425,12 @@ float V_Ashikhmin(float NdotL, float NdotV)
 // See https://blog.selfshadow.com/publications/s2013-shading-course/karis/s2013_pbs_epic_notes_v2.pdf
 vec3 LUT(float NdotV, float roughness)
 {
+    // there is no lambertian LUT, skip the sample loop that would only accumulate zeros
+    if (cDistribution == cLambertian)
+    {
+        return vec3(0.0);
+    }
+
     // Compute spherical view vector: (sin(phi), 0, cos(phi))
     vec3 V = vec3(sqrt(1.0 - NdotV * NdotV), 0.0, NdotV);
 
@@ -427,7 +442,7 @@ vec3 LUT(float NdotV, float roughness)
     float B = 0.0;
     float C = 0.0;
 
-    for(int i = 0; i < int(pFilterParameters.sampleCount); ++i)
+    for(int i = 0; i < int(cSampleCount); ++i)
     {
         // Importance sampling, depending on the distribution.
         vec4 importanceSample = getImportanceSample(i, N, roughness);
@@ -440,7 +455,7 @@ vec3 LUT(float NdotV, float roughness)
         float VdotH = saturate(dot(V, H));
         if (NdotL > 0.0)
         {
-            if (pFilterParameters.distribution == cGGX || pFilterParameters.distribution == cGGXCubeMap)
+            if (cDistribution == cGGX || cDistribution == cGGXCubeMap)
             {
 
                 // Taken from: https://bruop.github.io/ibl
@@ -453,7 +468,7 @@ vec3 LUT(float NdotV, float roughness)
                 C += 0.0;
             }
 
-            if (pFilterParameters.distribution == cCharlie)
+            if (cDistribution == cCharlie)
             {
                 // LUT for Charlie distribution.
                 float sheenDistribution = D_Charlie(roughness, NdotH);
@@ -467,9 +482,146 @@ vec3 LUT(float NdotV, float roughness)
     }
 
     // removed comments, look at the original repo
-    return vec3(4.0 * A, 4.0 * B, 4.0 * 2.0 * UX3D_MATH_PI * C) / float(pFilterParameters.sampleCount);
+    return vec3(4.0 * A, 4.0 * B, 4.0 * 2.0 * UX3D_MATH_PI * C) / float(cSampleCount);
+}
+
+
+// filters the texel at uv [0,1] of the given face
+vec3 filterTexel(int face, vec2 uv, uint mipLevel)
+{
+    float angle = radians(90.0f);
+    float cosTheta = cos(angle);
+    float sinTheta = sin(angle);
+
+    vec3 scan = uvToXYZ(face, uv*2.0-1.0);
+
+    vec3 direction = normalize(scan);
+
+    vec3 rotateDir = vec3(direction.x*cosTheta + direction.z*sinTheta,
+                          direction.y,
+                          -direction.x*sinTheta + direction.z*cosTheta);
+
+    rotateDir.y = -rotateDir.y;
+
+    return filterColor(rotateDir, mipLevel);
+}
+
+#ifdef IBLSAMPLER_LUT
+
+// entry point
+// one invocation per LUT texel, x: NdotV, y: roughness
+void generateLUT()
+{
+	ivec2 size = imageSize(uOutputLUT);
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+
+	if (texel.x >= size.x || texel.y >= size.y)
+	{
+		return;
+	}
+
+	vec2 uv = (vec2(texel) + 0.5) / vec2(size);
+	imageStore(uOutputLUT, texel, vec4(LUT(uv.x, uv.y), 1.0));
+}
+
+#elif defined(IBLSAMPLER_COMPUTE)
+
+// entry point
+// A single dispatch filters all mip levels: the work groups of all levels are enumerated one after the other
+// (level 0 first) and z selects the face.
+// Work groups never straddle two levels, so the image array index is uniform per work group.
+void filterCubeMapCompute()
+{
+	uint group = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+
+	uint mipLevel = 0u;
+	uint mipSideLength = pFilterParameters.width;
+	uint groupsPerRow = (mipSideLength + uint(GROUP_SIZE) - 1u) / uint(GROUP_SIZE);
+
+	while (group >= groupsPerRow * groupsPerRow)
+	{
+		group -= groupsPerRow * groupsPerRow;
+		mipLevel++;
+
+		if (mipLevel >= pFilterParameters.mipLevelCount)
+		{
+			return; // padding of the last row of work groups
+		}
+
+		mipSideLength = max(mipSideLength >> 1u, 1u);
+		groupsPerRow = (mipSideLength + uint(GROUP_SIZE) - 1u) / uint(GROUP_SIZE);
+	}
+
+	uvec2 texel = uvec2(group % groupsPerRow, group / groupsPerRow) * uint(GROUP_SIZE) + gl_LocalInvocationID.xy;
+
+	if (texel.x >= mipSideLength || texel.y >= mipSideLength)
+	{
+		return;
+	}
+
+	vec2 uv = (vec2(texel) + 0.5) / float(mipSideLength);
+	int face = int(gl_WorkGroupID.z);
+
+	imageStore(uOutputCubeMap[mipLevel], ivec3(texel, face), vec4(filterTexel(face, uv, mipLevel), 1.0));
+}
+
+#ifdef IBLSAMPLER_OUTPUT_WITHOUT_FORMAT
+// entry point
+// filterCubeMapCompute for outputs that are not rgba32f, a separate entry point names its precompiled SPIR-V
+void filterCubeMapComputeWithoutFormat()
+{
+	filterCubeMapCompute();
+}
+#endif
+
+#else
+
+vec3 decodeRGBE(vec4 texel)
+{
+	vec4 rgbe = floor(texel * 255.0 + 0.5);
+	return rgbe.a > 0.0 ? rgbe.rgb * exp2(rgbe.a - 136.0) : vec3(0.0);
+}
+
+// same as the mirrored repeat address mode of the sampler for texels just outside the image
+ivec2 mirrorTexel(ivec2 texel, ivec2 size)
+{
+	texel = ivec2(texel.x < 0 ? -1 - texel.x : texel.x, texel.y < 0 ? -1 - texel.y : texel.y);
+	return ivec2(texel.x >= size.x ? 2 * size.x - 1 - texel.x : texel.x, texel.y >= size.y ? 2 * size.y - 1 - texel.y : texel.y);
 }
 
+vec3 fetchPanorama(ivec2 texel)
+{
+	ivec2 size = ivec2(pFilterParameters.panoramaWidth, pFilterParameters.panoramaHeight);
+	ivec2 tileSize = textureSize(uPanorama, 0).xy;
+	int tileColumns = (size.x + tileSize.x - 1) / tileSize.x;
+
+	texel = mirrorTexel(texel, size);
+	ivec2 tile = texel / tileSize;
+
+	vec4 value = texelFetch(uPanorama, ivec3(texel - tile * tileSize, tile.y * tileColumns + tile.x), 0);
+	return pFilterParameters.panoramaEncoding == cPanoramaRGBE ? decodeRGBE(value) : value.rgb;
+}
+
+vec3 samplePanorama(vec2 uv)
+{
+	if (pFilterParameters.panoramaEncoding != cPanoramaRGBE && textureSize(uPanorama, 0).z == 1)
+	{
+		return texture(uPanorama, vec3(uv, 0.0)).rgb;
+	}
+
+	// rgbe can not be filtered by the sampler and tiles have no shared border,
+	// fetch and decode the four neighbours and interpolate the linear values
+	vec2 position = uv * vec2(pFilterParameters.panoramaWidth, pFilterParameters.panoramaHeight) - 0.5;
+	ivec2 base = ivec2(floor(position));
+	vec2 weight = position - floor(position);
+
+	vec3 c00 = fetchPanorama(base);
+	vec3 c10 = fetchPanorama(base + ivec2(1, 0));
+	vec3 c01 = fetchPanorama(base + ivec2(0, 1));
+	vec3 c11 = fetchPanorama(base + ivec2(1, 1));
+
+	return mix(mix(c00, c10, weight.x), mix(c01, c11, weight.x), weight.y);
+}
 
 // entry point
 void panoramaToCubeMap() 
@@ -482,7 +634,7 @@ void panoramaToCubeMap()
 	
 		vec2 src = dirToUV(direction);		
 			
-		writeFace(face, texture(uPanorama, src).rgb);
+		writeFace(face, samplePanorama(src));
 	}
 }
 
@@ -490,33 +642,12 @@ void panoramaToCubeMap()
 void filterCubeMap() 
 {
 	vec2 newUV = inUV * float(1 << (pFilterParameters.currentMipLevel));
-	 
-	newUV = newUV*2.0-1.0;
 
-    float angle = radians(90.0f);
-    float cosTheta = cos(angle);
-    float sinTheta = sin(angle);
-	
 	for(int face = 0; face < 6; ++face)
 	{
-		vec3 scan = uvToXYZ(face, newUV);		
-			
-		vec3 direction = normalize(scan);
-
-        vec3 rotateDir = vec3(direction.x*cosTheta + direction.z*sinTheta,
-                              direction.y,
-                              -direction.x*sinTheta + direction.z*cosTheta);
-
-        rotateDir.y = -rotateDir.y;
-
-		writeFace(face, filterColor(rotateDir));
-	}
-
-	if (pFilterParameters.currentMipLevel == 0)
-	{
-		
-		outLUT = LUT(inUV.x, inUV.y);
-	
+		writeFace(face, filterTexel(face, newUV, pFilterParameters.currentMipLevel));
 	}
 }
+
+#endif // IBLSAMPLER_COMPUTE
 )""
@@ -1,9 +1,11 @@
 #include "vkHelper.h"
 #include "FileHelper.h"
 #include <cstring>
+#include <algorithm>
 #include "stdio.h"
 
-constexpr auto g_PipelineCachePath = "pipeline.cache";
+// stored next to the executable so the cache is found independent of the working directory
+constexpr auto g_PipelineCacheFileName = "pipeline.cache";
 
 IBLLib::vkHelper::vkHelper()
 {
@@ -31,6 +33,15 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.apiVersion = VK_API_VERSION_1_0;
 
+		// 1.2 provides timeline semaphores, vkEnumerateInstanceVersion is missing on 1.0 loaders
+		PFN_vkEnumerateInstanceVersion enumerateInstanceVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion"));
+		uint32_t instanceVersion = VK_API_VERSION_1_0;
+		if (enumerateInstanceVersion != nullptr && enumerateInstanceVersion(&instanceVersion) == VK_SUCCESS && instanceVersion >= VK_API_VERSION_1_2)
+		{
+			appInfo.apiVersion = VK_API_VERSION_1_2;
+		}
+		m_instanceVersion = appInfo.apiVersion;
+
 		std::vector<const char*> layers;
 		if (_debugOutput)
 		{
@@ -113,12 +124,11 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 
 		m_physicalDevice = devices[_phyDeviceIndex];
 
-		VkPhysicalDeviceProperties deviceProperties;
-		vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+		vkGetPhysicalDeviceProperties(m_physicalDevice, &m_deviceProperties);
 
-		printf("Physical Device created: %s\n", deviceProperties.deviceName);
-		printf("APIVersion: %u.%u.%u\n", VK_VERSION_MAJOR(deviceProperties.apiVersion), VK_VERSION_MINOR(deviceProperties.apiVersion), VK_VERSION_PATCH(deviceProperties.apiVersion));
-		printf("DriverVersion: %u\n", deviceProperties.driverVersion);
+		printf("Physical Device created: %s\n", m_deviceProperties.deviceName);
+		printf("APIVersion: %u.%u.%u\n", VK_VERSION_MAJOR(m_deviceProperties.apiVersion), VK_VERSION_MINOR(m_deviceProperties.apiVersion), VK_VERSION_PATCH(m_deviceProperties.apiVersion));
+		printf("DriverVersion: %u\n", m_deviceProperties.driverVersion);
 
 		vkGetPhysicalDeviceFeatures(m_physicalDevice, &m_deviceFeatures); // TODO: check needed features
 		vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &m_memoryProperties);		
@@ -128,7 +138,10 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 	// Select queue & logical device
 	//
 
-	m_queueFamilyIndex = UINT32_MAX;
+	SubmissionQueue& graphics = m_queues[static_cast<uint32_t>(QueueType::Graphics)];
+	SubmissionQueue& transfer = m_queues[static_cast<uint32_t>(QueueType::Transfer)];
+	graphics.familyIndex = UINT32_MAX;
+	transfer.familyIndex = UINT32_MAX;
 
 	{
 		uint32_t queueFamilyCount = 0;
@@ -137,7 +150,7 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 		vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
 
-		for (uint32_t i = 0; i < queueFamilyCount && m_queueFamilyIndex == UINT32_MAX; ++i)
+		for (uint32_t i = 0; i < queueFamilyCount && graphics.familyIndex == UINT32_MAX; ++i)
 		{
 			const VkQueueFamilyProperties& family = queueFamilies[i];
 
@@ -146,35 +159,81 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 				&& (family.queueFlags & VK_QUEUE_TRANSFER_BIT)
 				)
 			{
-				m_queueFamilyIndex = i;
+				graphics.familyIndex = i;
 			}
 		}
 
-		if (m_queueFamilyIndex == UINT32_MAX)
+		if (graphics.familyIndex == UINT32_MAX)
 		{
 			printf("Failed to find matching queue family\n");
 			return VK_RESULT_MAX_ENUM;
 		}
 
+		// a transfer only family maps to the dma engines which copy concurrently to rendering
+		for (uint32_t i = 0; i < queueFamilyCount && transfer.familyIndex == UINT32_MAX; ++i)
+		{
+			const VkQueueFamilyProperties& family = queueFamilies[i];
+
+			if (family.queueCount > 0u
+				&& (family.queueFlags & VK_QUEUE_TRANSFER_BIT)
+				&& (family.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == 0u
+				// the panorama upload copies rows of arbitrary width
+				&& family.minImageTransferGranularity.width <= 1u && family.minImageTransferGranularity.height <= 1u
+				)
+			{
+				transfer.familyIndex = i;
+			}
+		}
+
+		m_dedicatedTransfer = transfer.familyIndex != UINT32_MAX;
+
 		if (m_debugOutputEnabled)
 		{
-			printf("Selected queue index %u\n", m_queueFamilyIndex);
+			printf("Selected queue index %u\n", graphics.familyIndex);
+			if (m_dedicatedTransfer)
+			{
+				printf("Selected transfer queue index %u\n", transfer.familyIndex);
+			}
 		}
 
 		float queuePriority = 1.0f;
-		VkDeviceQueueCreateInfo queueCreateInfo{};
-		queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-		queueCreateInfo.queueFamilyIndex = m_queueFamilyIndex;
-		queueCreateInfo.queueCount = 1u;
-		queueCreateInfo.pQueuePriorities = &queuePriority;
+		VkDeviceQueueCreateInfo queueCreateInfos[2] = {};
+		for (uint32_t i = 0u; i < 2u; ++i)
+		{
+			queueCreateInfos[i].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+			queueCreateInfos[i].queueFamilyIndex = m_queues[i].familyIndex;
+			queueCreateInfos[i].queueCount = 1u;
+			queueCreateInfos[i].pQueuePriorities = &queuePriority;
+		}
+
+		// TODO: fill required device features
+		m_enabledFeatures = VkPhysicalDeviceFeatures{};
+		// optional, used by the compute filter path
+		m_enabledFeatures.shaderStorageImageArrayDynamicIndexing = m_deviceFeatures.shaderStorageImageArrayDynamicIndexing;
+		// optional, lets the compute filter store the output format instead of rgba32f
+		m_enabledFeatures.shaderStorageImageWriteWithoutFormat = m_deviceFeatures.shaderStorageImageWriteWithoutFormat;
 
-		VkPhysicalDeviceFeatures deviceFeatures{}; // TODO: fill required device features
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+		timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+
+		if (m_instanceVersion >= VK_API_VERSION_1_2 && m_deviceProperties.apiVersion >= VK_API_VERSION_1_2)
+		{
+			PFN_vkGetPhysicalDeviceFeatures2 getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2>(vkGetInstanceProcAddr(m_instance, "vkGetPhysicalDeviceFeatures2"));
+			if (getFeatures2 != nullptr)
+			{
+				VkPhysicalDeviceFeatures2 features2{};
+				features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+				features2.pNext = &timelineFeatures;
+				getFeatures2(m_physicalDevice, &features2);
+			}
+		}
 
 		VkDeviceCreateInfo deviceCreateInfo{};
 		deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-		deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-		deviceCreateInfo.queueCreateInfoCount = 1u;
-		deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
+		deviceCreateInfo.pNext = timelineFeatures.timelineSemaphore ? &timelineFeatures : nullptr;
+		deviceCreateInfo.pQueueCreateInfos = queueCreateInfos;
+		deviceCreateInfo.queueCreateInfoCount = m_dedicatedTransfer ? 2u : 1u;
+		deviceCreateInfo.pEnabledFeatures = &m_enabledFeatures;
 		deviceCreateInfo.enabledExtensionCount = 0u;
 
 		if ((res = vkCreateDevice(m_physicalDevice, &deviceCreateInfo, nullptr, &m_logicalDevice)) != VK_SUCCESS)
@@ -187,21 +246,77 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		{
 			printf("Logical device created\n");
 		}
-		vkGetDeviceQueue(m_logicalDevice, m_queueFamilyIndex, 0, &m_queue);
+
+		const uint32_t queueCount = m_dedicatedTransfer ? 2u : 1u;
+		for (uint32_t i = 0u; i < queueCount; ++i)
+		{
+			vkGetDeviceQueue(m_logicalDevice, m_queues[i].familyIndex, 0, &m_queues[i].queue);
+		}
+
+		m_memoryArena.initialize(m_logicalDevice, m_memoryProperties, m_deviceProperties.limits.nonCoherentAtomSize);
+
+		if (timelineFeatures.timelineSemaphore)
+		{
+			m_vkWaitSemaphores = reinterpret_cast<PFN_vkWaitSemaphores>(vkGetDeviceProcAddr(m_logicalDevice, "vkWaitSemaphores"));
+			m_vkGetSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValue>(vkGetDeviceProcAddr(m_logicalDevice, "vkGetSemaphoreCounterValue"));
+
+			VkSemaphoreTypeCreateInfo typeInfo{};
+			typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+			typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+			typeInfo.initialValue = 0u;
+
+			VkSemaphoreCreateInfo semaphoreInfo{};
+			semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+			semaphoreInfo.pNext = &typeInfo;
+
+			// one timeline per queue, signals of different queues are not ordered
+			for (uint32_t i = 0u; i < queueCount && m_vkWaitSemaphores != nullptr && m_vkGetSemaphoreCounterValue != nullptr; ++i)
+			{
+				if (vkCreateSemaphore(m_logicalDevice, &semaphoreInfo, nullptr, &m_queues[i].timeline) != VK_SUCCESS)
+				{
+					m_queues[i].timeline = VK_NULL_HANDLE;
+				}
+			}
+
+			// cross queue waits need both timelines, otherwise all queues use fences
+			if (graphics.timeline == VK_NULL_HANDLE || (m_dedicatedTransfer && transfer.timeline == VK_NULL_HANDLE))
+			{
+				for (SubmissionQueue& queue : m_queues)
+				{
+					if (queue.timeline != VK_NULL_HANDLE)
+					{
+						vkDestroySemaphore(m_logicalDevice, queue.timeline, nullptr);
+						queue.timeline = VK_NULL_HANDLE;
+					}
+				}
+			}
+		}
+
+		for (SubmissionQueue& queue : m_queues)
+		{
+			queue.submittedValue = 0u;
+			queue.completedValue = 0u;
+		}
+
+		if (m_debugOutputEnabled)
+		{
+			printf("Submissions tracked with %s\n", graphics.timeline != VK_NULL_HANDLE ? "timeline semaphores" : "fences");
+		}
 	}
 
 	//
 	// Create command pool
 	//
 
+	for (uint32_t i = 0u, queueCount = m_dedicatedTransfer ? 2u : 1u; i < queueCount; ++i)
 	{
 		VkCommandPoolCreateInfo cmdPoolCreateInfo{};
 		cmdPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		cmdPoolCreateInfo.pNext = nullptr;
 		cmdPoolCreateInfo.flags = /*VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | */VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		cmdPoolCreateInfo.queueFamilyIndex = m_queueFamilyIndex;
+		cmdPoolCreateInfo.queueFamilyIndex = m_queues[i].familyIndex;
 
-		if ((res = vkCreateCommandPool(m_logicalDevice, &cmdPoolCreateInfo, nullptr, &m_commandPool)) != VK_SUCCESS)
+		if ((res = vkCreateCommandPool(m_logicalDevice, &cmdPoolCreateInfo, nullptr, &m_queues[i].commandPool)) != VK_SUCCESS)
 		{
 			printf("Failed to create command pool [%u]\n", res);
 			return res;
@@ -261,13 +376,36 @@ VkResult IBLLib::vkHelper::initialize(uint32_t _phyDeviceIndex, uint32_t _descri
 		VkPipelineCacheCreateInfo pipelineCacheCreateInfo{};
 		pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
 
+		m_pipelineCachePath = getExecutableDirectory() + g_PipelineCacheFileName;
+
 		std::vector<char> cache;
-		if (readFile(g_PipelineCachePath, cache))
+		if (readFile(m_pipelineCachePath.c_str(), cache))
 		{
-			printf("Vulkan pipeline cache loaded\n");
-			
-			pipelineCacheCreateInfo.initialDataSize = static_cast<uint32_t>(cache.size());
-			pipelineCacheCreateInfo.pInitialData = cache.data();
+			// header version one: length, version, vendorID, deviceID, pipelineCacheUUID
+			const size_t headerSize = 16u + VK_UUID_SIZE;
+			uint32_t header[4] = {};
+
+			if (cache.size() >= headerSize)
+			{
+				memcpy(header, cache.data(), sizeof(header));
+			}
+
+			// ignore caches written by a different device or driver
+			if (cache.size() >= headerSize &&
+				header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+				header[2] == m_deviceProperties.vendorID &&
+				header[3] == m_deviceProperties.deviceID &&
+				memcmp(cache.data() + 16u, m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0)
+			{
+				printf("Vulkan pipeline cache loaded\n");
+
+				pipelineCacheCreateInfo.initialDataSize = cache.size();
+				pipelineCacheCreateInfo.pInitialData = cache.data();
+			}
+			else
+			{
+				printf("Vulkan pipeline cache %s is incompatible, ignoring it\n", m_pipelineCachePath.c_str());
+			}
 		}
 
 		if ((res = vkCreatePipelineCache(m_logicalDevice, &pipelineCacheCreateInfo, nullptr, &m_pipelineCache)) != VK_SUCCESS)
@@ -284,6 +422,9 @@ void IBLLib::vkHelper::shutdown()
 {
 	if (m_logicalDevice != VK_NULL_HANDLE)
 	{
+		// submissions are not waited for individually, nothing may be in flight when resources go away
+		vkDeviceWaitIdle(m_logicalDevice);
+
 		// clear framebuffer
 		for (const VkFramebuffer& framebuf : m_frameBuffers)
 		{
@@ -298,19 +439,21 @@ void IBLLib::vkHelper::shutdown()
 		m_samplers.clear();
 
 		// clear images
-		for (Image& img : m_images)
+		for (auto& img : m_images)
 		{
-			img.destroy(m_logicalDevice);
+			img.second.destroy(m_logicalDevice, m_memoryArena);
 		}
 		m_images.clear();
 
 		// clear buffers
-		for (Buffer& buf : m_buffers)
+		for (auto& buf : m_buffers)
 		{
-			buf.destroy(m_logicalDevice);
+			buf.second.destroy(m_logicalDevice, m_memoryArena);
 		}
 		m_buffers.clear();
 
+		m_memoryArena.shutdown();
+
 		// clear pipelines
 		for (const VkPipeline& pipeline : m_pipelines)
 		{
@@ -353,9 +496,9 @@ void IBLLib::vkHelper::shutdown()
 
 				if (vkGetPipelineCacheData(m_logicalDevice, m_pipelineCache, &bytes, cache.data()) == VK_SUCCESS)
 				{
-					if (writeFile(g_PipelineCachePath, cache))
+					if (writeFile(m_pipelineCachePath.c_str(), cache))
 					{
-						printf("Stored %s [%zukb]\n", g_PipelineCachePath, cache.size() / 1000u);
+						printf("Stored %s [%zukb]\n", m_pipelineCachePath.c_str(), cache.size() / 1000u);
 					}
 				}				
 			}
@@ -380,15 +523,39 @@ void IBLLib::vkHelper::shutdown()
 		}
 		m_shaderModules.clear();
 
-		if (m_commandPool != VK_NULL_HANDLE)
+		for (SubmissionQueue& queue : m_queues)
 		{
-			vkDestroyCommandPool(m_logicalDevice, m_commandPool, nullptr);
-			if (m_debugOutputEnabled)
+			if (queue.timeline != VK_NULL_HANDLE)
+			{
+				vkDestroySemaphore(m_logicalDevice, queue.timeline, nullptr);
+				queue.timeline = VK_NULL_HANDLE;
+			}
+
+			for (const PendingSubmission& submission : queue.pendingSubmissions)
+			{
+				vkDestroyFence(m_logicalDevice, submission.fence, nullptr);
+			}
+			queue.pendingSubmissions.clear();
+
+			for (const VkFence& fence : queue.freeFences)
+			{
+				vkDestroyFence(m_logicalDevice, fence, nullptr);
+			}
+			queue.freeFences.clear();
+
+			if (queue.commandPool != VK_NULL_HANDLE)
 			{
-				printf("Vulkan command pool destroyed\n");
+				vkDestroyCommandPool(m_logicalDevice, queue.commandPool, nullptr);
+				if (m_debugOutputEnabled)
+				{
+					printf("Vulkan command pool destroyed\n");
+				}
+				queue.commandPool = VK_NULL_HANDLE;
 			}
-			m_commandPool = VK_NULL_HANDLE;
+
+			queue.queue = VK_NULL_HANDLE;
 		}
+		m_dedicatedTransfer = false;
 
 		vkDestroyDevice(m_logicalDevice, nullptr);
 		if (m_debugOutputEnabled)
@@ -409,16 +576,17 @@ void IBLLib::vkHelper::shutdown()
 	}
 }
 
-VkResult IBLLib::vkHelper::createCommandBuffer(VkCommandBuffer& _outCmdBuffer, VkCommandBufferLevel _level) const
+VkResult IBLLib::vkHelper::createCommandBuffer(VkCommandBuffer& _outCmdBuffer, VkCommandBufferLevel _level, QueueType _queue) const
 {
-	if (m_commandPool == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
+	const VkCommandPool commandPool = getQueue(_queue).commandPool;
+	if (commandPool == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
 
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = m_commandPool;
+	allocInfo.commandPool = commandPool;
 	allocInfo.level = _level;
 	allocInfo.commandBufferCount = 1u;
 
@@ -432,9 +600,10 @@ VkResult IBLLib::vkHelper::createCommandBuffer(VkCommandBuffer& _outCmdBuffer, V
 	return res;
 }
 
-VkResult IBLLib::vkHelper::createCommandBuffers(std::vector<VkCommandBuffer>& _outCmdBuffers, uint32_t _count, VkCommandBufferLevel _level) const
+VkResult IBLLib::vkHelper::createCommandBuffers(std::vector<VkCommandBuffer>& _outCmdBuffers, uint32_t _count, VkCommandBufferLevel _level, QueueType _queue) const
 {
-	if (m_commandPool == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
+	const VkCommandPool commandPool = getQueue(_queue).commandPool;
+	if (commandPool == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
@@ -443,7 +612,7 @@ VkResult IBLLib::vkHelper::createCommandBuffers(std::vector<VkCommandBuffer>& _o
 
 	VkCommandBufferAllocateInfo allocInfo{};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = m_commandPool;
+	allocInfo.commandPool = commandPool;
 	allocInfo.level = _level;
 	allocInfo.commandBufferCount = _count;
 
@@ -457,11 +626,12 @@ VkResult IBLLib::vkHelper::createCommandBuffers(std::vector<VkCommandBuffer>& _o
 	return res;
 }
 
-void IBLLib::vkHelper::destroyCommandBuffer(VkCommandBuffer _cmdBuffer) const
+void IBLLib::vkHelper::destroyCommandBuffer(VkCommandBuffer _cmdBuffer, QueueType _queue) const
 {
-	if (m_commandPool != VK_NULL_HANDLE && m_logicalDevice != VK_NULL_HANDLE)
+	const VkCommandPool commandPool = getQueue(_queue).commandPool;
+	if (commandPool != VK_NULL_HANDLE && m_logicalDevice != VK_NULL_HANDLE)
 	{
-		vkFreeCommandBuffers(m_logicalDevice, m_commandPool, 1u, &_cmdBuffer);
+		vkFreeCommandBuffers(m_logicalDevice, commandPool, 1u, &_cmdBuffer);
 	}
 }
 
@@ -531,78 +701,264 @@ VkResult IBLLib::vkHelper::endCommandBuffers(const std::vector<VkCommandBuffer>&
 	return res;
 }
 
-VkResult IBLLib::vkHelper::executeCommandBuffer(VkCommandBuffer _cmdBuffer) const
+VkResult IBLLib::vkHelper::executeCommandBuffer(VkCommandBuffer _cmdBuffer, QueueType _queue)
 {
-	return executeCommandBuffers({ _cmdBuffer });
+	return executeCommandBuffers({ _cmdBuffer }, _queue);
 }
 
-VkResult IBLLib::vkHelper::executeCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers) const
+VkResult IBLLib::vkHelper::executeCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers, QueueType _queue)
 {
-	if (m_queue == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
+	Submission submission{};
+	VkResult res = submitCommandBuffers(_cmdBuffers, submission, Submission{}, _queue);
+
+	if (res == VK_SUCCESS)
+	{
+		res = waitForSubmission(submission);
+	}
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::submitCommandBuffer(VkCommandBuffer _cmdBuffer, Submission& _outSubmission, const Submission& _waitSubmission, QueueType _queue)
+{
+	return submitCommandBuffers({ _cmdBuffer }, _outSubmission, _waitSubmission, _queue);
+}
+
+VkResult IBLLib::vkHelper::submitCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers, Submission& _outSubmission, const Submission& _waitSubmission, QueueType _queue)
+{
+	_outSubmission = Submission{};
+
+	SubmissionQueue& queue = getQueue(_queue);
+
+	if (queue.queue == VK_NULL_HANDLE || m_logicalDevice == VK_NULL_HANDLE)
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
 
 	VkResult res = VK_SUCCESS;
+	const uint64_t signalValue = queue.submittedValue + 1u;
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	submitInfo.pNext = nullptr;
+	submitInfo.commandBufferCount = static_cast<uint32_t>(_cmdBuffers.size());
+	submitInfo.pCommandBuffers = _cmdBuffers.data();
+
+	VkTimelineSemaphoreSubmitInfo timelineInfo{};
+	const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
 	VkFence fence = VK_NULL_HANDLE;
 
-	// create fence
+	const SubmissionQueue& waitQueue = getQueue(_waitSubmission.queue);
+
+	if (queue.timeline != VK_NULL_HANDLE)
 	{
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.pNext = nullptr;
-		fenceInfo.flags = 0u;
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1u;
+		timelineInfo.pSignalSemaphoreValues = &signalValue;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.signalSemaphoreCount = 1u;
+		submitInfo.pSignalSemaphores = &queue.timeline;
 
-		if ((res = vkCreateFence(m_logicalDevice, &fenceInfo, nullptr, &fence)) != VK_SUCCESS)
+		if (_waitSubmission.value > waitQueue.completedValue)
 		{
-			printf("Failed to end create fence [%u]\n", res);
-			return res;
+			timelineInfo.waitSemaphoreValueCount = 1u;
+			timelineInfo.pWaitSemaphoreValues = &_waitSubmission.value;
+			submitInfo.waitSemaphoreCount = 1u;
+			submitInfo.pWaitSemaphores = &waitQueue.timeline;
+			submitInfo.pWaitDstStageMask = &waitStage;
 		}
 	}
-
-	// submit
+	else
 	{
-		VkSubmitInfo submitInfo{};
-		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-		submitInfo.pNext = nullptr;
-		submitInfo.commandBufferCount = static_cast<uint32_t>(_cmdBuffers.size());
-		submitInfo.pCommandBuffers = _cmdBuffers.data();
+		// fences can not be waited on by the gpu, the host has to wait instead
+		if ((res = waitForSubmission(_waitSubmission)) != VK_SUCCESS)
+		{
+			return res;
+		}
 
-		if ((res = vkQueueSubmit(m_queue, 1u, &submitInfo, fence)) != VK_SUCCESS)
+		if (queue.freeFences.empty() == false)
 		{
-			if (res == VK_ERROR_DEVICE_LOST)
-			{
-				printf("Failed to submit queue [VK_ERROR_DEVICE_LOST]. Prefiltering likely exceeded the TDRDelay. Consider reducing the quality of sample, outputResolution, or mipLevels.\n");
-			}
-			else
+			fence = queue.freeFences.back();
+			queue.freeFences.pop_back();
+		}
+		else
+		{
+			VkFenceCreateInfo fenceInfo{};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			fenceInfo.pNext = nullptr;
+			fenceInfo.flags = 0u;
+
+			if ((res = vkCreateFence(m_logicalDevice, &fenceInfo, nullptr, &fence)) != VK_SUCCESS)
 			{
-				printf("Failed to submit queue [%d].\n", res);
+				printf("Failed to end create fence [%u]\n", res);
+				return res;
 			}
-			vkDestroyFence(m_logicalDevice, fence, nullptr);
-			return res;
 		}
-		if (m_debugOutputEnabled)
+	}
+
+	if ((res = vkQueueSubmit(queue.queue, 1u, &submitInfo, fence)) != VK_SUCCESS)
+	{
+		if (res == VK_ERROR_DEVICE_LOST)
+		{
+			printf("Failed to submit queue [VK_ERROR_DEVICE_LOST]. Prefiltering likely exceeded the TDRDelay. Consider reducing the quality of sample, outputResolution, or mipLevels.\n");
+		}
+		else
 		{
-			printf("Executing %u command buffers\n", submitInfo.commandBufferCount);
+			printf("Failed to submit queue [%d].\n", res);
 		}
+
+		if (fence != VK_NULL_HANDLE)
+		{
+			queue.freeFences.push_back(fence);
+		}
+		return res;
 	}
 
-	// wait / block for execution to be complete
-	if ((res = vkWaitForFences(m_logicalDevice, 1u, &fence, VK_TRUE, UINT64_MAX)) != VK_SUCCESS)
+	if (fence != VK_NULL_HANDLE)
 	{
-		printf("Failed to wait for fence [%u]\n", res);
+		queue.pendingSubmissions.push_back({ signalValue, fence });
 	}
 
-	if ((res = vkQueueWaitIdle(m_queue)) != VK_SUCCESS)
+	if (m_debugOutputEnabled)
 	{
-		printf("Failed to wait for queue [%u]\n", res);
+		printf("Executing %u command buffers\n", submitInfo.commandBufferCount);
 	}
 
-	vkDestroyFence(m_logicalDevice, fence, nullptr);
+	queue.submittedValue = signalValue;
+	_outSubmission.queue = resolveQueue(_queue);
+	_outSubmission.value = signalValue;
 
 	return res;
 }
 
+VkResult IBLLib::vkHelper::waitForSubmission(const Submission& _submission, uint64_t _timeout)
+{
+	SubmissionQueue& queue = getQueue(_submission.queue);
+
+	if (_submission.value <= queue.completedValue)
+	{
+		return VK_SUCCESS;
+	}
+
+	if (_submission.value > queue.submittedValue)
+	{
+		printf("Waiting for submission %llu that was never made\n", static_cast<unsigned long long>(_submission.value));
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	VkResult res = VK_SUCCESS;
+
+	if (queue.timeline != VK_NULL_HANDLE)
+	{
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1u;
+		waitInfo.pSemaphores = &queue.timeline;
+		waitInfo.pValues = &_submission.value;
+
+		if ((res = m_vkWaitSemaphores(m_logicalDevice, &waitInfo, _timeout)) == VK_SUCCESS)
+		{
+			queue.completedValue = _submission.value;
+		}
+		else if (res != VK_TIMEOUT)
+		{
+			printf("Failed to wait for submission [%u]\n", res);
+		}
+
+		return res;
+	}
+
+	return retireSubmissions(queue, _submission.value, _timeout);
+}
+
+bool IBLLib::vkHelper::isSubmissionComplete(const Submission& _submission)
+{
+	SubmissionQueue& queue = getQueue(_submission.queue);
+
+	if (_submission.value <= queue.completedValue)
+	{
+		return true;
+	}
+
+	if (queue.timeline != VK_NULL_HANDLE)
+	{
+		uint64_t value = 0u;
+		if (m_vkGetSemaphoreCounterValue(m_logicalDevice, queue.timeline, &value) == VK_SUCCESS)
+		{
+			queue.completedValue = std::max(queue.completedValue, value);
+		}
+		return _submission.value <= queue.completedValue;
+	}
+
+	return retireSubmissions(queue, _submission.value, 0u) == VK_SUCCESS;
+}
+
+VkResult IBLLib::vkHelper::retireSubmissions(SubmissionQueue& _queue, uint64_t _value, uint64_t _timeout)
+{
+	VkResult res = VK_SUCCESS;
+
+	// pending submissions are ordered by value, retire them front to back
+	size_t retired = 0u;
+	for (; retired < _queue.pendingSubmissions.size() && _queue.pendingSubmissions[retired].value <= _value; ++retired)
+	{
+		const PendingSubmission& submission = _queue.pendingSubmissions[retired];
+
+		res = _timeout == 0u ? vkGetFenceStatus(m_logicalDevice, submission.fence) : vkWaitForFences(m_logicalDevice, 1u, &submission.fence, VK_TRUE, _timeout);
+		if (res != VK_SUCCESS)
+		{
+			if (res != VK_NOT_READY && res != VK_TIMEOUT)
+			{
+				printf("Failed to wait for fence [%u]\n", res);
+			}
+			break;
+		}
+
+		vkResetFences(m_logicalDevice, 1u, &submission.fence);
+		_queue.freeFences.push_back(submission.fence);
+		_queue.completedValue = submission.value;
+	}
+
+	_queue.pendingSubmissions.erase(_queue.pendingSubmissions.begin(), _queue.pendingSubmissions.begin() + retired);
+
+	return res;
+}
+
+void IBLLib::vkHelper::releaseImage(VkCommandBuffer _cmdBuffer, VkImage _image,
+	VkImageLayout _oldLayout, VkImageLayout _newLayout,
+	VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess,
+	QueueType _srcQueue, QueueType _dstQueue,
+	VkImageSubresourceRange _subresourceRange) const
+{
+	const uint32_t srcFamily = getQueue(_srcQueue).familyIndex;
+	const uint32_t dstFamily = getQueue(_dstQueue).familyIndex;
+
+	// within one family the acquire barrier does the whole transition
+	if (srcFamily != dstFamily)
+	{
+		imageBarrier(_cmdBuffer, _image, _oldLayout, _newLayout, _srcStage, _srcAccess, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0u, _subresourceRange, srcFamily, dstFamily);
+	}
+}
+
+void IBLLib::vkHelper::acquireImage(VkCommandBuffer _cmdBuffer, VkImage _image,
+	VkImageLayout _oldLayout, VkImageLayout _newLayout,
+	VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess,
+	QueueType _srcQueue, QueueType _dstQueue,
+	VkImageSubresourceRange _subresourceRange) const
+{
+	const uint32_t srcFamily = getQueue(_srcQueue).familyIndex;
+	const uint32_t dstFamily = getQueue(_dstQueue).familyIndex;
+
+	if (srcFamily != dstFamily)
+	{
+		imageBarrier(_cmdBuffer, _image, _oldLayout, _newLayout, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0u, _dstStage, _dstAccess, _subresourceRange, srcFamily, dstFamily);
+	}
+	else
+	{
+		// the releasing work was submitted earlier on the same family, submission order covers it
+		imageBarrier(_cmdBuffer, _image, _oldLayout, _newLayout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_ACCESS_MEMORY_WRITE_BIT, _dstStage, _dstAccess, _subresourceRange);
+	}
+}
+
 VkResult IBLLib::vkHelper::loadShaderModule(VkShaderModule& _outShader, const uint32_t* _spvBlob, size_t _spvBlobByteSize)
 {
 	if (_spvBlobByteSize % sizeof(uint32_t) != 0u)
@@ -819,6 +1175,37 @@ VkResult IBLLib::vkHelper::createPipeline(VkPipeline& _outPipeline, const VkGrap
 	return res;
 }
 
+VkResult IBLLib::vkHelper::createComputePipeline(VkPipeline& _outPipeline, VkPipelineLayout _layout, VkShaderModule _shaderModule, const char* _entryPoint, const VkSpecializationInfo* _specInfo)
+{
+	if (m_logicalDevice == VK_NULL_HANDLE)
+	{
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	VkComputePipelineCreateInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	info.pNext = nullptr;
+	info.layout = _layout;
+	info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	info.stage.module = _shaderModule;
+	info.stage.pName = _entryPoint;
+	info.stage.pSpecializationInfo = _specInfo;
+
+	VkResult res = VK_SUCCESS;
+
+	if ((res = vkCreateComputePipelines(m_logicalDevice, m_pipelineCache, 1u, &info, nullptr, &_outPipeline)) != VK_SUCCESS)
+	{
+		_outPipeline = VK_NULL_HANDLE;
+		printf("Failed to create compute pipeline [%u]\n", res);
+		return res;
+	}
+
+	m_pipelines.emplace_back(_outPipeline);
+
+	return res;
+}
+
 VkResult IBLLib::vkHelper::createRenderPass(VkRenderPass& _outRenderPass, const VkRenderPassCreateInfo* _pCreateInfo)
 {
 	if (m_logicalDevice == VK_NULL_HANDLE)
@@ -850,7 +1237,7 @@ bool IBLLib::vkHelper::getMemoryTypeIndex(const VkMemoryRequirements& _requireme
 	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; ++i)
 	{
 		if ((_requirements.memoryTypeBits & (1 << i)) &&
-			(m_memoryProperties.memoryTypes[i].propertyFlags & _properties))
+			(m_memoryProperties.memoryTypes[i].propertyFlags & _properties) == _properties)
 		{
 			_outIndex = i;
 			return true;
@@ -860,7 +1247,7 @@ bool IBLLib::vkHelper::getMemoryTypeIndex(const VkMemoryRequirements& _requireme
 	return false;
 }
 
-VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, uint32_t _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags, VkSharingMode _sharingMode, VkBufferCreateFlags _flags)
+VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, VkDeviceSize _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags, VkSharingMode _sharingMode, VkBufferCreateFlags _flags)
 {
 	if (m_logicalDevice == VK_NULL_HANDLE)
 	{
@@ -873,7 +1260,7 @@ VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, uint32_
 	bufferInfo.size = _byteSize;
 	bufferInfo.usage = _usage;
 	bufferInfo.sharingMode = _sharingMode;
-	bufferInfo.pQueueFamilyIndices = &m_queueFamilyIndex;
+	bufferInfo.pQueueFamilyIndices = &getQueue(QueueType::Graphics).familyIndex;
 	bufferInfo.queueFamilyIndexCount = 1u;
 	bufferInfo.flags = _flags;
 
@@ -886,8 +1273,7 @@ VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, uint32_
 		return res;
 	}
 
-	m_buffers.emplace_back();
-	Buffer& buffer = m_buffers.back();
+	Buffer& buffer = m_buffers[_outBuffer];
 
 	buffer.buffer = _outBuffer;
 	buffer.info = bufferInfo;
@@ -895,24 +1281,20 @@ VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, uint32_
 	VkMemoryRequirements requirements{};
 	vkGetBufferMemoryRequirements(m_logicalDevice, _outBuffer, &requirements);
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.pNext = nullptr;
-	allocInfo.allocationSize = requirements.size;
-
-	if (getMemoryTypeIndex(requirements, _memoryFlags, allocInfo.memoryTypeIndex) == false)
+	uint32_t memoryTypeIndex = 0u;
+	if (getMemoryTypeIndex(requirements, _memoryFlags, memoryTypeIndex) == false)
 	{
-		printf("Unsupported memory requirements [%u]\n", res);
-		return res;
+		printf("Unsupported memory requirements [%u]\n", _memoryFlags);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
 	}
 
-	if ((res = vkAllocateMemory(m_logicalDevice, &allocInfo, nullptr, &buffer.memory)) != VK_SUCCESS)
+	if ((res = m_memoryArena.allocate(requirements, memoryTypeIndex, true, buffer.allocation)) != VK_SUCCESS)
 	{
 		printf("Failed to allocate buffer [%u]\n", res);
 		return res;
 	}
 
-	if ((res = vkBindBufferMemory(m_logicalDevice, _outBuffer, buffer.memory, 0u)) != VK_SUCCESS)
+	if ((res = vkBindBufferMemory(m_logicalDevice, _outBuffer, buffer.allocation.memory, buffer.allocation.offset)) != VK_SUCCESS)
 	{
 		printf("Failed to bind buffer memory [%u]\n", res);
 	}
@@ -920,23 +1302,50 @@ VkResult IBLLib::vkHelper::createBufferAndAllocate(VkBuffer& _outBuffer, uint32_
 	return res;
 }
 
+VkResult IBLLib::vkHelper::createReadbackBuffer(VkBuffer& _outBuffer, VkDeviceSize _byteSize, VkBufferUsageFlags _usage)
+{
+	// host coherent memory is usually uncached on discrete gpus, reading it back is slow
+	VkResult res = createBufferAndAllocate(_outBuffer, _byteSize, _usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+
+	if (res != VK_SUCCESS)
+	{
+		destroyBuffer(_outBuffer);
+		res = createBufferAndAllocate(_outBuffer, _byteSize, _usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	}
+
+	// host visible blocks are mapped by the arena, nothing else to do
+	return res;
+}
+
 void IBLLib::vkHelper::destroyBuffer(VkBuffer _buffer)
 {
 	if (m_logicalDevice != VK_NULL_HANDLE)
 	{
-		for (auto it = m_buffers.begin(), end = m_buffers.end(); it != end; ++it)
+		auto it = m_buffers.find(_buffer);
+		if (it != m_buffers.end())
 		{
-			if (it->buffer == _buffer)
-			{
-				it->destroy(m_logicalDevice);
-				m_buffers.erase(it);
-				break;
-			}
+			it->second.destroy(m_logicalDevice, m_memoryArena);
+			m_buffers.erase(it);
 		}
 	}
 }
 
 VkResult IBLLib::vkHelper::writeBufferData(VkBuffer _buffer, const void* _pData, size_t _bytes)
+{
+	void* data = nullptr;
+	VkResult res = mapBuffer(_buffer, data, _bytes);
+
+	if (res == VK_SUCCESS)
+	{
+		// write data
+		memcpy(data, _pData, _bytes);
+		unmapBuffer(_buffer);
+	}
+
+	return res;
+}
+
+VkResult IBLLib::vkHelper::readBufferData(VkBuffer _buffer, void* _pData, size_t _bytes, size_t _offset)
 {
 	VkResult res = VK_RESULT_MAX_ENUM;
 
@@ -945,60 +1354,56 @@ VkResult IBLLib::vkHelper::writeBufferData(VkBuffer _buffer, const void* _pData,
 		return res;
 	}
 
-	for (const Buffer& buf : m_buffers)
+	const Buffer* buf = findBuffer(_buffer);
+	if (buf == nullptr || buf->allocation.mapped == nullptr)
 	{
-		if (buf.buffer == _buffer && buf.memory != VK_NULL_HANDLE)
-		{
-			void* data = nullptr;
-			if ((res = vkMapMemory(m_logicalDevice, buf.memory, 0u, _bytes, 0, &data)) != VK_SUCCESS)
-			{
-				printf("Failed to map buffer memory [%u]\n", res);
-				return res;
-			}
+		printf("Not a valid host visible buffer\n");
+		return res;
+	}
 
-			// write data
-			memcpy(data, _pData, _bytes);
-			vkUnmapMemory(m_logicalDevice, buf.memory);
-			return res;
-		}
+	// cached memory has to be invalidated to see the gpu writes
+	if ((res = m_memoryArena.invalidate(buf->allocation)) != VK_SUCCESS)
+	{
+		printf("Failed to invalidate buffer memory [%u]\n", res);
+		return res;
 	}
 
-	printf("Not a valid buffer\n");
+	memcpy(_pData, static_cast<const uint8_t*>(buf->allocation.mapped) + _offset, _bytes);
 
 	return res;
 }
 
-VkResult IBLLib::vkHelper::readBufferData(VkBuffer _buffer, void* _pData, size_t _bytes, size_t _offset)
+VkResult IBLLib::vkHelper::mapBuffer(VkBuffer _buffer, void*& _outData, size_t _bytes, size_t _offset)
 {
 	VkResult res = VK_RESULT_MAX_ENUM;
+	_outData = nullptr;
 
 	if (m_logicalDevice == VK_NULL_HANDLE)
 	{
 		return res;
 	}
 
-	for (const Buffer& buf : m_buffers)
+	const Buffer* buf = findBuffer(_buffer);
+	if (buf == nullptr || buf->allocation.mapped == nullptr || _offset + _bytes > buf->allocation.size)
 	{
-		if (buf.buffer == _buffer && buf.memory != VK_NULL_HANDLE)
-		{
-			void* data = nullptr;
-			if ((res = vkMapMemory(m_logicalDevice, buf.memory, _offset, _bytes, 0, &data)) != VK_SUCCESS)
-			{
-				printf("Failed to map buffer memory [%u]\n", res);
-				return res;
-			}
-
-			// read data
-			memcpy(_pData, data, _bytes);			
-
-			vkUnmapMemory(m_logicalDevice, buf.memory);
-			return res;
-		}
+		printf("Not a valid host visible buffer\n");
+		return res;
 	}
 
-	printf("Not a valid buffer\n");
+	// host visible memory is mapped persistently, hand out the existing mapping
+	_outData = static_cast<uint8_t*>(buf->allocation.mapped) + _offset;
 
-	return res;
+	return VK_SUCCESS;
+}
+
+void IBLLib::vkHelper::unmapBuffer(VkBuffer _buffer)
+{
+	const Buffer* buf = findBuffer(_buffer);
+	if (buf != nullptr)
+	{
+		// make host writes to cached memory visible to the device
+		m_memoryArena.flush(buf->allocation);
+	}
 }
 
 VkResult IBLLib::vkHelper::createImage2DAndAllocate(
@@ -1036,8 +1441,7 @@ VkResult IBLLib::vkHelper::createImage2DAndAllocate(
 		return res;
 	}
 
-	m_images.emplace_back();
-	Image& img = m_images.back();
+	Image& img = m_images[_outImage];
 
 	img.image = _outImage;
 	img.info = imageInfo;
@@ -1045,24 +1449,20 @@ VkResult IBLLib::vkHelper::createImage2DAndAllocate(
 	VkMemoryRequirements requirements{};
 	vkGetImageMemoryRequirements(m_logicalDevice, _outImage, &requirements);
 
-	VkMemoryAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.pNext = nullptr;
-	allocInfo.allocationSize = requirements.size;
-
-	if (getMemoryTypeIndex(requirements, _memoryFlags, allocInfo.memoryTypeIndex) == false)
+	uint32_t memoryTypeIndex = 0u;
+	if (getMemoryTypeIndex(requirements, _memoryFlags, memoryTypeIndex) == false)
 	{
-		printf("Unsupported memory requirements [%u]\n", res);
-		return res;
+		printf("Unsupported memory requirements [%u]\n", _memoryFlags);
+		return VK_ERROR_FEATURE_NOT_PRESENT;
 	}
 
-	if ((res = vkAllocateMemory(m_logicalDevice, &allocInfo, nullptr, &img.memory)) != VK_SUCCESS)
+	if ((res = m_memoryArena.allocate(requirements, memoryTypeIndex, _tiling == VK_IMAGE_TILING_LINEAR, img.allocation)) != VK_SUCCESS)
 	{
 		printf("Failed to allocate image [%u]\n", res);
 		return res;
 	}
 
-	if ((res = vkBindImageMemory(m_logicalDevice, _outImage, img.memory, 0u)) != VK_SUCCESS)
+	if ((res = vkBindImageMemory(m_logicalDevice, _outImage, img.allocation.memory, img.allocation.offset)) != VK_SUCCESS)
 	{
 		printf("Failed to bind image memory [%u]\n", res);
 	}
@@ -1070,7 +1470,7 @@ VkResult IBLLib::vkHelper::createImage2DAndAllocate(
 	return res;
 }
 
-void IBLLib::vkHelper::Image::destroy(VkDevice _device)
+void IBLLib::vkHelper::Image::destroy(VkDevice _device, MemoryArena& _arena)
 {
 	for (const VkImageView& view : views)
 	{
@@ -1084,14 +1484,10 @@ void IBLLib::vkHelper::Image::destroy(VkDevice _device)
 		image = VK_NULL_HANDLE;
 	}
 
-	if (memory != VK_NULL_HANDLE)
-	{
-		vkFreeMemory(_device, memory, nullptr);
-		memory = VK_NULL_HANDLE;
-	}
+	_arena.free(allocation);
 }
 
-void IBLLib::vkHelper::Buffer::destroy(VkDevice _device)
+void IBLLib::vkHelper::Buffer::destroy(VkDevice _device, MemoryArena& _arena)
 {
 	if (buffer != VK_NULL_HANDLE)
 	{
@@ -1099,25 +1495,36 @@ void IBLLib::vkHelper::Buffer::destroy(VkDevice _device)
 		buffer = VK_NULL_HANDLE;
 	}
 
-	if (memory != VK_NULL_HANDLE)
-	{
-		vkFreeMemory(_device, memory, nullptr);
-		memory = VK_NULL_HANDLE;
-	}
+	_arena.free(allocation);
+}
+
+IBLLib::vkHelper::Buffer* IBLLib::vkHelper::findBuffer(VkBuffer _buffer)
+{
+	auto it = m_buffers.find(_buffer);
+	return it != m_buffers.end() ? &it->second : nullptr;
+}
+
+IBLLib::vkHelper::Image* IBLLib::vkHelper::findImage(VkImage _image)
+{
+	auto it = m_images.find(_image);
+	return it != m_images.end() ? &it->second : nullptr;
+}
+
+const IBLLib::vkHelper::Image* IBLLib::vkHelper::findImage(VkImage _image) const
+{
+	auto it = m_images.find(_image);
+	return it != m_images.end() ? &it->second : nullptr;
 }
 
 void IBLLib::vkHelper::destroyImage(VkImage _image)
 {
 	if (m_logicalDevice != VK_NULL_HANDLE)
 	{
-		for (auto it = m_images.begin(), end = m_images.end(); it != end; ++it)
+		auto it = m_images.find(_image);
+		if (it != m_images.end())
 		{
-			if (it->image == _image)
-			{
-				it->destroy(m_logicalDevice);
-				m_images.erase(it);
-				break;
-			}
+			it->second.destroy(m_logicalDevice, m_memoryArena);
+			m_images.erase(it);
 		}
 	}
 }
@@ -1129,90 +1536,84 @@ VkResult IBLLib::vkHelper::createImageView(VkImageView& _outView, VkImage _image
 		return VK_RESULT_MAX_ENUM;
 	}
 
-	for (Image& img : m_images)
+	Image* img = findImage(_image);
+	if (img == nullptr)
 	{
-		if (img.image == _image)
-		{
-			VkImageViewCreateInfo info{};
-			info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-			info.pNext = nullptr;
-			info.format = _format == VK_FORMAT_UNDEFINED ? img.info.format : _format;
-			info.flags = 0u;
-			info.image = _image;
-			info.components = _swizzle;
-			info.viewType = _type;
-			info.subresourceRange = _range;
+		return VK_RESULT_MAX_ENUM;
+	}
 
-			VkResult res = vkCreateImageView(m_logicalDevice, &info, nullptr, &_outView);
+	VkImageViewCreateInfo info{};
+	info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+	info.pNext = nullptr;
+	info.format = _format == VK_FORMAT_UNDEFINED ? img->info.format : _format;
+	info.flags = 0u;
+	info.image = _image;
+	info.components = _swizzle;
+	info.viewType = _type;
+	info.subresourceRange = _range;
 
-			if (res == VK_SUCCESS)
-			{
-				img.views.emplace_back(_outView);			
-			}
-			else
-			{
-				printf("Failed to create image view [%u]\n", res);
-			}
+	VkResult res = vkCreateImageView(m_logicalDevice, &info, nullptr, &_outView);
 
-			return res;
-		}
+	if (res == VK_SUCCESS)
+	{
+		img->views.emplace_back(_outView);			
+	}
+	else
+	{
+		printf("Failed to create image view [%u]\n", res);
 	}
 
-	return VK_RESULT_MAX_ENUM;
+	return res;
 }
 
 void IBLLib::vkHelper::copyBufferToBasicImage2D(VkCommandBuffer _cmdBuffer, VkBuffer _src, VkImage _dst) const
 {
-	for (const Image& img : m_images)
+	const Image* img = findImage(_dst);
+	if (img == nullptr)
 	{
-		if (img.image == _dst)
-		{
-			VkBufferImageCopy region{};
-			region.bufferOffset = 0u;
-			region.bufferRowLength = 0u;
-			region.bufferImageHeight = 0u;
+		return;
+	}
 
-			region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			region.imageSubresource.mipLevel = 0u;
-			region.imageSubresource.baseArrayLayer = 0u;
-			region.imageSubresource.layerCount = img.info.arrayLayers;// 1u;
+	VkBufferImageCopy region{};
+	region.bufferOffset = 0u;
+	region.bufferRowLength = 0u;
+	region.bufferImageHeight = 0u;
 
-			region.imageOffset = { 0, 0, 0 };
-			region.imageExtent = img.info.extent;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.mipLevel = 0u;
+	region.imageSubresource.baseArrayLayer = 0u;
+	region.imageSubresource.layerCount = img->info.arrayLayers;// 1u;
 
-			vkCmdCopyBufferToImage(_cmdBuffer, _src, _dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &region);
-			return;
-		}
-	}
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = img->info.extent;
+
+	vkCmdCopyBufferToImage(_cmdBuffer, _src, _dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1u, &region);
 }
 
 void IBLLib::vkHelper::copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, VkImageSubresourceLayers _imageSubresource) const
 {
-	for (const Image& img : m_images)
+	const Image* img = findImage(_src);
+	if (img == nullptr)
 	{
-		if (img.image == _src)
-		{
-			VkBufferImageCopy region{};
-			region.bufferOffset = 0u;
-			region.bufferRowLength = 0u;
-			region.bufferImageHeight = 0u;
+		printf("image not found\n");
+		return;
+	}
 
-			region.imageSubresource = _imageSubresource;
+	VkBufferImageCopy region{};
+	region.bufferOffset = 0u;
+	region.bufferRowLength = 0u;
+	region.bufferImageHeight = 0u;
 
-			region.imageOffset = { 0, 0, 0 };
-			region.imageExtent = img.info.extent;
-		
-			vkCmdCopyImageToBuffer(_cmdBuffer, _src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-				_dst,	//	VkBuffer
-				1u,		//	uint32_t  regionCount,
-				&region	//	const VkBufferImageCopy* pRegions);
-				);
+	region.imageSubresource = _imageSubresource;
 
-			return;
-		}
-	}
+	region.imageOffset = { 0, 0, 0 };
+	region.imageExtent = img->info.extent;
 
-	printf("image not found\n");
+	vkCmdCopyImageToBuffer(_cmdBuffer, _src, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		_dst,	//	VkBuffer
+		1u,		//	uint32_t  regionCount,
+		&region	//	const VkBufferImageCopy* pRegions);
+		);
 }
 
 void IBLLib::vkHelper::copyImage2DToBuffer(VkCommandBuffer _cmdBuffer, VkImage _src, VkBuffer _dst, const VkBufferImageCopy& _region) const
@@ -1227,14 +1628,15 @@ void IBLLib::vkHelper::imageBarrier(VkCommandBuffer _cmdBuffer, VkImage _image,
 									VkImageLayout oldLayout, VkImageLayout newLayout, 
 									VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess, 
 									VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess, 
-									VkImageSubresourceRange _subresourceRange) const
+									VkImageSubresourceRange _subresourceRange,
+									uint32_t _srcQueueFamily, uint32_t _dstQueueFamily) const
 {
 	VkImageMemoryBarrier barrier{};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout = oldLayout;
 	barrier.newLayout = newLayout;
-	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.srcQueueFamilyIndex = _srcQueueFamily;
+	barrier.dstQueueFamilyIndex = _dstQueueFamily;
 	barrier.image = _image;
 	barrier.subresourceRange = _subresourceRange;
 	barrier.srcAccessMask = _srcAccess;
@@ -1284,15 +1686,29 @@ VkResult IBLLib::vkHelper::createFramebuffer(VkFramebuffer& _outFramebuffer, VkR
 
 VkResult IBLLib::vkHelper::createFramebuffer(VkFramebuffer& _outFramebuffer, VkRenderPass _renderPass, VkImage _image)
 {
-	for (const Image& img : m_images)
+	const Image* img = findImage(_image);
+	if (img == nullptr)
 	{
-		if (img.image == _image)
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	return createFramebuffer(_outFramebuffer, _renderPass, img->info.extent.width, img->info.extent.height, img->views, img->info.arrayLayers);
+}
+
+void IBLLib::vkHelper::destroyFramebuffer(VkFramebuffer _framebuffer)
+{
+	if (m_logicalDevice != VK_NULL_HANDLE)
+	{
+		for (auto it = m_frameBuffers.begin(), end = m_frameBuffers.end(); it != end; ++it)
 		{
-			return createFramebuffer(_outFramebuffer, _renderPass, img.info.extent.width, img.info.extent.height, img.views, img.info.arrayLayers);
+			if (*it == _framebuffer)
+			{
+				vkDestroyFramebuffer(m_logicalDevice, _framebuffer, nullptr);
+				m_frameBuffers.erase(it);
+				break;
+			}
 		}
 	}
-
-	return VK_RESULT_MAX_ENUM;
 }
 
 void IBLLib::vkHelper::beginRenderPass(VkCommandBuffer _cmdBuffer, VkRenderPass _renderPass, VkFramebuffer _framebuffer, const VkRect2D& _area, const std::vector<VkClearValue>& _clearValues, VkSubpassContents _contents) const
@@ -1309,6 +1725,24 @@ void IBLLib::vkHelper::beginRenderPass(VkCommandBuffer _cmdBuffer, VkRenderPass
 	vkCmdBeginRenderPass(_cmdBuffer, &info, _contents);
 }
 
+void IBLLib::vkHelper::setViewportAndScissor(VkCommandBuffer _cmdBuffer, VkExtent2D _extent) const
+{
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)_extent.width;
+	viewport.height = (float)_extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = _extent;
+
+	vkCmdSetViewport(_cmdBuffer, 0u, 1u, &viewport);
+	vkCmdSetScissor(_cmdBuffer, 0u, 1u, &scissor);
+}
+
 void IBLLib::vkHelper::fillSamplerCreateInfo(VkSamplerCreateInfo& _samplerInfo)
 {
 	_samplerInfo.magFilter = VK_FILTER_LINEAR;
@@ -1356,17 +1790,290 @@ VkResult IBLLib::vkHelper::createSampler(VkSampler& _outSampler, VkSamplerCreate
 	return res;
 }
 
+VkFormatFeatureFlags IBLLib::vkHelper::getOptimalTilingFeatures(VkFormat _format) const
+{
+	VkFormatProperties properties{};
+	vkGetPhysicalDeviceFormatProperties(m_physicalDevice, _format, &properties);
+	return properties.optimalTilingFeatures;
+}
+
 const VkImageCreateInfo* IBLLib::vkHelper::getCreateInfo(const VkImage _image)
 {
-	for (const Image& img : m_images)
+	const Image* img = findImage(_image);
+	return img != nullptr ? &img->info : nullptr;
+}
+
+namespace
+{
+	VkDeviceSize alignUp(VkDeviceSize _value, VkDeviceSize _alignment)
+	{
+		return (_value + _alignment - 1u) / _alignment * _alignment;
+	}
+} // !anonymous namespace
+
+void IBLLib::MemoryArena::initialize(VkDevice _device, const VkPhysicalDeviceMemoryProperties& _properties, VkDeviceSize _nonCoherentAtomSize, VkDeviceSize _blockSize)
+{
+	m_device = _device;
+	m_properties = _properties;
+	m_nonCoherentAtomSize = _nonCoherentAtomSize > 0u ? _nonCoherentAtomSize : 1u;
+	m_blockSize = _blockSize;
+
+	m_pools.clear();
+	m_pools.resize(2u * m_properties.memoryTypeCount);
+	for (uint32_t i = 0u; i < m_pools.size(); ++i)
+	{
+		m_pools[i].memoryTypeIndex = i / 2u;
+	}
+}
+
+void IBLLib::MemoryArena::shutdown()
+{
+	for (Pool& pool : m_pools)
+	{
+		for (Block& block : pool.blocks)
+		{
+			destroyBlock(block);
+		}
+		pool.blocks.clear();
+	}
+	m_pools.clear();
+	m_device = VK_NULL_HANDLE;
+}
+
+VkResult IBLLib::MemoryArena::createBlock(Pool& _pool, VkDeviceSize _size, bool _dedicated)
+{
+	VkMemoryAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.pNext = nullptr;
+	allocInfo.allocationSize = _size;
+	allocInfo.memoryTypeIndex = _pool.memoryTypeIndex;
+
+	Block block{};
+	block.size = _size;
+	block.dedicated = _dedicated;
+
+	VkResult res = VK_SUCCESS;
+	if ((res = vkAllocateMemory(m_device, &allocInfo, nullptr, &block.memory)) != VK_SUCCESS)
+	{
+		printf("Failed to allocate memory block [%u]\n", res);
+		return res;
+	}
+
+	// a VkDeviceMemory can only be mapped once, so the whole block is mapped up front
+	if (m_properties.memoryTypes[_pool.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		if ((res = vkMapMemory(m_device, block.memory, 0u, VK_WHOLE_SIZE, 0, &block.mapped)) != VK_SUCCESS)
+		{
+			printf("Failed to map memory block [%u]\n", res);
+			vkFreeMemory(m_device, block.memory, nullptr);
+			return res;
+		}
+	}
+
+	block.freeRanges.push_back({ 0u, _size });
+	_pool.blocks.push_back(std::move(block));
+
+	return res;
+}
+
+void IBLLib::MemoryArena::destroyBlock(Block& _block)
+{
+	if (_block.memory != VK_NULL_HANDLE)
 	{
-		if (img.image == _image)
+		if (_block.mapped != nullptr)
 		{
-			return &img.info;
+			vkUnmapMemory(m_device, _block.memory);
+			_block.mapped = nullptr;
 		}
+		vkFreeMemory(m_device, _block.memory, nullptr);
+		_block.memory = VK_NULL_HANDLE;
 	}
+}
+
+bool IBLLib::MemoryArena::suballocate(Block& _block, VkDeviceSize _size, VkDeviceSize _alignment, VkDeviceSize& _outOffset)
+{
+	// first fit
+	for (size_t i = 0u; i < _block.freeRanges.size(); ++i)
+	{
+		const Range range = _block.freeRanges[i];
+		const VkDeviceSize offset = alignUp(range.offset, _alignment);
+		const VkDeviceSize end = range.offset + range.size;
+
+		if (offset + _size > end)
+		{
+			continue;
+		}
 
-	return nullptr;
+		// keep the padding in front and the remainder behind the allocation free
+		_block.freeRanges.erase(_block.freeRanges.begin() + i);
+		if (offset + _size < end)
+		{
+			_block.freeRanges.insert(_block.freeRanges.begin() + i, { offset + _size, end - offset - _size });
+		}
+		if (offset > range.offset)
+		{
+			_block.freeRanges.insert(_block.freeRanges.begin() + i, { range.offset, offset - range.offset });
+		}
+
+		++_block.allocationCount;
+		_outOffset = offset;
+		return true;
+	}
+
+	return false;
+}
+
+VkResult IBLLib::MemoryArena::allocate(const VkMemoryRequirements& _requirements, uint32_t _memoryTypeIndex, bool _linear, Allocation& _outAllocation)
+{
+	if (m_device == VK_NULL_HANDLE || _memoryTypeIndex >= m_properties.memoryTypeCount)
+	{
+		return VK_RESULT_MAX_ENUM;
+	}
+
+	const uint32_t poolIndex = 2u * _memoryTypeIndex + (_linear ? 1u : 0u);
+	Pool& pool = m_pools[poolIndex];
+
+	const bool coherent = (m_properties.memoryTypes[_memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0u;
+
+	// non coherent allocations are padded to whole atoms so flushing one never touches a neighbour
+	VkDeviceSize alignment = _requirements.alignment > 0u ? _requirements.alignment : 1u;
+	VkDeviceSize size = _requirements.size;
+	if (coherent == false)
+	{
+		alignment = alignUp(alignment, m_nonCoherentAtomSize);
+		size = alignUp(size, m_nonCoherentAtomSize);
+	}
+
+	VkResult res = VK_SUCCESS;
+	VkDeviceSize offset = 0u;
+	Block* block = nullptr;
+
+	if (size > m_blockSize / 2u)
+	{
+		// large resources get a block of their own which is released with them
+		if ((res = createBlock(pool, size, true)) != VK_SUCCESS)
+		{
+			return res;
+		}
+		block = &pool.blocks.back();
+		suballocate(*block, size, alignment, offset);
+	}
+	else
+	{
+		for (Block& candidate : pool.blocks)
+		{
+			if (candidate.dedicated == false && suballocate(candidate, size, alignment, offset))
+			{
+				block = &candidate;
+				break;
+			}
+		}
+
+		if (block == nullptr)
+		{
+			if ((res = createBlock(pool, m_blockSize, false)) != VK_SUCCESS)
+			{
+				return res;
+			}
+			block = &pool.blocks.back();
+			suballocate(*block, size, alignment, offset);
+		}
+	}
+
+	_outAllocation.memory = block->memory;
+	_outAllocation.offset = offset;
+	_outAllocation.size = size;
+	_outAllocation.mapped = block->mapped != nullptr ? static_cast<uint8_t*>(block->mapped) + offset : nullptr;
+	_outAllocation.coherent = coherent;
+	_outAllocation.pool = poolIndex;
+
+	return res;
+}
+
+void IBLLib::MemoryArena::free(Allocation& _allocation)
+{
+	if (_allocation.memory == VK_NULL_HANDLE || _allocation.pool >= m_pools.size())
+	{
+		return;
+	}
+
+	Pool& pool = m_pools[_allocation.pool];
+
+	for (auto it = pool.blocks.begin(), end = pool.blocks.end(); it != end; ++it)
+	{
+		Block& block = *it;
+		if (block.memory != _allocation.memory)
+		{
+			continue;
+		}
+
+		// insert sorted and merge with the neighbouring free ranges
+		auto next = block.freeRanges.begin();
+		while (next != block.freeRanges.end() && next->offset < _allocation.offset)
+		{
+			++next;
+		}
+		next = block.freeRanges.insert(next, { _allocation.offset, _allocation.size });
+
+		auto following = next + 1;
+		if (following != block.freeRanges.end() && next->offset + next->size == following->offset)
+		{
+			next->size += following->size;
+			block.freeRanges.erase(following);
+		}
+		if (next != block.freeRanges.begin())
+		{
+			auto previous = next - 1;
+			if (previous->offset + previous->size == next->offset)
+			{
+				previous->size += next->size;
+				block.freeRanges.erase(next);
+			}
+		}
+
+		// keep one empty block per pool around for the next resource
+		if (--block.allocationCount == 0u && (block.dedicated || pool.blocks.size() > 1u))
+		{
+			destroyBlock(block);
+			pool.blocks.erase(it);
+		}
+		break;
+	}
+
+	_allocation = Allocation{};
+}
+
+VkMappedMemoryRange IBLLib::MemoryArena::getMappedRange(const Allocation& _allocation) const
+{
+	// offset and size are atom aligned for non coherent memory, see allocate
+	VkMappedMemoryRange range{};
+	range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+	range.memory = _allocation.memory;
+	range.offset = _allocation.offset;
+	range.size = _allocation.size;
+	return range;
+}
+
+VkResult IBLLib::MemoryArena::flush(const Allocation& _allocation) const
+{
+	if (_allocation.coherent || _allocation.mapped == nullptr)
+	{
+		return VK_SUCCESS;
+	}
+
+	const VkMappedMemoryRange range = getMappedRange(_allocation);
+	return vkFlushMappedMemoryRanges(m_device, 1u, &range);
+}
+
+VkResult IBLLib::MemoryArena::invalidate(const Allocation& _allocation) const
+{
+	if (_allocation.coherent || _allocation.mapped == nullptr)
+	{
+		return VK_SUCCESS;
+	}
+
+	const VkMappedMemoryRange range = getMappedRange(_allocation);
+	return vkInvalidateMappedMemoryRanges(m_device, 1u, &range);
 }
 
 const VkSpecializationInfo* IBLLib::SpecConstantFactory::getInfo()
@@ -1406,15 +2113,35 @@ void IBLLib::DescriptorSetInfo::addBinding(VkDescriptorType _type, uint32_t _cou
 void IBLLib::DescriptorSetInfo::addCombinedImageSampler(VkSampler _sampler, VkImageView _imageView, VkImageLayout _imageLayout, uint32_t _binding, VkShaderStageFlags _stages)
 {
 	addBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1u, _stages, _binding);
+	m_firstResource.push_back(m_resources.size());
 	m_resources.emplace_back(_sampler, _imageView, _imageLayout);
 }
 
 void IBLLib::DescriptorSetInfo::addUniform(VkBuffer _uniform, VkDeviceSize _offset, VkDeviceSize _range, uint32_t _binding, VkShaderStageFlags _stages)
 {
 	addBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1u, _stages, _binding);
+	m_firstResource.push_back(m_resources.size());
 	m_resources.emplace_back(_uniform, _offset, _range);
 }
 
+void IBLLib::DescriptorSetInfo::addStorageBuffer(VkBuffer _buffer, VkDeviceSize _offset, VkDeviceSize _range, uint32_t _binding, VkShaderStageFlags _stages)
+{
+	addBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1u, _stages, _binding);
+	m_firstResource.push_back(m_resources.size());
+	m_resources.emplace_back(_buffer, _offset, _range);
+}
+
+void IBLLib::DescriptorSetInfo::addStorageImages(const std::vector<VkImageView>& _imageViews, VkImageLayout _imageLayout, uint32_t _binding, VkShaderStageFlags _stages)
+{
+	addBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, static_cast<uint32_t>(_imageViews.size()), _stages, _binding);
+	m_firstResource.push_back(m_resources.size());
+
+	for (VkImageView view : _imageViews)
+	{
+		m_resources.emplace_back(VkSampler(VK_NULL_HANDLE), view, _imageLayout);
+	}
+}
+
 VkResult IBLLib::DescriptorSetInfo::create(vkHelper& _instance, std::vector<VkDescriptorSetLayout>& _outLayouts, std::vector<VkDescriptorSet>& _outDescriptorSets)
 {
 	_outLayouts.emplace_back();
@@ -1441,45 +2168,45 @@ VkResult IBLLib::DescriptorSetInfo::create(vkHelper& _instance, VkDescriptorSetL
 
 	_outDescriptorSet = m_descriptorSet;
 
-	if (m_bindings.size() != m_resources.size())
+	return fillWrites(m_descriptorSet);
+}
+
+VkResult IBLLib::DescriptorSetInfo::fillWrites(VkDescriptorSet _descriptorSet)
+{
+	if (m_bindings.size() != m_firstResource.size())
 	{
 		return VK_RESULT_MAX_ENUM;
 	}
 
-	m_writes.resize(m_resources.size());
+	m_descriptorSet = _descriptorSet;
+	m_writes.resize(m_bindings.size());
 
-	for (size_t i = 0; i < m_resources.size(); i++)
+	for (size_t i = 0; i < m_bindings.size(); i++)
 	{
 		const VkDescriptorSetLayoutBinding& binding = m_bindings[i];
+		Resource& resource = m_resources[m_firstResource[i]];
 
 		VkWriteDescriptorSet& write = m_writes[i];
 		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 		write.pNext = nullptr;
 
 		write.descriptorType = binding.descriptorType;
-
-		// TODO: support arrays
-		if (binding.descriptorCount > 1u)
-		{
-			continue;
-		}
-
-		write.descriptorCount = 1u; //binding.descriptorCount;
+		write.descriptorCount = binding.descriptorCount;
 		write.dstArrayElement = 0u;
 		write.dstBinding = binding.binding;
 		write.dstSet = m_descriptorSet;
 
 		if (write.descriptorType <= VK_DESCRIPTOR_TYPE_STORAGE_IMAGE)
 		{
-			write.pImageInfo = &m_resources[i].image;
+			write.pImageInfo = &resource.image;
 		}
 		else if (write.descriptorType <= VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC)
 		{
-			write.pBufferInfo = &m_resources[i].buffer;
+			write.pBufferInfo = &resource.buffer;
 		}
 	}
 
-	return res;
+	return VK_SUCCESS;
 }
 
 void IBLLib::vkHelper::updateDescriptorSets(const std::vector<VkWriteDescriptorSet>& _writes, const std::vector<VkCopyDescriptorSet>& _copies) const
@@ -1511,10 +2238,9 @@ IBLLib::GraphicsPipelineDesc::GraphicsPipelineDesc()
 	m_dynamicState.pNext = nullptr;
 
 	// enable all dynamic states, dont bake these into pipeline
-	static const VkDynamicState dynamicStates[] =
+	// viewport & scissor are opt-in, see setDynamicViewport
+	m_dynamicStates =
 	{ 
-	//	VK_DYNAMIC_STATE_VIEWPORT,
-	//	VK_DYNAMIC_STATE_SCISSOR,
 		VK_DYNAMIC_STATE_LINE_WIDTH,
 		VK_DYNAMIC_STATE_DEPTH_BIAS,
 		VK_DYNAMIC_STATE_BLEND_CONSTANTS,
@@ -1524,9 +2250,6 @@ IBLLib::GraphicsPipelineDesc::GraphicsPipelineDesc()
 		VK_DYNAMIC_STATE_STENCIL_REFERENCE
 	};
 
-	m_dynamicState.dynamicStateCount = static_cast<uint32_t>(sizeof(dynamicStates) / sizeof(VkDynamicState));
-	m_dynamicState.pDynamicStates = dynamicStates;
-
 	// rasterizer defaults
 	// TODO: add setters for rasterizer configuration
 	m_rasterState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -1646,9 +2369,18 @@ void IBLLib::GraphicsPipelineDesc::setViewportExtent(VkExtent2D _extent)
 	m_viewportScissor.extent = _extent;
 }
 
+void IBLLib::GraphicsPipelineDesc::setDynamicViewport()
+{
+	m_dynamicStates.push_back(VK_DYNAMIC_STATE_VIEWPORT);
+	m_dynamicStates.push_back(VK_DYNAMIC_STATE_SCISSOR);
+}
+
 const VkGraphicsPipelineCreateInfo* IBLLib::GraphicsPipelineDesc::getInfo()
 {
 	// finalize info with dynamic data
+	m_dynamicState.dynamicStateCount = static_cast<uint32_t>(m_dynamicStates.size());
+	m_dynamicState.pDynamicStates = m_dynamicStates.data();
+
 	m_viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	m_viewportState.flags = 0;
 	m_viewportState.pNext = NULL;
@@ -1,10 +1,88 @@
 #pragma once
 
 #include <vulkan/vulkan.h>
+#include <string.h>
 #include <vector>
+#include <string>
+#include <unordered_map>
 
 namespace IBLLib
 {
+	// sub-allocates resources from large VkDeviceMemory blocks, drivers limit the number of live allocations
+	class MemoryArena
+	{
+	public:
+		struct Allocation
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize offset = 0u;
+			VkDeviceSize size = 0u;
+			void* mapped = nullptr; // host visible blocks stay mapped for their whole lifetime
+			bool coherent = true;
+			uint32_t pool = 0u;
+		};
+
+		void initialize(VkDevice _device, const VkPhysicalDeviceMemoryProperties& _properties, VkDeviceSize _nonCoherentAtomSize, VkDeviceSize _blockSize = 64u << 20);
+		void shutdown();
+
+		// linear and optimal resources never share a block, so bufferImageGranularity does not apply
+		VkResult allocate(const VkMemoryRequirements& _requirements, uint32_t _memoryTypeIndex, bool _linear, Allocation& _outAllocation);
+		void free(Allocation& _allocation);
+
+		// no-ops for host coherent memory
+		VkResult flush(const Allocation& _allocation) const;
+		VkResult invalidate(const Allocation& _allocation) const;
+
+	private:
+		struct Range
+		{
+			VkDeviceSize offset;
+			VkDeviceSize size;
+		};
+
+		struct Block
+		{
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDeviceSize size = 0u;
+			void* mapped = nullptr;
+			uint32_t allocationCount = 0u;
+			bool dedicated = false;
+			std::vector<Range> freeRanges; // sorted by offset, neighbours are always merged
+		};
+
+		struct Pool
+		{
+			uint32_t memoryTypeIndex = 0u;
+			std::vector<Block> blocks;
+		};
+
+		VkResult createBlock(Pool& _pool, VkDeviceSize _size, bool _dedicated);
+		void destroyBlock(Block& _block);
+		static bool suballocate(Block& _block, VkDeviceSize _size, VkDeviceSize _alignment, VkDeviceSize& _outOffset);
+		VkMappedMemoryRange getMappedRange(const Allocation& _allocation) const;
+
+		VkDevice m_device = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties m_properties{};
+		VkDeviceSize m_nonCoherentAtomSize = 1u;
+		VkDeviceSize m_blockSize = 0u;
+
+		std::vector<Pool> m_pools; // two per memory type: optimal images, linear resources
+	};
+
+	enum class QueueType : uint32_t
+	{
+		Graphics = 0u,
+		// dedicated transfer family if the device has one, otherwise the graphics queue
+		Transfer = 1u
+	};
+
+	// identifies a submission on one queue, value 0 means nothing was submitted
+	struct Submission
+	{
+		QueueType queue = QueueType::Graphics;
+		uint64_t value = 0u;
+	};
+
 	class vkHelper
 	{
 		friend class DescriptorSetInfo;
@@ -17,12 +95,13 @@ namespace IBLLib
 
 		void shutdown();
 
-		VkResult createCommandBuffer(VkCommandBuffer& _outCmdBuffer, VkCommandBufferLevel _level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) const;
+		// command buffers can only be submitted to the queue they were created for
+		VkResult createCommandBuffer(VkCommandBuffer& _outCmdBuffer, VkCommandBufferLevel _level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, QueueType _queue = QueueType::Graphics) const;
 
 		// command buffers are owned by this vkHelper instance, do not reset or destory manually
-		VkResult createCommandBuffers(std::vector<VkCommandBuffer>& _outCmdBuffers, uint32_t _count, VkCommandBufferLevel _level = VK_COMMAND_BUFFER_LEVEL_PRIMARY) const;
+		VkResult createCommandBuffers(std::vector<VkCommandBuffer>& _outCmdBuffers, uint32_t _count, VkCommandBufferLevel _level = VK_COMMAND_BUFFER_LEVEL_PRIMARY, QueueType _queue = QueueType::Graphics) const;
 
-		void destroyCommandBuffer(VkCommandBuffer _cmdBuffer) const;
+		void destroyCommandBuffer(VkCommandBuffer _cmdBuffer, QueueType _queue = QueueType::Graphics) const;
 
 		VkResult beginCommandBuffer(VkCommandBuffer _cmdBuffer, VkCommandBufferUsageFlags _flags = 0u) const;
 
@@ -32,10 +111,22 @@ namespace IBLLib
 
 		VkResult endCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers) const;
 
-		VkResult executeCommandBuffer(VkCommandBuffer _cmdBuffer) const;
+		VkResult executeCommandBuffer(VkCommandBuffer _cmdBuffer, QueueType _queue = QueueType::Graphics);
 
 		// make sure there are no dependencies between command buffers. this method is blocking
-		VkResult executeCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers) const;
+		VkResult executeCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers, QueueType _queue = QueueType::Graphics);
+
+		// non blocking submit, _outSubmission is the timeline value reached once the command buffers completed.
+		// submissions of one queue complete in order, the command buffers have to stay alive until then.
+		// _waitSubmission, which may come from the other queue, delays the execution on the gpu until it completed
+		VkResult submitCommandBuffer(VkCommandBuffer _cmdBuffer, Submission& _outSubmission, const Submission& _waitSubmission = {}, QueueType _queue = QueueType::Graphics);
+		VkResult submitCommandBuffers(const std::vector<VkCommandBuffer>& _cmdBuffers, Submission& _outSubmission, const Submission& _waitSubmission = {}, QueueType _queue = QueueType::Graphics);
+
+		// blocks until the submission and all earlier ones on its queue completed
+		VkResult waitForSubmission(const Submission& _submission, uint64_t _timeout = UINT64_MAX);
+		bool isSubmissionComplete(const Submission& _submission);
+
+		bool hasDedicatedTransferQueue() const { return m_dedicatedTransfer; }
 
 		VkResult loadShaderModule(VkShaderModule& _outShader, const uint32_t* _spvBlob, size_t _spvBlobByteSize);
 
@@ -69,19 +160,29 @@ namespace IBLLib
 		// pipelines are owned by this vkHelper instance, do not destory manually
 		VkResult createPipeline(VkPipeline& _outPipeline, const VkGraphicsPipelineCreateInfo* _pCreateInfo);
 
+		// pipelines are owned by this vkHelper instance, do not destory manually
+		VkResult createComputePipeline(VkPipeline& _outPipeline, VkPipelineLayout _layout, VkShaderModule _shaderModule, const char* _entryPoint, const VkSpecializationInfo* _specInfo = nullptr);
+
 		// renderpasses are owned by this vkHelper instance, do not destory manually
 		VkResult createRenderPass(VkRenderPass& _outRenderPass, const VkRenderPassCreateInfo* _pCreateInfo);
 
 		// returns true if memory type is supported by the device
 		bool getMemoryTypeIndex(const VkMemoryRequirements& _requirements, VkMemoryPropertyFlags _properties, uint32_t& _outIndex);
 
-		VkResult createBufferAndAllocate(VkBuffer& _outBuffer, uint32_t _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VkSharingMode _sharingMode = VK_SHARING_MODE_EXCLUSIVE, VkBufferCreateFlags _flags = 0u);
+		VkResult createBufferAndAllocate(VkBuffer& _outBuffer, VkDeviceSize _byteSize, VkBufferUsageFlags _usage, VkMemoryPropertyFlags _memoryFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VkSharingMode _sharingMode = VK_SHARING_MODE_EXCLUSIVE, VkBufferCreateFlags _flags = 0u);
+
+		// host readable buffer for gpu to host copies, prefers cached memory and stays mapped until it is destroyed
+		VkResult createReadbackBuffer(VkBuffer& _outBuffer, VkDeviceSize _byteSize, VkBufferUsageFlags _usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT);
 
 		void destroyBuffer(VkBuffer _buffer);
 
 		VkResult writeBufferData(VkBuffer _buffer, const void* _pData, size_t _bytes);
 		VkResult readBufferData(VkBuffer _buffer, void* _pData, size_t _bytes, size_t _offset=0u);
 
+		// maps host visible buffer memory so it can be filled in place, must be paired with unmapBuffer
+		VkResult mapBuffer(VkBuffer _buffer, void*& _outData, size_t _bytes, size_t _offset = 0u);
+		void unmapBuffer(VkBuffer _buffer);
+
 		VkResult createImage2DAndAllocate(VkImage& _outImage, uint32_t _width, uint32_t _height,
 			VkFormat _format, VkImageUsageFlags _usage,
 			uint32_t _mipLevels = 1u, uint32_t _arrayLayers = 1u,
@@ -102,7 +203,22 @@ namespace IBLLib
 			VkImageLayout _oldLayout, VkImageLayout _newLayout,
 			VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess,
 			VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess,
-			VkImageSubresourceRange _subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u}) const;
+			VkImageSubresourceRange _subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u},
+			uint32_t _srcQueueFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t _dstQueueFamily = VK_QUEUE_FAMILY_IGNORED) const;
+
+		// queue family ownership transfer of an exclusive image. the release is recorded on the source queue, the acquire
+		// with the same layouts on the destination queue, whose submission has to wait for the releasing one
+		void releaseImage(VkCommandBuffer _cmdBuffer, VkImage _image,
+			VkImageLayout _oldLayout, VkImageLayout _newLayout,
+			VkPipelineStageFlags _srcStage, VkAccessFlags _srcAccess,
+			QueueType _srcQueue, QueueType _dstQueue,
+			VkImageSubresourceRange _subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u }) const;
+
+		void acquireImage(VkCommandBuffer _cmdBuffer, VkImage _image,
+			VkImageLayout _oldLayout, VkImageLayout _newLayout,
+			VkPipelineStageFlags _dstStage, VkAccessFlags _dstAccess,
+			QueueType _srcQueue, QueueType _dstQueue,
+			VkImageSubresourceRange _subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0u, 1u, 0u, 1u }) const;
 
 		void transitionImageToTransferWrite(VkCommandBuffer _cmdBuffer, VkImage _image, VkImageLayout _oldLayout = VK_IMAGE_LAYOUT_UNDEFINED) const
 		{
@@ -129,53 +245,100 @@ namespace IBLLib
 		// simpler helper function using views attached to VkImage
 		VkResult createFramebuffer(VkFramebuffer& _outFramebuffer, VkRenderPass _renderPass, VkImage _image);
 
+		void destroyFramebuffer(VkFramebuffer _framebuffer);
+
 		void beginRenderPass(VkCommandBuffer _cmdBuffer, VkRenderPass _renderPass, VkFramebuffer _framebuffer, const VkRect2D& _area, const std::vector<VkClearValue>& _clearValues = {}, VkSubpassContents _contents = VK_SUBPASS_CONTENTS_INLINE) const;
 
 		void endRenderPass(VkCommandBuffer _cmdBuffer) const { vkCmdEndRenderPass(_cmdBuffer); };
 
+		// only valid for pipelines created with GraphicsPipelineDesc::setDynamicViewport
+		void setViewportAndScissor(VkCommandBuffer _cmdBuffer, VkExtent2D _extent) const;
+
 		void fillSamplerCreateInfo(VkSamplerCreateInfo& _samplerInfo);
 		VkResult createSampler(VkSampler& _outSampler, VkSamplerCreateInfo _info);
 
 		const VkImageCreateInfo* getCreateInfo(const VkImage _image);
 
+		const VkPhysicalDeviceProperties& getDeviceProperties() const { return m_deviceProperties; }
+		// format features of images with VK_IMAGE_TILING_OPTIMAL
+		VkFormatFeatureFlags getOptimalTilingFeatures(VkFormat _format) const;
+		// optional features are enabled on the logical device if the physical device supports them
+		const VkPhysicalDeviceFeatures& getEnabledFeatures() const { return m_enabledFeatures; }
+
 	private:
 		struct Buffer
 		{
 			VkBufferCreateInfo info{};
 			VkBuffer buffer = VK_NULL_HANDLE;
-			VkDeviceMemory memory = VK_NULL_HANDLE;
-			void destroy(VkDevice _device);
+			MemoryArena::Allocation allocation;
+			void destroy(VkDevice _device, MemoryArena& _arena);
 		};
 
 		struct Image
 		{
 			VkImageCreateInfo info{};
 			VkImage image = VK_NULL_HANDLE;
-			VkDeviceMemory memory = VK_NULL_HANDLE;
+			MemoryArena::Allocation allocation;
 			std::vector<VkImageView> views;
-			void destroy(VkDevice _device);
+			void destroy(VkDevice _device, MemoryArena& _arena);
 		};
 
+		// fallback for devices without timeline semaphores, fences are recycled once signaled
+		struct PendingSubmission
+		{
+			uint64_t value;
+			VkFence fence;
+		};
+
+		struct SubmissionQueue
+		{
+			VkQueue queue = VK_NULL_HANDLE;
+			uint32_t familyIndex = 0u;
+			VkCommandPool commandPool = VK_NULL_HANDLE;
+			VkSemaphore timeline = VK_NULL_HANDLE;
+			uint64_t submittedValue = 0u;
+			uint64_t completedValue = 0u;
+			std::vector<PendingSubmission> pendingSubmissions;
+			std::vector<VkFence> freeFences;
+		};
+
+		QueueType resolveQueue(QueueType _queue) const { return m_dedicatedTransfer ? _queue : QueueType::Graphics; }
+		SubmissionQueue& getQueue(QueueType _queue) { return m_queues[static_cast<uint32_t>(resolveQueue(_queue))]; }
+		const SubmissionQueue& getQueue(QueueType _queue) const { return m_queues[static_cast<uint32_t>(resolveQueue(_queue))]; }
+
+		VkResult retireSubmissions(SubmissionQueue& _queue, uint64_t _value, uint64_t _timeout);
+
+		Buffer* findBuffer(VkBuffer _buffer);
+		Image* findImage(VkImage _image);
+		const Image* findImage(VkImage _image) const;
+
 		VkInstance m_instance = VK_NULL_HANDLE;
+		uint32_t m_instanceVersion = VK_API_VERSION_1_0;
 		VkPhysicalDevice m_physicalDevice = VK_NULL_HANDLE;
+		VkPhysicalDeviceProperties m_deviceProperties{};
 		VkPhysicalDeviceFeatures m_deviceFeatures{};
+		VkPhysicalDeviceFeatures m_enabledFeatures{};
 		VkPhysicalDeviceMemoryProperties m_memoryProperties{};
 
 		VkDevice m_logicalDevice = VK_NULL_HANDLE;
-		VkQueue m_queue = VK_NULL_HANDLE;
-		uint32_t m_queueFamilyIndex = 0u;
-		VkCommandPool m_commandPool = VK_NULL_HANDLE;
+		SubmissionQueue m_queues[2]; // indexed by QueueType
+		bool m_dedicatedTransfer = false;
 		VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
 		VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
 
+		PFN_vkWaitSemaphores m_vkWaitSemaphores = nullptr;
+		PFN_vkGetSemaphoreCounterValue m_vkGetSemaphoreCounterValue = nullptr;
+		std::string m_pipelineCachePath;
+
 		std::vector<VkShaderModule> m_shaderModules;
 		std::vector<VkDescriptorSetLayout> m_descriptorSetLayouts;
 		std::vector<VkPipelineLayout> m_pipelineLayouts;
 		std::vector<VkPipeline> m_pipelines;
 		std::vector<VkRenderPass> m_renderPasses;
 		std::vector<VkFramebuffer> m_frameBuffers;
-		std::vector<Buffer> m_buffers;
-		std::vector<Image> m_images;
+		MemoryArena m_memoryArena;
+		std::unordered_map<VkBuffer, Buffer> m_buffers;
+		std::unordered_map<VkImage, Image> m_images;
 		std::vector<VkSampler> m_samplers;
 
 		bool m_debugOutputEnabled;
@@ -216,11 +379,17 @@ namespace IBLLib
 
 		void addCombinedImageSampler(VkSampler _sampler, VkImageView _imageView, VkImageLayout _imageLayout, uint32_t _binding = UINT32_MAX, VkShaderStageFlags _stages = VK_SHADER_STAGE_FRAGMENT_BIT);
 		void addUniform(VkBuffer _uniform, VkDeviceSize _offset = 0u, VkDeviceSize _range = VK_WHOLE_SIZE, uint32_t _binding = UINT32_MAX, VkShaderStageFlags _stages = VK_SHADER_STAGE_ALL_GRAPHICS);
+		void addStorageBuffer(VkBuffer _buffer, VkDeviceSize _offset = 0u, VkDeviceSize _range = VK_WHOLE_SIZE, uint32_t _binding = UINT32_MAX, VkShaderStageFlags _stages = VK_SHADER_STAGE_COMPUTE_BIT);
+		// adds an array binding with one element per view
+		void addStorageImages(const std::vector<VkImageView>& _imageViews, VkImageLayout _imageLayout = VK_IMAGE_LAYOUT_GENERAL, uint32_t _binding = UINT32_MAX, VkShaderStageFlags _stages = VK_SHADER_STAGE_COMPUTE_BIT);
 
 		// helper function that creates layout and descriptor set and VkWriteDescriptorSets
 		VkResult create(vkHelper& _instance, std::vector<VkDescriptorSetLayout>& _outLayouts, std::vector<VkDescriptorSet>& _outDescriptorSets);
 		VkResult create(vkHelper& _instance, VkDescriptorSetLayout& _outLayout, VkDescriptorSet& _outDescriptorSet);
 
+		// fills the VkWriteDescriptorSets for an already allocated set, e.g. to point a persistent set to new resources
+		VkResult fillWrites(VkDescriptorSet _descriptorSet);
+
 		const VkDescriptorSetLayoutCreateInfo* getLayoutCreateInfo();
 		const std::vector<VkWriteDescriptorSet>& getWrites() const { return m_writes; }
 
@@ -243,6 +412,7 @@ namespace IBLLib
 		};
 
 		std::vector<VkDescriptorSetLayoutBinding> m_bindings;
+		std::vector<size_t> m_firstResource; // index into m_resources per binding, array elements are stored consecutively
 		std::vector<Resource> m_resources;
 		std::vector<VkWriteDescriptorSet> m_writes;
 
@@ -273,6 +443,8 @@ namespace IBLLib
 		void setRenderPass(VkRenderPass _renderPass);
 		void setPipelineLayout(VkPipelineLayout _pipelineLayout);
 		void setViewportExtent(VkExtent2D _extent);
+		// viewport and scissor are set when recording, the pipeline can be used for any framebuffer size
+		void setDynamicViewport();
 
 		const VkGraphicsPipelineCreateInfo* getInfo();
 	private:
@@ -296,6 +468,7 @@ namespace IBLLib
 		VkPipelineDepthStencilStateCreateInfo m_depthStencilState{};
 		VkPipelineColorBlendStateCreateInfo  m_colorBlendState{};
 		VkPipelineDynamicStateCreateInfo m_dynamicState{};
+		std::vector<VkDynamicState> m_dynamicStates;
 	};
 
 	class RenderPassDesc